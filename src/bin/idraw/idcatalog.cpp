@@ -33,6 +33,8 @@
 #include "idclasses.h"
 #include "idcomp.h"
 
+#include <Unidraw/uscanner.h>
+
 #include <Unidraw/Components/ellipse.h>
 #include <Unidraw/Components/polygon.h>
 #include <Unidraw/Components/psformat.h>
@@ -141,11 +143,11 @@ boolean IdrawCatalog::Retrieve (const char* name, Component*& comp) {
         _valid = Catalog::Retrieve(name, comp);
 
     } else {
-        filebuf fbuf;
-        _valid = fbuf.open(name, IOS_IN) != 0;
+        UScanner scanner(name);
+        _valid = scanner.Valid();
 
         if (_valid) {
-            istream in(&fbuf);
+            istream in(&scanner);
             comp = ReadPostScript(in);
 
             if (_valid) {
@@ -1,6 +1,8 @@
 #define Dispatcher _lib_dp(Dispatcher)
+#define DispatcherBackend _lib_dp(DispatcherBackend)
 #define FdMask _lib_dp(FdMask)
 #define IOHandler _lib_dp(IOHandler)
+#define RpcFlusher _lib_dp(RpcFlusher)
 #define RpcHdr _lib_dp(RpcHdr)
 #define RpcPeer _lib_dp(RpcPeer)
 #define RpcReader _lib_dp(RpcReader)
@@ -1,6 +1,8 @@
 #undef Dispatcher
+#undef DispatcherBackend
 #undef FdMask
 #undef IOHandler
+#undef RpcFlusher
 #undef RpcHdr
 #undef RpcPeer
 #undef RpcReader
@@ -31,6 +31,7 @@
 
 #include <Dispatch/enter-scope.h>
 
+class DispatcherBackend;
 class FdMask;
 class IOHandler;
 class TimerQueue;
@@ -51,6 +52,7 @@ public:
     virtual void link(int fd, DispatcherMask, IOHandler*);
     virtual IOHandler* handler(int fd, DispatcherMask) const;
     virtual void unlink(int fd);
+    virtual void unlink(int fd, DispatcherMask);
 
     virtual void startTimer(long sec, long usec, IOHandler*);
     virtual void stopTimer(IOHandler*);
@@ -75,6 +77,7 @@ protected:
     virtual timeval* calculateTimeout(timeval*) const;
     virtual boolean handleError();
     virtual void checkConnections();
+    void growTables(int);
 protected:
     int	_nfds;
     FdMask* _rmask;
@@ -86,8 +89,10 @@ protected:
     IOHandler** _rtable;
     IOHandler** _wtable;
     IOHandler** _etable;
+    int _ntable;
     TimerQueue* _queue;
     ChildQueue* _cqueue;
+    DispatcherBackend* _backend;
 
 #if defined(HAVE_BSD_SIGNALS) || defined(HAVE_POSIX_SIGNALS)
     static RETSIGTYPE sigCLD(int);
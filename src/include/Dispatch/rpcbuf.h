@@ -25,8 +25,11 @@
 #ifndef dp_rpcbuf_h
 #define dp_rpcbuf_h
 
+#include <Dispatch/iohandler.h>
 #include <Dispatch/iostreamb.h>
 
+class RpcFlusher;
+
 // Specialize streambuf to sending and receiving RPC requests to and
 // from remote machines.
 
@@ -40,6 +43,10 @@ public:
     int fd();
     boolean opened();
     boolean nonblocking();
+    int pending();
+    int queued();
+    int highwater();
+    boolean congested();
 
     enum { anyport = 0 };
     rpcbuf* listen(int port);
@@ -47,10 +54,12 @@ public:
     rpcbuf* accept(int& fd);
     rpcbuf* attach(int fd);
     rpcbuf* nonblocking(boolean);
+    rpcbuf* highwater(int);
     rpcbuf* verbose(boolean);
     rpcbuf* close();
     int start_request();
     int read_request();
+    int append(const void*, int);
 
     virtual int overflow(int c = EOF);
     virtual int underflow();
@@ -64,8 +73,19 @@ public:
 protected:
     virtual int doallocate();
     void finish_request();
+    int length_width();
+    void store_length(char*, int);
+    int load_length(const char*);
     boolean expand_g(int);
     boolean expand_p();
+    int push();
+    int send(int);
+    int consume(int, int, int);
+    void enqueue(int);
+    void dequeue(int, int);
+    void output_wait(boolean);
+    int drain(int);
+    void discard();
     void error(const char*);
     void sys_error(const char*);
     iostreamb& mystream();
@@ -83,6 +103,39 @@ protected:
     boolean _close;		// should I close my file descriptor on exit?
     boolean _nonblocking;	// can I read or write without blocking?
     boolean _verbose;		// should I print system error messages?
+
+    struct Segment {
+	int offset;		// put area offset the data follows
+	const char* data;	// caller's data, sent in place
+	int length;
+    };
+    Segment* _segments;		// caller's data appended to requests
+    int _nsegments;
+    int _maxsegments;
+    int _rsegbytes;		// bytes appended to outgoing RPC request
+
+    int* _queue;		// lengths of finished RPC requests not yet sent
+    int _qhead;
+    int _qcount;
+    int _qmax;
+    int _qbytes;		// unsent bytes of those requests
+    int _highwater;		// max queued bytes before overflow waits
+    RpcFlusher* _flusher;	// sends queued output when writable
+    boolean _flushing;		// is _flusher linked to the Dispatcher?
+
+    friend class RpcFlusher;
+};
+
+// Send output queued by a nonblocking rpcbuf when its connection
+// becomes writable.
+
+class RpcFlusher : public IOHandler {
+public:
+    RpcFlusher(rpcbuf*);
+
+    virtual int outputReady(int);
+protected:
+    rpcbuf* _buf;
 };
 
 // Get the stream which will format the length field of RPC requests.
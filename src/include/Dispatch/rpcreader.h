@@ -40,6 +40,9 @@ class rpcstream;
 class RpcReader : public IOHandler {
 public:
     virtual ~RpcReader();
+
+    int batch();
+    void batch(int);
 protected:
     RpcReader(rpcstream* client, int nfcns);
     RpcReader(int fd, int nfcns, boolean binary);
@@ -48,6 +51,7 @@ protected:
     virtual int inputReady(int);
     virtual RpcReader* map(unsigned long);
     boolean execute(RpcReader*, RpcHdr&);
+    virtual void batchExecuted(int fd, int nrequests);
     virtual void connectionClosed(int fd) = 0;
 protected:
     typedef void (*PF)(RpcReader*, RpcHdr&, rpcstream&);
@@ -56,6 +60,7 @@ protected:
     rpcstream* _client;		/* source of RPC requests coming from client */
     boolean _delete;		/* should the destructor delete _client? */
     int _fd;			/* file number of connection with client */
+    int _batch;			/* max requests per wakeup (0 = no limit) */
 private:
     /* deny access since unimplemented and member-wise won't work */
     RpcReader(const RpcReader&);
@@ -66,4 +71,12 @@ inline rpcstream& RpcReader::client() {
     return *_client;
 }
 
+inline int RpcReader::batch() {
+    return _batch;
+}
+
+inline void RpcReader::batch(int nrequests) {
+    _batch = (nrequests < 0) ? 0 : nrequests;
+}
+
 #endif
@@ -37,6 +37,7 @@ public:
     ~RpcWriter();
 
     rpcstream& server();
+    boolean congested();
 protected:
     RpcWriter(const char* path, boolean fatal, boolean binary);
     RpcWriter(const char* host, int port, boolean fatal, boolean binary);
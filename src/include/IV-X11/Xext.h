@@ -74,6 +74,10 @@ void XShapeSelectInput (Display*, XWindow, Bool);
 unsigned long XShapeInputSelected (Display*, XWindow);
 XRectangle *XShapeGetRectangles (Display*, XWindow, int, int*, int*);
 
+#ifdef HAVE_X11_EXTENSIONS_XSHM_H
+#include <X11/extensions/XShm.h>
+#endif
+
 #include <IV-X11/Xundefs.h>
 
 }
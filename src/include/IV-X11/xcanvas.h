@@ -55,13 +55,12 @@ public:
     GC drawgc_;
     int x0_;
     int y0_;
-    Coord width_;
     Coord curx_;
     Coord cury_;
     char* text_;
     char* cur_text_;
-    int spaces_;
-    XTextItem* items_;
+    XTextItem* items_;		/* delta is the pixel x until flushed */
+    int item_count_;
 };
 
 class PathRenderInfo {
@@ -76,6 +75,18 @@ public:
     XPoint* end_point_;
 };
 
+class BatchRenderInfo {
+public:
+#ifdef _DELTA_EXTENSIONS
+#pragma __static_class
+#endif
+    CanvasRep* canvas_;
+    int kind_;
+    int count_;
+    XSegment* segments_;
+    XRectangle* rects_;
+};
+
 class CanvasRep {
 public:
 #ifdef _DELTA_EXTENSIONS
@@ -89,10 +100,18 @@ public:
     PixelCoord pwidth_;
     PixelCoord pheight_;
 
+    enum { max_damage = 8 };
+
     boolean damaged_ : 1;
     boolean on_damage_list_ : 1;
     boolean repairing_ : 1;
-    CanvasDamage damage_;
+    CanvasDamage damage_;			/* bounds of the whole list */
+    CanvasDamage damage_list_[max_damage];
+    int damage_count_;
+    Coord damage_area_;				/* as requested, overlaps and all */
+
+    unsigned long damaged_pixels_;		/* for the last repair */
+    unsigned long redrawn_pixels_;
 
     XDrawable drawbuffer_;
     XDrawable copybuffer_;
@@ -104,6 +123,10 @@ public:
     Region empty_;
     GC drawgc_;
     GC copygc_;
+    GC stencilgc_;				/* for stencil, made on first use */
+    GC xorgc_;
+    unsigned long xor_pixel_;
+    boolean stencil_clip_;			/* both have drawgc_'s clip */
     int op_;
     Pixmap stipple_;
     unsigned long pixel_;
@@ -120,18 +143,22 @@ public:
 
     static TextRenderInfo text_;
     static PathRenderInfo path_;
+    static BatchRenderInfo batch_;
 
     enum { unbound = 0 };
+    enum { batch_segments = 1, batch_rectangles, batch_fills };
 
     XDisplay* dpy() const;
     Transformer& matrix() const;
 
     void flush();
+    boolean batch(int kind, const Color*, const Brush*);
     void swapbuffers();
     void brush(const Brush*);
     void color(const Color*);
     void font(const Font*);
 
+    void add_damage(Coord left, Coord bottom, Coord right, Coord top);
     void new_damage();
     void clear_damage();
     boolean start_repair();
@@ -147,6 +174,31 @@ public:
     void wait_for_copy();
 };
 
+/*
+ * Transformed (scaled or rotated) copies of bitmaps and rasters
+ * are kept in a cache bounded by the total size of their pixmaps.
+ * The least recently drawn copies are freed first.  The budget
+ * defaults to the "transformedImageCache" style attribute (in kilobytes).
+ */
+
+class TxImageCache {
+public:
+#ifdef _DELTA_EXTENSIONS
+#pragma __static_class
+#endif
+    static void budget(unsigned long bytes);
+    static unsigned long budget();
+    static unsigned long size();
+    static unsigned long count();
+
+    static unsigned long hits();
+    static unsigned long misses();
+    static unsigned long evictions();
+
+    static void purge(const void* source);
+    static void clear();
+};
+
 #include <InterViews/_leave.h>
 
 #endif
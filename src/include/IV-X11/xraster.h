@@ -35,6 +35,7 @@
 #include <InterViews/_enter.h>
 
 class Display;
+class RasterShm;
 
 class RasterRep {
 public:
@@ -54,6 +55,14 @@ public:
     XImage* image_;
     Pixmap pixmap_;
     GC gc_;
+
+    /* region of image_ not yet sent to pixmap_, valid if modified_ */
+    unsigned int damage_left_;
+    unsigned int damage_top_;
+    unsigned int damage_right_;
+    unsigned int damage_bottom_;
+
+    RasterShm* shm_;
 };
 
 #include <InterViews/_leave.h>
@@ -42,6 +42,7 @@
 #define BMPRaster _lib_iv(BMPRaster)
 #define Background _lib_iv(Background)
 #define Banner _lib_iv(Banner)
+#define BatchRenderInfo _lib_iv(BatchRenderInfo)
 #define Bevel _lib_iv(Bevel)
 #define BevelFrame _lib_iv(BevelFrame)
 #define Bitmap _lib_iv(Bitmap)
@@ -173,6 +174,8 @@
 #define MarginFrame _lib_iv(MarginFrame)
 #define MarginLayout _lib_iv(MarginLayout)
 #define MatchEditor _lib_iv(MatchEditor)
+#define MemoryCanvas _lib_iv(MemoryCanvas)
+#define MemoryCanvasRep _lib_iv(MemoryCanvasRep)
 #define Menu _lib_iv(Menu)
 #define MenuBar _lib_iv(MenuBar)
 #define MenuImpl _lib_iv(MenuImpl)
@@ -218,6 +221,7 @@
 #define RadioButton _lib_iv(RadioButton)
 #define Raster _lib_iv(Raster)
 #define RasterRep _lib_iv(RasterRep)
+#define RasterShm _lib_iv(RasterShm)
 #define Reducer _lib_iv(Reducer)
 #define Regexp _lib_iv(Regexp)
 #define ReqErr _lib_iv(ReqErr)
@@ -318,6 +322,7 @@
 #define TransientWindow _lib_iv(TransientWindow)
 #define Tray _lib_iv(Tray)
 #define TrayElement _lib_iv(TrayElement)
+#define TxImageCache _lib_iv(TxImageCache)
 #define UpMover _lib_iv(UpMover)
 #define VBorder _lib_iv(VBorder)
 #define VBox _lib_iv(VBox)
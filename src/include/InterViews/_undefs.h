@@ -42,6 +42,7 @@
 #undef BMPRaster
 #undef Background
 #undef Banner
+#undef BatchRenderInfo
 #undef Bevel
 #undef BevelFrame
 #undef Bitmap
@@ -173,6 +174,8 @@
 #undef MarginFrame
 #undef MarginLayout
 #undef MatchEditor
+#undef MemoryCanvas
+#undef MemoryCanvasRep
 #undef Menu
 #undef MenuBar
 #undef MenuImpl
@@ -218,6 +221,7 @@
 #undef RadioButton
 #undef Raster
 #undef RasterRep
+#undef RasterShm
 #undef Reducer
 #undef Regexp
 #undef ReqErr
@@ -318,6 +322,7 @@
 #undef TransientWindow
 #undef Tray
 #undef TrayElement
+#undef TxImageCache
 #undef UpMover
 #undef VBorder
 #undef VBox
@@ -53,6 +53,10 @@ public:
     virtual void poke(boolean set, int x, int y);
     virtual boolean peek(int x, int y) const;
 
+    /* a run of count bits in row y, packed most significant bit first */
+    virtual void poke_bits(int x, int y, int count, const unsigned char* bits);
+    virtual void peek_bits(int x, int y, int count, unsigned char* bits) const;
+
     virtual Coord width() const;
     virtual Coord height() const;
 
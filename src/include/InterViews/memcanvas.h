@@ -0,0 +1,86 @@
+/*
+ * MemoryCanvas - draw into an array of pixels
+ */
+
+#ifndef iv_memcanvas_h
+#define iv_memcanvas_h
+
+#include <InterViews/canvas.h>
+
+#include <ivstream.h>
+
+class MemoryCanvasRep;
+
+/*
+ * A canvas that renders into memory instead of a window, so glyphs
+ * can be drawn without an X server.  Pixels are 0xffRRGGBB, top row
+ * first; scale gives the number of pixels per point.  Paths, fills,
+ * clipping and transforms need no display.  Text, stencils and images
+ * are drawn from fonts, bitmaps and rasters, which still need one.
+ */
+
+class MemoryCanvas : public Canvas {
+public:
+    MemoryCanvas(PixelCoord width, PixelCoord height, float scale = 1.0);
+    virtual ~MemoryCanvas();
+
+    virtual void size(Coord width, Coord height);
+    virtual void psize(PixelCoord width, PixelCoord height);
+
+    virtual Coord width() const;
+    virtual Coord height() const;
+    virtual PixelCoord pwidth() const;
+    virtual PixelCoord pheight() const;
+
+    virtual PixelCoord to_pixels(Coord, DimensionName d = Dimension_X) const;
+    virtual Coord to_coord(PixelCoord, DimensionName d = Dimension_X) const;
+    virtual Coord to_pixels_coord(Coord, DimensionName d = Dimension_X) const;
+
+    virtual void new_path();
+    virtual void move_to(Coord x, Coord y);
+    virtual void line_to(Coord x, Coord y);
+    virtual void curve_to(
+	Coord x, Coord y, Coord x1, Coord y1, Coord x2, Coord y2
+    );
+    virtual void close_path();
+
+    virtual void stroke(const Color*, const Brush*);
+    virtual void fill(const Color*);
+    virtual void fill_rect(Coord l, Coord b, Coord r, Coord t, const Color*);
+
+    virtual void character(
+	const Font*, long ch, Coord width, const Color*, Coord x, Coord y
+    );
+    virtual void stencil(const Bitmap*, const Color*, Coord x, Coord y);
+    virtual void image(const Raster*, Coord x, Coord y);
+
+    virtual void push_clipping();
+    virtual void clip();
+    virtual void clip_rect(Coord l, Coord b, Coord r, Coord t);
+    virtual void pop_clipping();
+
+    /* the whole canvas is always considered damaged */
+    virtual void damage(const Extension&);
+    virtual void damage(Coord left, Coord bottom, Coord right, Coord top);
+    virtual boolean damaged(const Extension&) const;
+    virtual boolean damaged(
+	Coord left, Coord bottom, Coord right, Coord top
+    ) const;
+    virtual void damage_area(Extension&);
+    virtual void damage_all();
+    virtual boolean any_damage() const;
+    virtual void restrict_damage(const Extension&);
+    virtual void restrict_damage(
+	Coord left, Coord bottom, Coord right, Coord top
+    );
+
+    virtual void clear(const Color*);
+    virtual const unsigned int* pixels() const;
+    virtual void write(ostream&) const;	/* as a binary PPM file */
+private:
+    static const Bitmap* char_bitmap(const Font*, long ch);
+
+    MemoryCanvasRep* rep_;
+};
+
+#endif
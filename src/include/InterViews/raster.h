@@ -39,6 +39,9 @@ class RasterRep;
 
 class Raster : public Resource {
 public:
+    /* layouts for peek_pixels and poke_pixels, valued in bytes per pixel */
+    enum PixelFormat { gray8 = 1, rgb8 = 3, rgba8 = 4 };
+
     Raster(unsigned long width, unsigned long height);
     Raster(const Raster&);
     virtual ~Raster();
@@ -66,6 +69,23 @@ public:
 	float alpha
     );
 
+    /*
+     * Read or write a rectangle of pixels as packed 8-bit samples.
+     * The first row in the buffer is the top row of the rectangle
+     * and successive rows are stride bytes apart (zero for no padding).
+     */
+    virtual void peek_pixels(
+	unsigned long x, unsigned long y,
+	unsigned long width, unsigned long height,
+	unsigned char* pixels, PixelFormat, long stride = 0
+    ) const;
+
+    virtual void poke_pixels(
+	unsigned long x, unsigned long y,
+	unsigned long width, unsigned long height,
+	const unsigned char* pixels, PixelFormat, long stride = 0
+    );
+
     virtual void flush() const;
 
     RasterRep* rep() const;
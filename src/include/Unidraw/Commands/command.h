@@ -51,6 +51,7 @@ public:
     virtual void Store(Component*, Data* = nil);
     virtual Data* Recall(Component*);
     virtual void Log();
+    virtual long Size();                // bytes held to undo
     
     virtual void SetControlInfo(ControlInfo*);
     virtual void SetEditor(Editor*);
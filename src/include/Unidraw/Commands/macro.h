@@ -43,6 +43,7 @@ public:
     virtual void Execute();
     virtual void Unexecute();
     virtual boolean Reversible();
+    virtual long Size();
     
     virtual void SetEditor(Editor*);
 
@@ -50,6 +50,9 @@ public:
     void Solve();
     void Print();                               // for debugging only
 
+    void SetThreads(int);                       // solve networks in parallel
+    int GetThreads();
+
     CSolverState* GetState(Connector*);
     void SetState(CSolverState*);
     
@@ -60,9 +63,14 @@ private:
     void Wrote(Connector*);
 
     CNet* Network(UList*);
+    CNet* Partner(CNet*, Orientation);
     ConnInfo* Info(Connector*, Orientation);
     void SolveAll(UList*, Orientation);
+    void SolveAll(CNet**, int, Orientation);
     void Solve(CNet*, Orientation);
+    void Capture(CNet*, Orientation);
+    float Captured(Connector*, Orientation);
+    static void* SolveNetworks(void*);
     void DestroyCnxns();
     void DestroyCnxns(CNet*);
 
@@ -124,10 +132,11 @@ private:
     void ReplaceYInfo(CNet*, CNet*, CNet*, Orientation);
     void ReplacePseudoFixedInfo(CNet*, Orientation);
 
-    void DefaultPosition(CNet*);
+    void DefaultPosition(CNet*, Orientation);
 private:
     UList* _hnets, *_vnets;
     CCnxn_HashTable* _hwritten, *_vwritten;
+    int _threads;
 };
 
 class CSolverState {
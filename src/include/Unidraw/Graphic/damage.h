@@ -60,6 +60,13 @@ public:
     Canvas* GetCanvas();
     Painter* GetPainter();
     Graphic* GetGraphic();
+
+    void SetAreaLimit(int);	    /* most areas kept before merging */
+    int GetAreaLimit();
+
+    void Instrument(boolean);	    /* count pixels damaged and repainted */
+    void GetStatistics(unsigned long& damaged, unsigned long& repainted);
+    void ResetStatistics();
 protected:    
     int Area(BoxObj&);
 
@@ -83,10 +90,17 @@ protected:
 protected:
     UList* _additions;
     UList* _areas;
+private:
+    void Coalesce();
+    void DeleteIncurred();
 private:
     Canvas* _canvas;
     Painter* _output;
     Graphic* _graphic;
+    int _limit;
+    boolean _instrument;
+    UList* _incurred;
+    unsigned long _damaged, _repainted;
 };
 
 #include <IV-2_6/_leave.h>
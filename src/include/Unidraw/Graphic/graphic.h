@@ -155,6 +155,7 @@ protected:
     virtual void uncacheExtent();
     virtual void uncacheParents();
     virtual void uncacheChildren();
+    virtual void uncacheChild(Graphic*);   /* child's extent has changed */
     virtual void invalidateCaches();
 /*
  * Graphics state concatentation operations.
@@ -31,6 +31,7 @@
 
 #include <IV-2_6/_enter.h>
 
+class PictureIndex;
 class UList;
 
 class Picture : public FullGraphic {
@@ -82,10 +83,24 @@ protected:
     virtual void cacheExtent(float, float, float, float, float);
     virtual void uncacheExtent();
     virtual void uncacheChildren();
+    virtual void uncacheChild(Graphic*);
 protected:
     UList* _kids;
+private:
+    enum HitTest { HitContains, HitIntersects, HitWithin };
+
+    boolean indexing();
+    PictureIndex* findIndex(Graphic* gs, boolean rebind);
+    PictureIndex* searchIndex(
+        float, float, float, float, Graphic* gs, boolean rebind
+    );
+    boolean searchHits(BoxObj&, HitTest, boolean last, Graphic*& found);
+    void getLocalBox(
+        Graphic*, Graphic* gs, float&, float&, float&, float&, float&
+    );
 private:
     Extent* _extent;
+    PictureIndex* _index;
 };
 
 #include <IV-2_6/_leave.h>
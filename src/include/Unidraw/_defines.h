@@ -19,6 +19,8 @@
 #define CSolverState _lib_iv(CSolverState)
 #define Catalog _lib_iv(Catalog)
 #define CatalogChooser _lib_iv(CatalogChooser)
+#define CatalogFile _lib_iv(CatalogFile)
+#define CatalogRefs _lib_iv(CatalogRefs)
 #define CenterCmd _lib_iv(CenterCmd)
 #define Clipboard _lib_iv(Clipboard)
 #define CloseEditorCmd _lib_iv(CloseEditorCmd)
@@ -95,6 +97,7 @@
 #define HPanelControl _lib_iv(HPanelControl)
 #define HSlotComp _lib_iv(HSlotComp)
 #define HSlotView _lib_iv(HSlotView)
+#define HistoryLog _lib_iv(HistoryLog)
 #define HistoryMap _lib_iv(HistoryMap)
 #define ImportCmd _lib_iv(ImportCmd)
 #define InorderView _lib_iv(InorderView)
@@ -164,6 +167,7 @@
 #define PatternVar _lib_iv(PatternVar)
 #define PatternVarView _lib_iv(PatternVarView)
 #define Picture _lib_iv(Picture)
+#define PictureIndex _lib_iv(PictureIndex)
 #define PinComp _lib_iv(PinComp)
 #define PinGraphic _lib_iv(PinGraphic)
 #define PinView _lib_iv(PinView)
@@ -245,7 +249,9 @@
 #define UList _lib_iv(UList)
 #define UMap _lib_iv(UMap)
 #define UMapElem _lib_iv(UMapElem)
+#define UMapIndex _lib_iv(UMapIndex)
 #define UPage _lib_iv(UPage)
+#define UScanner _lib_iv(UScanner)
 #define UStencil _lib_iv(UStencil)
 #define UndoCmd _lib_iv(UndoCmd)
 #define UngroupCmd _lib_iv(UngroupCmd)
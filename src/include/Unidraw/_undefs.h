@@ -19,6 +19,8 @@
 #undef CSolverState
 #undef Catalog
 #undef CatalogChooser
+#undef CatalogFile
+#undef CatalogRefs
 #undef CenterCmd
 #undef Clipboard
 #undef CloseEditorCmd
@@ -95,6 +97,7 @@
 #undef HPanelControl
 #undef HSlotComp
 #undef HSlotView
+#undef HistoryLog
 #undef HistoryMap
 #undef ImportCmd
 #undef InorderView
@@ -164,6 +167,7 @@
 #undef PatternVar
 #undef PatternVarView
 #undef Picture
+#undef PictureIndex
 #undef PinComp
 #undef PinGraphic
 #undef PinView
@@ -245,7 +249,9 @@
 #undef UList
 #undef UMap
 #undef UMapElem
+#undef UMapIndex
 #undef UPage
+#undef UScanner
 #undef UStencil
 #undef UndoCmd
 #undef UngroupCmd
@@ -33,6 +33,8 @@
 #include <Unidraw/umap.h>
 
 class Bitmap;
+class CatalogFile;
+class CatalogRefs;
 class Clipboard;
 class Command;
 class Component;
@@ -98,9 +100,13 @@ public:
 
     void SetClipboard(Clipboard*);
     void SetEditorInfo(EditorInfo*);
+    void SetBinary(boolean);            // save in the binary format
+    void SetLazy(boolean);              // read binary images when needed
 
     Clipboard* GetClipboard();
     EditorInfo* GetEditorInfo();
+    boolean GetBinary();
+    boolean GetLazy();
 
     const char* GetName();
     Creator* GetCreator();
@@ -199,6 +205,11 @@ private:
     void WriteObject(void*, ClassId, ostream&);
     void WriteIt(void*, ClassId, ostream&);
 
+    boolean ReadRef(istream&, void*&);
+    void DefineRef(void*);
+    boolean WriteRef(void*, ostream&);
+    CatalogFile* LazyFile(istream&);
+
     void* CopyObject(void*, ClassId);
     void Forget(void*, const char* name, NameMap*);
 
@@ -222,6 +233,13 @@ private:
     ObjectMap* _curMap;
     ObjectMap* _substMap;
     float _fileVersion;
+
+    boolean _binary;
+    int _fileFormat;                    // binary format revision, or 0
+    CatalogRefs* _inRefs;               // set while reading a binary file
+    CatalogRefs* _outRefs;              // set while writing one
+    boolean _lazy;
+    CatalogFile* _inFile;               // set while reading one lazily
 #if defined(__xlC__) || defined(__GNUG__)
     char* _tmpfile;
 #endif
@@ -238,6 +256,8 @@ inline float Catalog::GetVersion () { return _version; }
 inline float Catalog::FileVersion () { return _fileVersion; }
 inline Clipboard* Catalog::GetClipboard () { return _clipboard; }
 inline EditorInfo* Catalog::GetEditorInfo () { return _edInfo; }
+inline boolean Catalog::GetBinary () { return _binary; }
+inline boolean Catalog::GetLazy () { return _lazy; }
 
 class ObjectMap : public UMap {
 public:
@@ -46,9 +46,6 @@ public:
     const char* GetName(int index);
     const char* GetInfo(const char* name);
     const char* GetInfo(int index);
-private:
-    virtual UMapElem* FindId(void*);
-    virtual UMapElem* FindTag(void*);
 };
 
 #include <InterViews/_leave.h>
@@ -34,4 +34,13 @@ static const float UV_PRERELEASE	=  0;   // pre-3.0 release
 
 #define UV_LATEST UV_ORIGINAL
 
+/*
+ * Binary catalog format revision history.
+ */
+
+static const int UV_BINARY_ORIGINAL	=  1;   // first binary format
+static const int UV_BINARY_INDEXED	=  2;   // image rows length-prefixed
+
+#define UV_BINARY_LATEST UV_BINARY_INDEXED
+
 #endif
@@ -49,6 +49,13 @@ private:
 inline void* UHashElem::GetKey () { return _key; }
 inline void UHashElem::SetKey (void* key) { _key = key; }
 
+/*
+ * An open-addressed table that grows as elements are registered; nslots
+ * only sets its initial size.  Iteration visits elements in the order
+ * they were registered.  Registering a key again hides the earlier
+ * element until the later one is unregistered.
+ */
+
 class UHashTable {
 public:
     UHashTable(int nslots);
@@ -63,18 +70,25 @@ public:
 
     UHashElem* GetElem(Iterator);
     UHashElem* Find(void* key);
+    int Count();
 protected:
     virtual UHashElem* CreateElem();
     virtual int Hash(void*);
     virtual boolean Equal(void* key1, void* key2);
+
+    void Unregister(Iterator&);	    /* unregisters and moves to next */
 protected:
     int _nslots;
 private:
-    UList* UElem(Iterator);
-    UHashElem* Elem(UList*);
-    void DeleteSlot(UList*);
+    int Position(Iterator);
+    int Start(void* key);
+    void Rehash(int nslots);
 private:
-    UList** _slot;
+    void** _key;		    /* slot keys, probed linearly */
+    int* _pos;			    /* slot's element, or one of below */
+    UHashElem** _elem;		    /* elements in registration order */
+    int _nelems, _maxelems;
+    int _count, _deleted;
 };
 
 #include <InterViews/_leave.h>
@@ -21,7 +21,7 @@
  */
 
 /*
- * UMap - maintains a void* <-> void* mapping (linear search by default).
+ * UMap - maintains a void* <-> void* mapping, hashed on both sides.
  */
 
 #ifndef unidraw_umap_h
@@ -29,6 +29,8 @@
 
 #include <Unidraw/uarray.h>
 
+class UMapIndex;
+
 class UMapElem {
 public:
     virtual ~UMapElem();
@@ -37,8 +39,20 @@ public:
     virtual void* tag();
 protected:
     UMapElem();
+private:
+    friend class UMap;
+
+    int _index;                         /* position in the map, or -1 */
 };
 
+/*
+ * Ids and tags are compared as pointers unless the subclass constructs
+ * the map to compare them as strings.  FindId and FindTag return the
+ * earliest registered element with a matching id or tag.  Elements
+ * know their position, so unregistering one just leaves a hole; the
+ * holes are squeezed out before the next access by index.
+ */
+
 class UMap {
 public:
     virtual ~UMap();
@@ -46,7 +60,7 @@ public:
     int Count();
     void Clear();
 protected:
-    UMap();
+    UMap(boolean string_ids = false, boolean string_tags = false);
 
     void Register(UMapElem*);
     void Unregister(UMapElem*);
@@ -57,11 +71,22 @@ protected:
     virtual UMapElem* FindId(void*);
     virtual UMapElem* FindTag(void*);
 protected:
-    UArray _elems;
+    UArray _elems;                      /* nil where unregistered */
+private:
+    void Compact();
+private:
+    UMapIndex* _ids;
+    UMapIndex* _tags;
+    int _holes;                         /* nils in _elems */
 };
 
-inline int UMap::Index (UMapElem* elem) { return _elems.Index(elem); }
-inline UMapElem* UMap::Elem (int index) { return (UMapElem*) _elems[index]; }
-inline int UMap::Count () { return _elems.Count(); }
+inline UMapElem* UMap::Elem (int index) {
+    if (_holes != 0) {
+        Compact();
+    }
+    return (UMapElem*) _elems[index];
+}
+
+inline int UMap::Count () { return _elems.Count() - _holes; }
 
 #endif
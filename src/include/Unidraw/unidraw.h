@@ -36,9 +36,11 @@ class Component;
 class Editor;
 class Event;
 class Iterator;
+class HistoryLog;
 class HistoryMap;
 class OptionDesc;
 class PropertyData;
+class UHashTable;
 class UList;
 class World;
 
@@ -74,6 +76,9 @@ public:
 
     void SetHistoryLength(int);
     int GetHistoryLength();
+    void SetHistoryBudget(long);            // in bytes; 0 means no limit
+    long GetHistoryBudget();
+    long GetHistorySize(Component* = nil);  // bytes held, all if nil
 
     void Log(Command*);
     void Undo(Component*, int = 1);
@@ -102,6 +107,7 @@ private:
     void Init(Catalog*, World*);
     void InitAttributes();
     void DeleteComponent(Component*);
+    void TrimHistory(UList*);
 
     Editor* editor(UList*);
     Editor* FindAny(Component*, UList*);
@@ -116,6 +122,9 @@ private:
 
     HistoryMap* _histories;
     int _histlen;
+    long _histbudget;
+    UHashTable* _histsizes;
+    HistoryLog* _histlog;
 };
 
 inline Catalog* Unidraw::GetCatalog () { return _catalog; }
@@ -0,0 +1,37 @@
+/*
+ * UScanner - input stream buffer holding a whole file, memory-mapped
+ * where possible, with scanning that skips istream's extractors.
+ */
+
+#ifndef unidraw_uscanner_h
+#define unidraw_uscanner_h
+
+#include <OS/enter-scope.h>
+#include <Unidraw/enter-scope.h>
+
+class InputFile;
+
+#include <ivstream.h>
+#include <stdio.h>
+
+class UScanner : public streambuf {
+public:
+    UScanner(const char* filename);     /* maps the file */
+    UScanner(FILE*);                    /* reads it to the end */
+    virtual ~UScanner();
+
+    boolean Valid();
+
+    /* these work on any stream buffer */
+    static boolean GetLine(streambuf*, char*, int size);   /* as fgets */
+    static int GetHex(streambuf*, unsigned char*, int n);  /* bytes read */
+protected:
+    virtual int underflow();
+private:
+    void Init(const char*, long len);
+private:
+    InputFile* _file;
+    char* _buf;
+};
+
+#endif
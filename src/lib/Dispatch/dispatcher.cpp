@@ -34,7 +34,8 @@
 #define _LANGUAGE_C_PLUS_PLUS 1 //gcc-2.8.1 mips-sgi-irix6.2
 #endif
 
-// Dispatcher provides an interface to the "select" system call.
+// Dispatcher provides an interface to the "select" system call
+// (or to epoll, where available).
 
 #include <Dispatch/dispatcher.h>
 #include <Dispatch/iohandler.h>
@@ -43,6 +44,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -55,6 +57,11 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 
 #if TIME_WITH_SYS_TIME
 # include <sys/time.h>
@@ -92,68 +99,520 @@ extern "C" {
 
 Dispatcher* Dispatcher::_instance;
 
-class FdMask : public fd_set {
+/*
+ * An FdMask is a set of file descriptors.  Unlike an fd_set it grows to
+ * hold any descriptor, and it can step directly from one member to the
+ * next so that callers need not test every descriptor below _nfds.
+ * Sets that fit in an fd_set use inline storage.
+ */
+
+static const int FdMaskWordBits = 8 * sizeof(unsigned long);
+static const int FdMaskInlineWords =
+    (FD_SETSIZE + FdMaskWordBits - 1) / FdMaskWordBits;
+
+class FdMask {
 public:
     FdMask();
+    FdMask(const FdMask&);
+    ~FdMask();
+
+    FdMask& operator =(const FdMask&);
+
     void zero();
     void setBit(int);
     void clrBit(int);
     boolean isSet(int) const;
     boolean anySet() const;
     int numSet() const;
+    int nextSet(int) const;
+
+    void copyTo(fd_set&, int nfds) const;
+    void copyFrom(const fd_set&, int nfds);
+private:
+    void grow(int nwords);
+
+    unsigned long* _bits;
+    int _nwords;
+    unsigned long _inline[FdMaskInlineWords];
 };
 
 FdMask::FdMask() {
+    _bits = _inline;
+    _nwords = FdMaskInlineWords;
     zero();
 }
 
-void FdMask::zero() { Memory::zero(this, sizeof(FdMask)); }
-void FdMask::setBit(int fd) { FD_SET(fd,this); }
-void FdMask::clrBit(int fd) { FD_CLR(fd,this); }
-boolean FdMask::isSet(int fd) const { return FD_ISSET(fd,this); }
+FdMask::FdMask(const FdMask& m) {
+    _bits = _inline;
+    _nwords = FdMaskInlineWords;
+    zero();
+    *this = m;
+}
 
-boolean FdMask::anySet() const {
+FdMask::~FdMask() {
+    if (_bits != _inline) {
+	delete [] _bits;
+    }
+}
+
+FdMask& FdMask::operator =(const FdMask& m) {
+    if (&m != this) {
+	if (m._nwords > _nwords) {
+	    grow(m._nwords);
+	}
+	Memory::copy(m._bits, _bits, m._nwords * sizeof(unsigned long));
+	for (int i = m._nwords; i < _nwords; i++) {
+	    _bits[i] = 0;
+	}
+    }
+    return *this;
+}
 
-#ifdef _XOPEN_SOURCE
-    const int mskcnt = howmany(FD_SETSIZE,NFDBITS);
-    for (int i = 0; i < mskcnt; i++) {
-	if (fds_bits[i]) {
+void FdMask::grow(int nwords) {
+    int n = _nwords;
+    while (n < nwords) {
+	n <<= 1;
+    }
+    unsigned long* bits = new unsigned long[n];
+    Memory::copy(_bits, bits, _nwords * sizeof(unsigned long));
+    for (int i = _nwords; i < n; i++) {
+	bits[i] = 0;
+    }
+    if (_bits != _inline) {
+	delete [] _bits;
+    }
+    _bits = bits;
+    _nwords = n;
+}
+
+void FdMask::zero() {
+    Memory::zero(_bits, _nwords * sizeof(unsigned long));
+}
+
+void FdMask::setBit(int fd) {
+    int w = fd / FdMaskWordBits;
+    if (w >= _nwords) {
+	grow(w + 1);
+    }
+    _bits[w] |= 1UL << (fd % FdMaskWordBits);
+}
+
+void FdMask::clrBit(int fd) {
+    int w = fd / FdMaskWordBits;
+    if (w < _nwords) {
+	_bits[w] &= ~(1UL << (fd % FdMaskWordBits));
+    }
+}
+
+boolean FdMask::isSet(int fd) const {
+    int w = fd / FdMaskWordBits;
+    return w < _nwords && (_bits[w] & (1UL << (fd % FdMaskWordBits))) != 0;
+}
+
+boolean FdMask::anySet() const {
+    for (int i = 0; i < _nwords; i++) {
+	if (_bits[i] != 0) {
 	    return true;
 	}
     }
-#else
-//
-// Redo using entirely standard macros.  This is slightly less efficient.
-//
-    for (int fd_idx = 0; fd_idx < FD_SETSIZE; ++fd_idx)
-      if (FD_ISSET(fd_idx, this))
-	return true;
-#endif
     return false;
 }
 
 int FdMask::numSet() const {
     int n = 0;
-//
-// Redone using entirely standard macros.
-//
-    for (int i = 0; i < FD_SETSIZE; ++i)
-      if (FD_ISSET(i, this))
-	++n;
-
-//    const int mskcnt = howmany(FD_SETSIZE,NFDBITS);
-//    for (int i = 0; i < mskcnt; i++) {
-//	if (fds_bits[i]) {
-//	    for (int j = 0; j < NFDBITS; j++) {
-//		if ((fds_bits[i] & (1 << j)) != 0) {
-//		    n += 1;
-//		}
-//	    }
-//	}
-//    }
+    for (int i = 0; i < _nwords; i++) {
+	for (unsigned long w = _bits[i]; w != 0; w &= w - 1) {
+	    ++n;
+	}
+    }
     return n;
 }
 
+/*
+ * Return the smallest member of the set that is >= fd, or -1.
+ */
+
+int FdMask::nextSet(int fd) const {
+    if (fd < 0) {
+	fd = 0;
+    }
+    int i = fd / FdMaskWordBits;
+    if (i >= _nwords) {
+	return -1;
+    }
+    unsigned long w = _bits[i] & (~0UL << (fd % FdMaskWordBits));
+    while (w == 0) {
+	if (++i >= _nwords) {
+	    return -1;
+	}
+	w = _bits[i];
+    }
+    int bit = 0;
+#if defined(__GNUC__)
+    bit = __builtin_ctzl(w);
+#else
+    while ((w & 1) == 0) {
+	w >>= 1;
+	++bit;
+    }
+#endif
+    return i * FdMaskWordBits + bit;
+}
+
+void FdMask::copyTo(fd_set& s, int nfds) const {
+    FD_ZERO(&s);
+    for (int fd = nextSet(0); fd >= 0 && fd < nfds; fd = nextSet(fd + 1)) {
+	FD_SET(fd, &s);
+    }
+}
+
+void FdMask::copyFrom(const fd_set& s, int nfds) {
+    zero();
+    for (int fd = 0; fd < nfds; fd++) {
+	if (FD_ISSET(fd, &s)) {
+	    setBit(fd);
+	}
+    }
+}
+
+/*
+ * A DispatcherBackend waits for descriptors in a set of interest masks
+ * to become ready.  The select backend recomputes everything on each
+ * call and is limited to FD_SETSIZE descriptors; the epoll backend is
+ * told about interest changes as they happen and reports only the
+ * descriptors that are actually ready.
+ */
+
+static const int ReadEvent = 0x1;
+static const int WriteEvent = 0x2;
+static const int ExceptEvent = 0x4;
+
+class DispatcherBackend {
+public:
+    virtual ~DispatcherBackend();
+
+    virtual void interest(int fd, int events) = 0;
+    virtual int wait(
+	const FdMask& rmask, const FdMask& wmask, const FdMask& emask,
+	int nfds, FdMask& rmaskret, FdMask& wmaskret, FdMask& emaskret,
+	timeval* howlong
+    ) = 0;
+
+    static DispatcherBackend* make();
+};
+
+DispatcherBackend::~DispatcherBackend() { }
+
+class SelectBackend : public DispatcherBackend {
+public:
+    SelectBackend();
+    virtual ~SelectBackend();
+
+    virtual void interest(int fd, int events);
+    virtual int wait(
+	const FdMask&, const FdMask&, const FdMask&,
+	int nfds, FdMask&, FdMask&, FdMask&, timeval*
+    );
+};
+
+SelectBackend::SelectBackend() { }
+SelectBackend::~SelectBackend() { }
+
+void SelectBackend::interest(int fd, int) {
+    if (fd >= FD_SETSIZE) {
+	fprintf(stderr, "Dispatcher: fd %d exceeds FD_SETSIZE\n", fd);
+	abort();
+    }
+}
+
+int SelectBackend::wait(
+    const FdMask& rmask, const FdMask& wmask, const FdMask& emask,
+    int nfds, FdMask& rmaskret, FdMask& wmaskret, FdMask& emaskret,
+    timeval* howlong
+) {
+    fd_set rset, wset, eset;
+    rmask.copyTo(rset, nfds);
+    wmask.copyTo(wset, nfds);
+    emask.copyTo(eset, nfds);
+//#if 0 && defined(hpux)
+// 	nfound = select(
+//	    nfds, (int*)&rset, (int*)&wset, (int*)&eset, howlong
+//	);
+//#else
+    int nfound = select(nfds, &rset, &wset, &eset, howlong);
+//#endif
+    if (nfound > 0) {
+	rmaskret.copyFrom(rset, nfds);
+	wmaskret.copyFrom(wset, nfds);
+	emaskret.copyFrom(eset, nfds);
+    }
+    return nfound;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+class EpollBackend : public DispatcherBackend {
+public:
+    EpollBackend(int epfd);
+    virtual ~EpollBackend();
+
+    virtual void interest(int fd, int events);
+    virtual int wait(
+	const FdMask&, const FdMask&, const FdMask&,
+	int nfds, FdMask&, FdMask&, FdMask&, timeval*
+    );
+private:
+    void dropped(int fd);
+    boolean anyStale(const FdMask&, const FdMask&, const FdMask&);
+    int mergeAlways(const FdMask&, const FdMask&, FdMask*, FdMask*);
+
+    int _epfd;
+    int _registered;
+    epoll_event* _events;
+    int _nevents;
+    FdMask _linked;		/* in the epoll set, as far as we know */
+    FdMask _always;		/* epoll refused them; always ready */
+    boolean _stale;		/* some descriptor left the set behind our back */
+};
+
+static const int EpollMinEvents = 64;
+
+EpollBackend::EpollBackend(int epfd) {
+    _epfd = epfd;
+    _registered = 0;
+    _nevents = EpollMinEvents;
+    _events = new epoll_event[_nevents];
+    _stale = false;
+}
+
+EpollBackend::~EpollBackend() {
+    close(_epfd);
+    delete [] _events;
+}
+
+/*
+ * Descriptors that are closed without being unlinked drop out of the
+ * epoll set on their own, so a descriptor number can come back while
+ * we still think it is registered (or vice versa).  Retry with the
+ * other operation rather than trusting our bookkeeping, and remember
+ * that something was closed so the next wait looks for descriptors
+ * that select would have reported with EBADF.
+ *
+ * Regular files and some devices cannot be polled at all; epoll
+ * rejects them with EPERM.  Select calls them always ready, so we
+ * keep them aside and do the same.
+ */
+
+void EpollBackend::interest(int fd, int events) {
+    if (_always.isSet(fd)) {
+	_always.clrBit(fd);
+	if (events == 0) {
+	    return;
+	}
+    }
+    if (events == 0) {
+	epoll_event ev;
+	Memory::zero(&ev, sizeof(ev));
+	if (epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, &ev) == 0) {
+	    --_registered;
+	} else if (_linked.isSet(fd)) {
+	    dropped(fd);
+	}
+	_linked.clrBit(fd);
+	return;
+    }
+    epoll_event ev;
+    Memory::zero(&ev, sizeof(ev));
+    ev.data.fd = fd;
+    if ((events & ReadEvent) != 0) {
+	ev.events |= EPOLLIN;
+    }
+    if ((events & WriteEvent) != 0) {
+	ev.events |= EPOLLOUT;
+    }
+    if ((events & ExceptEvent) != 0) {
+	ev.events |= EPOLLPRI;
+    }
+    if (epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+	return;
+    }
+    if (errno == EPERM) {
+	_always.setBit(fd);
+	return;
+    }
+    if (errno != ENOENT) {
+	if (errno == EBADF) {
+	    _stale = true;
+	} else {
+	    fprintf(
+		stderr, "Dispatcher: epoll_ctl(MOD, %d): %s\n",
+		fd, strerror(errno)
+	    );
+	}
+	return;
+    }
+    if (_linked.isSet(fd)) {
+	dropped(fd);
+    }
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+	_linked.setBit(fd);
+	++_registered;
+    } else if (errno == EPERM) {
+	_always.setBit(fd);
+    } else if (errno == EBADF) {
+	_stale = true;
+    } else {
+	fprintf(
+	    stderr, "Dispatcher: epoll_ctl(ADD, %d): %s\n",
+	    fd, strerror(errno)
+	);
+    }
+    if (_registered > _nevents) {
+	delete [] _events;
+	while (_nevents < _registered) {
+	    _nevents <<= 1;
+	}
+	_events = new epoll_event[_nevents];
+    }
+}
+
+/*
+ * The kernel took fd out of the set when it was closed.
+ */
+
+void EpollBackend::dropped(int fd) {
+    _linked.clrBit(fd);
+    --_registered;
+    _stale = true;
+}
+
+/*
+ * Epoll never reports EBADF, so once epoll_ctl tells us a descriptor
+ * went away check the ones we are waiting on (and the always-ready
+ * ones) the way select would.  Checking costs a system call per
+ * descriptor, so don't do it on every wait.
+ */
+
+static boolean anyBad(const FdMask& mask) {
+    for (int fd = mask.nextSet(0); fd >= 0; fd = mask.nextSet(fd + 1)) {
+	if (fcntl(fd, F_GETFL) < 0 && errno == EBADF) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+boolean EpollBackend::anyStale(
+    const FdMask& rmask, const FdMask& wmask, const FdMask& emask
+) {
+    if (!_stale) {
+	return false;
+    }
+    _stale = false;
+    return anyBad(rmask) || anyBad(wmask) || anyBad(emask) || anyBad(_always);
+}
+
+/*
+ * Report the always-ready descriptors that are being waited on
+ * (or, if the result masks are nil, just count them).
+ */
+
+int EpollBackend::mergeAlways(
+    const FdMask& rmask, const FdMask& wmask,
+    FdMask* rmaskret, FdMask* wmaskret
+) {
+    int nfound = 0;
+    for (int fd = _always.nextSet(0); fd >= 0; fd = _always.nextSet(fd + 1)) {
+	if (rmask.isSet(fd)) {
+	    if (rmaskret != nil) {
+		rmaskret->setBit(fd);
+	    }
+	    ++nfound;
+	}
+	if (wmask.isSet(fd)) {
+	    if (wmaskret != nil) {
+		wmaskret->setBit(fd);
+	    }
+	    ++nfound;
+	}
+    }
+    return nfound;
+}
+
+int EpollBackend::wait(
+    const FdMask& rmask, const FdMask& wmask, const FdMask& emask,
+    int, FdMask& rmaskret, FdMask& wmaskret, FdMask& emaskret,
+    timeval* howlong
+) {
+    if (anyStale(rmask, wmask, emask)) {
+	errno = EBADF;
+	return -1;
+    }
+    int timeout = -1;
+    boolean always = (
+	_always.anySet() && mergeAlways(rmask, wmask, nil, nil) > 0
+    );
+    if (always) {
+	timeout = 0;
+    } else if (howlong != nil) {
+	/* round up so that we never wake before the next timer is due */
+	long ms = howlong->tv_usec / 1000 + (howlong->tv_usec % 1000 != 0);
+	if (howlong->tv_sec >= INT_MAX / 1000 - 1) {
+	    timeout = INT_MAX;
+	} else {
+	    timeout = int(howlong->tv_sec * 1000 + ms);
+	}
+    }
+    int n = epoll_wait(_epfd, _events, _nevents, timeout);
+    if (n < 0) {
+	return n;
+    }
+    rmaskret.zero();
+    wmaskret.zero();
+    emaskret.zero();
+    int nfound = 0;
+    for (int i = 0; i < n; i++) {
+	int fd = _events[i].data.fd;
+	unsigned int ev = _events[i].events;
+	if ((ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0 && rmask.isSet(fd)) {
+	    rmaskret.setBit(fd);
+	    ++nfound;
+	}
+	if ((ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0 && wmask.isSet(fd)) {
+	    wmaskret.setBit(fd);
+	    ++nfound;
+	}
+	if ((ev & EPOLLPRI) != 0 && emask.isSet(fd)) {
+	    emaskret.setBit(fd);
+	    ++nfound;
+	}
+    }
+    if (always) {
+	nfound += mergeAlways(rmask, wmask, &rmaskret, &wmaskret);
+    }
+    return nfound;
+}
+
+#endif
+
+/*
+ * Use epoll where we have it unless IV_DISPATCHER_SELECT is set in the
+ * environment, which is handy for comparing the two.
+ */
+
+DispatcherBackend* DispatcherBackend::make() {
+#ifdef HAVE_SYS_EPOLL_H
+    if (getenv("IV_DISPATCHER_SELECT") == nil) {
+	int epfd = epoll_create(EpollMinEvents);
+	if (epfd >= 0) {
+	    fcntl(epfd, F_SETFD, FD_CLOEXEC);
+	    return new EpollBackend(epfd);
+	}
+    }
+#endif
+    return new SelectBackend;
+}
+
 /*
  * Operations on timeval structures.
  */
@@ -210,14 +669,22 @@ boolean operator<(timeval src1, timeval src2) {
 
 /*
  * Interface to timers.
+ *
+ * Pending timers live in a binary heap ordered by expiration time
+ * (ties are broken by insertion order).  Each timer records its heap
+ * index so that it can be removed from the middle of the heap, and
+ * timers are also chained into a hash table keyed by handler so that
+ * stopTimer does not have to search the heap.  Timer nodes are carved
+ * out of blocks and recycled through a free list rather than being
+ * allocated and freed one at a time.
  */
 
 struct Timer {
-    Timer(timeval t, IOHandler* h, Timer* n);
-
     timeval timerValue;
     IOHandler* handler;
-    Timer* next;
+    unsigned long sequence;	// insertion order, for stable ties
+    int index;			// position in the heap
+    Timer* next;		// hash chain or free list
 };
 
 class TimerQueue {
@@ -234,31 +701,63 @@ public:
     void remove(IOHandler*);
     void expire(timeval);
 private:
-    Timer* _first;
+    boolean before(const Timer*, const Timer*) const;
+    void place(Timer*, int);
+    void siftUp(int);
+    void siftDown(int);
+    void removeAt(int);
+
+    Timer** probe(IOHandler*) const;
+    void hash(Timer*);
+    void unhash(Timer*);
+    void rehash(int);
+
+    Timer* allocate();
+    void release(Timer*);
+
+    Timer** _heap;
+    int _count;
+    int _avail;
+    Timer** _buckets;
+    int _nbuckets;
+    unsigned long _sequence;
+    Timer* _free;
+    Timer** _blocks;
+    int _nblocks;
     static timeval _zeroTime;
 };
 
-Timer::Timer(timeval t, IOHandler* h, Timer* n) :
-    timerValue(t),
-    handler(h),
-    next(n) {}
+static const int TimerBlockSize = 64;
+static const int TimerMinBuckets = 64;
 
 timeval TimerQueue::_zeroTime;
 
-TimerQueue::TimerQueue() :
-    _first(nil) {}
+TimerQueue::TimerQueue() {
+    _heap = nil;
+    _count = 0;
+    _avail = 0;
+    _nbuckets = TimerMinBuckets;
+    _buckets = new Timer*[_nbuckets];
+    for (int i = 0; i < _nbuckets; i++) {
+	_buckets[i] = nil;
+    }
+    _sequence = 0;
+    _free = nil;
+    _blocks = nil;
+    _nblocks = 0;
+}
 
 TimerQueue::~TimerQueue() {
-    Timer* doomed = _first;
-    while (doomed != nil) {
-	Timer* next = doomed->next;
-	delete doomed;
-	doomed = next;
+    for (int i = 0; i < _nblocks; i++) {
+	delete [] _blocks[i];
     }
+    delete [] _blocks;
+    delete [] _buckets;
+    delete [] _heap;
 }
 
 inline boolean TimerQueue::isEmpty() const {
-    return _first == nil;
+    return _count == 0;
 }
 
 inline timeval TimerQueue::zeroTime() {
@@ -266,7 +765,7 @@ inline timeval TimerQueue::zeroTime() {
 }
 
 inline timeval TimerQueue::earliestTime() const {
-    return _first->timerValue;
+    return _heap[0]->timerValue;
 }
 
 timeval TimerQueue::currentTime() {
@@ -280,46 +779,194 @@ timeval TimerQueue::currentTime() {
     return curTime;
 }
 
+inline boolean TimerQueue::before(const Timer* t1, const Timer* t2) const {
+    return t1->timerValue < t2->timerValue || (
+	!(t2->timerValue < t1->timerValue) && t1->sequence < t2->sequence
+    );
+}
+
+inline void TimerQueue::place(Timer* t, int i) {
+    _heap[i] = t;
+    t->index = i;
+}
+
+/*
+ * Handlers are heap objects, so the low-order bits of their addresses
+ * carry almost no information; fold the high bits down before masking.
+ */
+
+inline Timer** TimerQueue::probe(IOHandler* handler) const {
+    unsigned long k = (unsigned long)handler;
+    k ^= (k >> 4) ^ (k >> 11) ^ (k >> 19);
+    return &_buckets[k & (_nbuckets - 1)];
+}
+
+inline void TimerQueue::release(Timer* t) {
+    t->handler = nil;
+    t->next = _free;
+    _free = t;
+}
+
 void TimerQueue::insert(timeval futureTime, IOHandler* handler) {
-    if (isEmpty() || futureTime < earliestTime()) {
-	_first = new Timer(futureTime, handler, _first);
-    } else {
-	Timer* before = _first;
-	Timer* after = _first->next;
-	while (after != nil && futureTime > after->timerValue) {
-	    before = after;
-	    after = after->next;
+    Timer* t = allocate();
+    t->timerValue = futureTime;
+    t->handler = handler;
+    t->sequence = _sequence++;
+    if (_count == _avail) {
+	int avail = (_avail == 0) ? TimerBlockSize : _avail << 1;
+	Timer** heap = new Timer*[avail];
+	if (_heap != nil) {
+	    Memory::copy(_heap, heap, _count * sizeof(Timer*));
+	    delete [] _heap;
 	}
-	before->next = new Timer(futureTime, handler, after);
+	_heap = heap;
+	_avail = avail;
     }
+    place(t, _count);
+    _count += 1;
+    siftUp(t->index);
+    hash(t);
 }
 
+/*
+ * Stop the earliest pending timer for the given handler.  The handler's
+ * timers all hash to the same chain, which is normally just one entry.
+ */
+
 void TimerQueue::remove(IOHandler* handler) {
-    Timer* before = nil;
-    Timer* doomed = _first;
-    while (doomed != nil && doomed->handler != handler) {
-	before = doomed;
-	doomed = doomed->next;
+    Timer* doomed = nil;
+    for (Timer* t = *probe(handler); t != nil; t = t->next) {
+	if (t->handler == handler && (doomed == nil || before(t, doomed))) {
+	    doomed = t;
+	}
     }
     if (doomed != nil) {
-	if (before == nil) {
-	    _first = doomed->next;
-	} else {
-	    before->next = doomed->next;
-	}
-	delete doomed;
+	unhash(doomed);
+	removeAt(doomed->index);
+	release(doomed);
     }
 }
 
 void TimerQueue::expire(timeval curTime) {
     while (!isEmpty() && earliestTime() < curTime) {
-	Timer* expired = _first;
-	_first = _first->next;
-	expired->handler->timerExpired(curTime.tv_sec, curTime.tv_usec);
-	delete expired;
+	Timer* expired = _heap[0];
+	IOHandler* handler = expired->handler;
+	unhash(expired);
+	removeAt(0);
+	release(expired);
+	handler->timerExpired(curTime.tv_sec, curTime.tv_usec);
     }
 }
 
+void TimerQueue::siftUp(int i) {
+    Timer* t = _heap[i];
+    while (i > 0) {
+	int parent = (i - 1) >> 1;
+	if (!before(t, _heap[parent])) {
+	    break;
+	}
+	place(_heap[parent], i);
+	i = parent;
+    }
+    place(t, i);
+}
+
+void TimerQueue::siftDown(int i) {
+    Timer* t = _heap[i];
+    for (;;) {
+	int child = (i << 1) + 1;
+	if (child >= _count) {
+	    break;
+	}
+	if (child + 1 < _count && before(_heap[child + 1], _heap[child])) {
+	    child += 1;
+	}
+	if (!before(_heap[child], t)) {
+	    break;
+	}
+	place(_heap[child], i);
+	i = child;
+    }
+    place(t, i);
+}
+
+void TimerQueue::removeAt(int i) {
+    _count -= 1;
+    if (i != _count) {
+	Timer* last = _heap[_count];
+	place(last, i);
+	if (i > 0 && before(last, _heap[(i - 1) >> 1])) {
+	    siftUp(i);
+	} else {
+	    siftDown(i);
+	}
+    }
+    _heap[_count] = nil;
+}
+
+void TimerQueue::hash(Timer* t) {
+    if (_count > _nbuckets) {
+	rehash(_nbuckets << 1);
+    }
+    Timer** chain = probe(t->handler);
+    t->next = *chain;
+    *chain = t;
+}
+
+void TimerQueue::unhash(Timer* t) {
+    for (Timer** chain = probe(t->handler); *chain != nil; ) {
+	if (*chain == t) {
+	    *chain = t->next;
+	    break;
+	}
+	chain = &(*chain)->next;
+    }
+    t->next = nil;
+}
+
+void TimerQueue::rehash(int nbuckets) {
+    Timer** old = _buckets;
+    int n = _nbuckets;
+    _buckets = new Timer*[nbuckets];
+    _nbuckets = nbuckets;
+    for (int i = 0; i < nbuckets; i++) {
+	_buckets[i] = nil;
+    }
+    for (int j = 0; j < n; j++) {
+	Timer* t = old[j];
+	while (t != nil) {
+	    Timer* next = t->next;
+	    Timer** chain = probe(t->handler);
+	    t->next = *chain;
+	    *chain = t;
+	    t = next;
+	}
+    }
+    delete [] old;
+}
+
+Timer* TimerQueue::allocate() {
+    if (_free == nil) {
+	Timer* block = new Timer[TimerBlockSize];
+	Timer** blocks = new Timer*[_nblocks + 1];
+	if (_blocks != nil) {
+	    Memory::copy(_blocks, blocks, _nblocks * sizeof(Timer*));
+	    delete [] _blocks;
+	}
+	_blocks = blocks;
+	_blocks[_nblocks] = block;
+	_nblocks += 1;
+	for (int i = 0; i < TimerBlockSize; i++) {
+	    block[i].next = _free;
+	    _free = &block[i];
+	}
+    }
+    Timer* t = _free;
+    _free = t->next;
+    t->next = nil;
+    return t;
+}
+
 /*
  * Interface to child process handling.
  */
@@ -431,6 +1078,26 @@ void ChildQueue::notify() {
     _ready = false;
 }
 
+/*
+ * Return the conditions that have handlers on a file descriptor.
+ */
+
+static int interest(
+    IOHandler** rtable, IOHandler** wtable, IOHandler** etable, int fd
+) {
+    int events = 0;
+    if (rtable[fd] != nil) {
+	events |= ReadEvent;
+    }
+    if (wtable[fd] != nil) {
+	events |= WriteEvent;
+    }
+    if (etable[fd] != nil) {
+	events |= ExceptEvent;
+    }
+    return events;
+}
+
 Dispatcher::Dispatcher() {
     _nfds = 0;
     _rmask = new FdMask;
@@ -439,16 +1106,14 @@ Dispatcher::Dispatcher() {
     _rmaskready = new FdMask;
     _wmaskready = new FdMask;
     _emaskready = new FdMask;
-    _rtable = new IOHandler*[NOFILE];
-    _wtable = new IOHandler*[NOFILE];
-    _etable = new IOHandler*[NOFILE];
+    _ntable = 0;
+    _rtable = nil;
+    _wtable = nil;
+    _etable = nil;
+    growTables(NOFILE);
     _queue = new TimerQueue;
     _cqueue = new ChildQueue;
-    for (int i = 0; i < NOFILE; i++) {
-	_rtable[i] = nil;
-	_wtable[i] = nil;
-	_etable[i] = nil;
-    }
+    _backend = DispatcherBackend::make();
 }
 
 Dispatcher::~Dispatcher() {
@@ -463,6 +1128,7 @@ Dispatcher::~Dispatcher() {
     delete [] _etable;
     delete _queue;
     delete _cqueue;
+    delete _backend;
 }
 
 Dispatcher& Dispatcher::instance() {
@@ -475,9 +1141,12 @@ Dispatcher& Dispatcher::instance() {
 void Dispatcher::instance(Dispatcher* d) { _instance = d; }
 
 IOHandler* Dispatcher::handler(int fd, DispatcherMask mask) const {
-    if (fd < 0 || fd >= NOFILE) {
+    if (fd < 0) {
 	abort();
     }
+    if (fd >= _ntable) {
+	return nil;
+    }
     IOHandler* cur = nil;
     if (mask == ReadMask) {
 	cur = _rtable[fd];
@@ -492,20 +1161,93 @@ IOHandler* Dispatcher::handler(int fd, DispatcherMask mask) const {
 }
 
 void Dispatcher::link(int fd, DispatcherMask mask, IOHandler* handler) {
-    if (fd < 0 || fd >= NOFILE) {
+    if (fd < 0) {
 	abort();
     }
     attach(fd, mask, handler);
 }
 
 void Dispatcher::unlink(int fd) {
-    if (fd < 0 || fd >= NOFILE) {
+    if (fd < 0) {
+	abort();
+    }
+    if (fd < _ntable) {
+	detach(fd);
+    }
+}
+
+/*
+ * Stop watching one condition on a file descriptor, leaving any
+ * handlers for the other conditions in place.
+ */
+
+void Dispatcher::unlink(int fd, DispatcherMask mask) {
+    if (fd < 0) {
+	abort();
+    }
+    if (fd >= _ntable) {
+	return;
+    }
+    if (mask == ReadMask) {
+	_rmask->clrBit(fd);
+	_rmaskready->clrBit(fd);
+	_rtable[fd] = nil;
+    } else if (mask == WriteMask) {
+	_wmask->clrBit(fd);
+	_wmaskready->clrBit(fd);
+	_wtable[fd] = nil;
+    } else if (mask == ExceptMask) {
+	_emask->clrBit(fd);
+	_emaskready->clrBit(fd);
+	_etable[fd] = nil;
+    } else {
 	abort();
     }
-    detach(fd);
+    int events = interest(_rtable, _wtable, _etable, fd);
+    _backend->interest(fd, events);
+    if (events == 0) {
+	detach(fd);
+    }
+}
+
+/*
+ * The handler tables start out NOFILE entries long and double as
+ * needed, so descriptors are not limited by NOFILE or FD_SETSIZE
+ * (unless we fall back to select).
+ */
+
+void Dispatcher::growTables(int n) {
+    int size = (_ntable == 0) ? n : _ntable;
+    while (size < n) {
+	size <<= 1;
+    }
+    IOHandler** rtable = new IOHandler*[size];
+    IOHandler** wtable = new IOHandler*[size];
+    IOHandler** etable = new IOHandler*[size];
+    for (int i = 0; i < size; i++) {
+	if (i < _ntable) {
+	    rtable[i] = _rtable[i];
+	    wtable[i] = _wtable[i];
+	    etable[i] = _etable[i];
+	} else {
+	    rtable[i] = nil;
+	    wtable[i] = nil;
+	    etable[i] = nil;
+	}
+    }
+    delete [] _rtable;
+    delete [] _wtable;
+    delete [] _etable;
+    _rtable = rtable;
+    _wtable = wtable;
+    _etable = etable;
+    _ntable = size;
 }
 
 void Dispatcher::attach(int fd, DispatcherMask mask, IOHandler* handler) {
+    if (fd >= _ntable) {
+	growTables(fd + 1);
+    }
     if (mask == ReadMask) {
 	_rmask->setBit(fd);
 	_rtable[fd] = handler;
@@ -521,9 +1263,13 @@ void Dispatcher::attach(int fd, DispatcherMask mask, IOHandler* handler) {
     if (_nfds < fd+1) {
 	_nfds = fd+1;
     }
+    _backend->interest(fd, interest(_rtable, _wtable, _etable, fd));
 }
 
 void Dispatcher::detach(int fd) {
+    if (_rtable[fd] != nil || _wtable[fd] != nil || _etable[fd] != nil) {
+	_backend->interest(fd, 0);
+    }
     _rmask->clrBit(fd);
     _rtable[fd] = nil;
     _wmask->clrBit(fd);
@@ -731,18 +1477,12 @@ int Dispatcher::waitFor(
     }
 
     do {
-	rmaskret = *_rmask;
-	wmaskret = *_wmask;
-	emaskret = *_emask;
 	howlong = calculateTimeout(howlong);
 
-//#if 0 && defined(hpux)
-// 	nfound = select(
-//	    _nfds, (int*)&rmaskret, (int*)&wmaskret, (int*)&emaskret, howlong
-//	);
-//#else
- 	nfound = select(_nfds, &rmaskret, &wmaskret, &emaskret, howlong);
-//#endif
+	nfound = _backend->wait(
+	    *_rmask, *_wmask, *_emask, _nfds,
+	    rmaskret, wmaskret, emaskret, howlong
+	);
     } while (nfound < 0 && !handleError());
     if (!_cqueue->isEmpty()) {
 #if defined(HAVE_BSD_SIGNALS) // #ifdef SV_INTERRUPT  /* BSD-style */
@@ -757,11 +1497,35 @@ int Dispatcher::waitFor(
     return nfound;		/* Timed out or input available */
 }
 
+/*
+ * Return the smallest descriptor >= fd that is ready in any of the
+ * masks, or -1 if there is none.
+ */
+
+static int nextReady(
+    const FdMask& rmask, const FdMask& wmask, const FdMask& emask, int fd
+) {
+    int r = rmask.nextSet(fd);
+    int w = wmask.nextSet(fd);
+    int e = emask.nextSet(fd);
+    int next = r;
+    if (w >= 0 && (next < 0 || w < next)) {
+	next = w;
+    }
+    if (e >= 0 && (next < 0 || e < next)) {
+	next = e;
+    }
+    return next;
+}
+
 void Dispatcher::notify(
     int nfound, FdMask& rmaskret, FdMask& wmaskret, FdMask& emaskret
 ) {
-    for (int i = 0; i < _nfds && nfound > 0; i++) {
-	if (rmaskret.isSet(i)) {
+    int i = nextReady(rmaskret, wmaskret, emaskret, 0);
+    for (; i >= 0 && i < _nfds && nfound > 0;
+	i = nextReady(rmaskret, wmaskret, emaskret, i + 1)
+    ) {
+	if (rmaskret.isSet(i) && _rtable[i] != nil) {
 	    int status = _rtable[i]->inputReady(i);
 	    if (status < 0) {
 		detach(i);
@@ -770,7 +1534,7 @@ void Dispatcher::notify(
 	    }
 	    nfound--;
 	}
-	if (wmaskret.isSet(i)) {
+	if (wmaskret.isSet(i) && _wtable[i] != nil) {
 	    int status = _wtable[i]->outputReady(i);
 	    if (status < 0) {
 		detach(i);
@@ -779,7 +1543,7 @@ void Dispatcher::notify(
 	    }
 	    nfound--;
 	}
-	if (emaskret.isSet(i)) {
+	if (emaskret.isSet(i) && _etable[i] != nil) {
 	    int status = _etable[i]->exceptionRaised(i);
 	    if (status < 0) {
 		detach(i);
@@ -841,20 +1605,11 @@ boolean Dispatcher::handleError() {
 }
 
 void Dispatcher::checkConnections() {
-    FdMask rmask;
-    timeval poll = TimerQueue::zeroTime();
-
-    for (int fd = 0; fd < _nfds; fd++) {
-	if (_rtable[fd] != nil) {
-	    rmask.setBit(fd);
-//#if 0 && defined(hpux)
-//	    if (select(fd+1, (int*)&rmask, nil, nil, &poll) < 0) {
-//#else
-	    if (select(fd+1, &rmask, nil, nil, &poll) < 0) {
-//#endif
-		detach(fd);
-	    }
-	    rmask.clrBit(fd);
+    for (int fd = nextReady(*_rmask, *_wmask, *_emask, 0); fd >= 0;
+	fd = nextReady(*_rmask, *_wmask, *_emask, fd + 1)
+    ) {
+	if (fcntl(fd, F_GETFL) < 0 && errno == EBADF) {
+	    detach(fd);
 	}
     }
 }
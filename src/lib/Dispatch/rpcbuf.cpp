@@ -25,6 +25,8 @@
  * OF THIS SOFTWARE.
  */
 
+#include <Dispatch/dispatcher.h>
+#include <Dispatch/iohandler.h>
 #include <Dispatch/rpcbuf.h>
 #include <OS/memory.h>
 #include <OS/types.h>	/* must come before <netinet/in.h> on some systems */
@@ -34,12 +36,19 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netdb.h>
+#include <poll.h>
 #ifndef __DECCXX
 #include <osfcn.h>
 #endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
+
+#if !defined(IOV_MAX)
+#define IOV_MAX 16
+#endif
 
 // I need a pointer to an iostreamb so I can insert and extract values
 // in the length field of RPC requests.  If I don't have a stream, I
@@ -55,7 +64,19 @@ rpcbuf::rpcbuf(iostreamb* mystream) : streambuf(),
     _opened(false),
     _close(false),
     _nonblocking(false),
-    _verbose(true) {}
+    _verbose(true),
+    _segments(nil),
+    _nsegments(0),
+    _maxsegments(0),
+    _rsegbytes(0),
+    _queue(nil),
+    _qhead(0),
+    _qcount(0),
+    _qmax(0),
+    _qbytes(0),
+    _highwater(0),
+    _flusher(nil),
+    _flushing(false) {}
 
 // Free the buffer used to store the put area.  The streambuf
 // destructor will free the buffer used to store the get area.
@@ -65,6 +86,9 @@ rpcbuf::~rpcbuf() {
 
     delete pbase();
     setp(nil, nil);
+    delete [] _segments;
+    delete [] _queue;
+    delete _flusher;
 }
 
 // Return information about the connection.
@@ -259,15 +283,20 @@ rpcbuf* rpcbuf::attach(int fd) {
     return this;
 }
 
-// Empty the get/put areas, close the file descriptor if nothing else
-// might use it, and detach the streambuf from the file descriptor.
+// Empty the get/put areas (giving any queued output a bounded time to
+// go out and discarding the rest), close the file descriptor if
+// nothing else might use it, and detach the streambuf from the file
+// descriptor.
 
 rpcbuf* rpcbuf::close() {
     if (!_opened) {
 	return nil;
     }
 
-    sync();
+    if (sync() == EOF || drain(0) == EOF) {
+	discard();
+    }
+    output_wait(false);
 
     int ok = 0;
     if (_close) {
@@ -322,13 +351,77 @@ rpcbuf* rpcbuf::verbose(boolean verbose) {
     return this;
 }
 
-// Finish the current request, if any, and then start a new request.
-// The request begins with a length field, so insert a zero with
-// enough padding characters (if using formatted I/O) to overwrite the
-// zero later with 2**32 - 1, the largest possible length for a
-// request (the length must fit in an int).
+// The length field at the beginning of each request is stored and
+// loaded directly in the buffer rather than through the stream's
+// inserters and extractors.  With binary I/O it is a 32-bit integer in
+// the receiver's byte order, which is what ostreamb would insert after
+// negotiation.  With formatted I/O it is a decimal number padded with
+// blanks on the left and followed by one blank.  Either way its width
+// is fixed, so finish_request can overwrite it in place.
 
 const int FIELDWIDTH = 11;	// large enough to hold "2147483647 "
+const int BINARYWIDTH = 4;
+
+int rpcbuf::length_width() {
+    return mystream().binary() ? BINARYWIDTH : FIELDWIDTH;
+}
+
+void rpcbuf::store_length(char* field, int length) {
+    if (mystream().binary()) {
+	int one = 1;
+	boolean lsbfirst = (*(char*)&one != 0) != mystream().swapped();
+	unsigned int value = (unsigned int)length;
+	for (int i = 0; i < BINARYWIDTH; i++) {
+	    field[lsbfirst ? i : BINARYWIDTH - 1 - i] = char(value & 0xff);
+	    value >>= 8;
+	}
+    } else {
+	char* p = field + FIELDWIDTH - 1;
+	*p = ' ';
+	unsigned int value = (unsigned int)length;
+	do {
+	    *--p = char('0' + value % 10);
+	    value /= 10;
+	} while (value != 0 && p > field);
+	while (p > field) {
+	    *--p = ' ';
+	}
+    }
+}
+
+// The sender stored the length in our byte order (as ostreamb does
+// for all binary values), so decode it in host order.
+
+int rpcbuf::load_length(const char* field) {
+    if (mystream().binary()) {
+	int one = 1;
+	boolean lsbfirst = (*(char*)&one != 0);
+	unsigned int value = 0;
+	for (int i = 0; i < BINARYWIDTH; i++) {
+	    value = (value << 8) | (unsigned char)(
+		field[lsbfirst ? BINARYWIDTH - 1 - i : i]
+	    );
+	}
+	return (int)value;
+    } else {
+	const char* p = field;
+	const char* end = field + FIELDWIDTH;
+	while (p < end && *p == ' ') {
+	    ++p;
+	}
+	int value = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+	    value = value * 10 + (*p++ - '0');
+	}
+	return (p < end && *p == ' ') ? value : 0;
+    }
+}
+
+// Finish the current request, if any, and then start a new request.
+// The request begins with a length field, so reserve room for it and
+// fill in zero; finish_request will overwrite it with the real length.
+// Under nonblocking I/O overflow may leave output queued without
+// making room, so expand the put area until the field fits.
 
 int rpcbuf::start_request() {
     if (!_mystream || !_opened || allocate() == EOF) {
@@ -336,66 +429,98 @@ int rpcbuf::start_request() {
     }
 
     finish_request();
+    _actualWidth = length_width();
+    if (epptr() - pptr() < _actualWidth && overflow() == EOF) {
+	return EOF;
+    }
+    while (epptr() - pptr() < _actualWidth) {
+	if (!expand_p()) {
+	    error("rpcbuf::start_request: out of memory");
+	    return EOF;
+	}
+    }
     setr(pptr());
 
-    const int length = 0;
-    mystream().width(FIELDWIDTH);
-    mystream() << length;
-    _actualWidth = pptr() - rptr();
+    store_length(pptr(), 0);
+    pbump(_actualWidth);
 
     return 0;
 }
 
-// Finish the current request by inserting its final length in the
+// Finish the current request by storing its final length in the
 // length field at the beginning of the request (overwriting the old
 // value).  The length of the request includes its own length field.
 
 void rpcbuf::finish_request() {
     int length = pptr() - rptr();
     if (rptr() && length > 0) {
-	pbump(-length);
-	mystream().width(FIELDWIDTH);
-	mystream() << length;
-	if (_actualWidth != pptr() - rptr()) {
-	    error("rpcbuf::finish_request: length field's width changed");
-	}
-	pbump(length - (pptr() - rptr()));
+	store_length(rptr(), length + _rsegbytes);
+	enqueue(length + _rsegbytes);
     }
     setr(nil);
+    _rsegbytes = 0;
 }
 
-// Calculate the width of the length field (_actualWidth) and check
-// that all of the length field is in the buffer.  If so, extract the
-// length, move the get pointer back to the beginning of the request,
-// and return 0 if all of the request is in the buffer.  Otherwise,
-// return EOF.  By checking for EOF, the caller avoids extracting a
-// request before it's completely buffered.  The caller must call
-// select() to wait for new input and call rpcbuf::underflow() to
-// enqueue it until the complete request is buffered.
+// Append data to the outgoing RPC request.  Small amounts are copied
+// into the put area like any other insertion.  Larger blocks are not
+// copied; instead the rpcbuf remembers where they go and overflow
+// sends them straight from the caller's memory with writev.  The
+// caller must therefore leave the data untouched until the request
+// has been flushed.  Under nonblocking I/O the request may stay queued
+// after a flush, so always copy.  Return the number of bytes appended.
+
+const int APPENDCOPYMAX = 4096;
+
+int rpcbuf::append(const void* data, int n) {
+    if (n <= 0) {
+	return 0;
+    }
+    if (!rptr() || n <= APPENDCOPYMAX || _nonblocking) {
+	return sputn((const char*)data, n);
+    }
+
+    if (_nsegments == _maxsegments) {
+	int maxsegments = (_maxsegments == 0) ? 8 : _maxsegments * 2;
+	Segment* segments = new Segment[maxsegments];
+	if (!segments) {
+	    error("rpcbuf::append: out of memory");
+	    return 0;
+	}
+	for (int i = 0; i < _nsegments; i++) {
+	    segments[i] = _segments[i];
+	}
+	delete [] _segments;
+	_segments = segments;
+	_maxsegments = maxsegments;
+    }
+    Segment& seg = _segments[_nsegments++];
+    seg.offset = pptr() - pbase();
+    seg.data = (const char*)data;
+    seg.length = n;
+    _rsegbytes += n;
+    return n;
+}
+
+// Check that all of the length field is in the buffer.  If so, load
+// the length (leaving the get pointer at the beginning of the
+// request) and return 0 if all of the request is in the buffer.
+// Otherwise, return EOF.  By checking for EOF, the caller avoids
+// extracting a request before it's completely buffered.  The caller
+// must call select() to wait for new input and call
+// rpcbuf::underflow() to enqueue it until the complete request is
+// buffered.
 
 int rpcbuf::read_request() {
     if (!_mystream) {
 	return EOF;
     }
 
-    if (!_actualWidth) {
-	char* orig = pptr();
-	const int length = 0;
-	mystream().width(FIELDWIDTH);
-	mystream() << length;
-	_actualWidth = pptr() - orig;
-	pbump(orig - pptr());
-    }
-
     int navail = in_avail();
-    if (navail < _actualWidth) {
+    if (navail < length_width()) {
 	return EOF;
     }
 
-    char* orig = gptr();
-    int length = 0;
-    mystream() >> length;
-    gbump(orig - gptr());
+    int length = load_length(gptr());
 
     if (length <= 0) {
 	error("rpcbuf::read_request: zero or negative length");
@@ -415,10 +540,14 @@ int rpcbuf::read_request() {
 }
 
 // Finish the current RPC request if there's nothing to append to it,
-// thus allowing flush to send the current RPC request.  Send any
-// outgoing data using a loop to safeguard against partial writes.
-// Shift any still incomplete RPC request to the beginning of the put
-// area to make room for more data.  Append the overflow char if any.
+// thus allowing flush to send the current RPC request.  Send as much
+// outgoing data as the connection will take.  Under blocking I/O that
+// is all of it; under nonblocking I/O anything left over stays queued
+// in the put area and the Dispatcher finishes sending it when the
+// connection becomes writable again, unless the queue has grown past
+// the high-water mark, in which case wait until it drains below the
+// mark (failing if the peer stops reading).  Expand the put area if
+// it is still full.  Append the overflow char if any.
 
 int rpcbuf::overflow(int c) {
     if (!_opened || allocate() == EOF) {
@@ -429,38 +558,334 @@ int rpcbuf::overflow(int c) {
 	finish_request();
     }
 
-    if (rptr() == pbase() && pptr() >= epptr() && !expand_p()) {
+    if (push() == EOF) {
+	return EOF;
+    }
+
+    if (pending() > 0) {
+	output_wait(true);
+	if (_highwater > 0 && pending() > _highwater) {
+	    if (drain(_highwater) == EOF) {
+		return EOF;
+	    }
+	}
+    } else {
+	output_wait(false);
+    }
+
+    if (pptr() >= epptr() && !expand_p()) {
 	error("rpcbuf::overflow: out of memory");
 	return EOF;
     }
 
-    int nwrite = (rptr() >= pbase()) ? rptr() - pbase() : out_waiting();
+    if (c != EOF) {
+	sputc(c);
+    }
+    return zapeof(c);
+}
+
+// Send the finished part of the put area (everything before the
+// current RPC request, or all of it if there is no current request)
+// and shift whatever was not sent to the beginning of the put area.
+
+int rpcbuf::push() {
+    int nwrite = rptr() ? rptr() - pbase() : out_waiting();
+    int nsent = send(nwrite);
+    if (nsent == EOF) {
+	return EOF;
+    }
+    if (nsent > 0) {
+	int nleft = out_waiting() - nsent;
+	if (nleft > 0) {
+	    Memory::copy(pbase() + nsent, pbase(), nleft);
+	}
+	if (rptr()) {
+	    rbump(-nsent);
+	}
+	pbump(-nsent);
+    }
+    return 0;
+}
+
+// Send the first nwrite bytes of the put area along with any appended
+// data that goes with them, using a loop to safeguard against partial
+// writes.  Without appended data this is a plain write loop;
+// otherwise gather the put area pieces and the caller's blocks into
+// one writev.  Under nonblocking I/O stop early if the connection
+// won't take any more.  Return how many bytes of the put area were
+// sent.
+
+int rpcbuf::send(int nwrite) {
+    int npending = pending();
+    int nseg = 0;
+    while (nseg < _nsegments && _segments[nseg].offset <= nwrite) {
+	nseg++;
+    }
+
+    struct iovec one;
+    struct iovec* iov = (nseg == 0) ? &one : new struct iovec[2 * nseg + 1];
+    int niov = 0;
+    int pos = 0;
+    for (int i = 0; i < nseg; i++) {
+	const Segment& seg = _segments[i];
+	if (seg.offset > pos) {
+	    iov[niov].iov_base = pbase() + pos;
+	    iov[niov].iov_len = seg.offset - pos;
+	    niov++;
+	    pos = seg.offset;
+	}
+	iov[niov].iov_base = (char*)seg.data;
+	iov[niov].iov_len = seg.length;
+	niov++;
+    }
+    if (nwrite > pos) {
+	iov[niov].iov_base = pbase() + pos;
+	iov[niov].iov_len = nwrite - pos;
+	niov++;
+    }
+
     int count = 0;
-    while (count < nwrite) {
-	int nsent = write(_fd, pbase() + count, nwrite - count);
+    boolean failed = false;
+    struct iovec* next = iov;
+    while (niov > 0) {
+	int nsent = (niov == 1) ?
+	    write(_fd, next->iov_base, next->iov_len) :
+	    writev(_fd, next, (niov < IOV_MAX) ? niov : IOV_MAX);
 	if (nsent < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    if (_nonblocking && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		break;
+	    }
 	    sys_error("rpcbuf::overflow: write");
-	    return EOF;
+	    failed = true;
+	    break;
 	}
 	count += nsent;
+	while (niov > 0 && nsent >= (int)next->iov_len) {
+	    nsent -= next->iov_len;
+	    next++;
+	    niov--;
+	}
+	if (niov > 0) {
+	    next->iov_base = (char*)next->iov_base + nsent;
+	    next->iov_len -= nsent;
+	}
     }
-    if (rptr() > pbase()) {
-	Memory::copy(rptr(), pbase(), pptr() - rptr());
-	rbump(-nwrite);
+    if (iov != &one) {
+	delete [] iov;
+    }
+    if (failed) {
+	return EOF;
     }
-    pbump(-nwrite);
 
-    if (c != EOF) {
-	sputc(c);
+    dequeue(count, npending);
+    return consume(count, nseg, nwrite);
+}
+
+// Account for count bytes sent out of the first nseg segments and
+// nwrite bytes of the put area, in their interleaved order.  Drop the
+// segments sent completely, trim one sent partially, and rebase the
+// rest on the part of the put area that remains.  Return the number
+// of put area bytes sent.
+
+int rpcbuf::consume(int count, int nseg, int nwrite) {
+    int nput = 0;
+    int ndone = 0;
+    int pos = 0;
+    for (int i = 0; i < nseg && count > 0; i++) {
+	Segment& seg = _segments[i];
+	int n = seg.offset - pos;
+	if (n > count) {
+	    n = count;
+	}
+	nput += n;
+	count -= n;
+	pos = seg.offset;
+	if (count == 0) {
+	    break;
+	}
+	if (count >= seg.length) {
+	    count -= seg.length;
+	    ndone++;
+	} else {
+	    seg.data += count;
+	    seg.length -= count;
+	    count = 0;
+	}
     }
-    return zapeof(c);
+    if (count > 0) {
+	nput += (count < nwrite - pos) ? count : nwrite - pos;
+    }
+
+    for (int j = ndone; j < _nsegments; j++) {
+	_segments[j - ndone] = _segments[j];
+	_segments[j - ndone].offset -= nput;
+    }
+    _nsegments -= ndone;
+    return nput;
+}
+
+// Return the number of bytes of finished output waiting to be sent,
+// including appended data, and the number of RPC requests among them.
+
+int rpcbuf::pending() {
+    if (!pbase()) {
+	return 0;
+    }
+    int nfinished = (rptr() ? rptr() : pptr()) - pbase();
+    int n = nfinished;
+    for (int i = 0; i < _nsegments && _segments[i].offset <= nfinished; i++) {
+	n += _segments[i].length;
+    }
+    return n;
+}
+
+int rpcbuf::queued() {
+    return _qcount;
+}
+
+// Remember the length of each finished RPC request so that queued()
+// can count them until they have been sent.
+
+void rpcbuf::enqueue(int length) {
+    if (_qcount == _qmax) {
+	int qmax = (_qmax == 0) ? 16 : _qmax * 2;
+	int* q = new int[qmax];
+	for (int i = 0; i < _qcount; i++) {
+	    q[i] = _queue[(_qhead + i) % _qmax];
+	}
+	delete [] _queue;
+	_queue = q;
+	_qmax = qmax;
+	_qhead = 0;
+    }
+    _queue[(_qhead + _qcount) % _qmax] = length;
+    _qcount++;
+    _qbytes += length;
+}
+
+// Retire requests after sending count of npending bytes.  Bytes ahead
+// of the first request (e.g., from negotiate) don't belong to any.
+
+void rpcbuf::dequeue(int count, int npending) {
+    int nother = npending - _qbytes;
+    if (nother > 0) {
+	count -= (count < nother) ? count : nother;
+    }
+    _qbytes -= count;
+    while (_qcount > 0 && count >= _queue[_qhead]) {
+	count -= _queue[_qhead];
+	_qhead = (_qhead + 1) % _qmax;
+	_qcount--;
+    }
+    if (_qcount > 0) {
+	_queue[_qhead] -= count;
+    }
+}
+
+// Watch the connection for writability while output is queued.
+
+void rpcbuf::output_wait(boolean wait) {
+    if (wait && !_flushing) {
+	if (!_flusher) {
+	    _flusher = new RpcFlusher(this);
+	}
+	Dispatcher::instance().link(_fd, Dispatcher::WriteMask, _flusher);
+	_flushing = true;
+    } else if (!wait && _flushing) {
+	Dispatcher::instance().unlink(_fd, Dispatcher::WriteMask);
+	_flushing = false;
+    }
+}
+
+// Block until no more than limit bytes of output are queued.  A peer
+// that stops reading must not hang the caller (or the Dispatcher loop
+// that called it), so give up and return EOF if the connection takes
+// nothing for DRAINTIMEOUT milliseconds.
+
+const int DRAINTIMEOUT = 5000;
+
+int rpcbuf::drain(int limit) {
+    while (pending() > limit) {
+	struct pollfd pfd;
+	pfd.fd = _fd;
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	int n = poll(&pfd, 1, DRAINTIMEOUT);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    sys_error("rpcbuf::drain: poll");
+	    return EOF;
+	}
+	if (n == 0) {
+	    error("rpcbuf::drain: connection stopped taking output");
+	    return EOF;
+	}
+	if (push() == EOF) {
+	    return EOF;
+	}
+    }
+    if (pending() == 0) {
+	output_wait(false);
+    }
+    return 0;
+}
+
+// Throw away all queued output, including the current request.
+
+void rpcbuf::discard() {
+    if (pbase()) {
+	setp(pbase(), epptr());
+    }
+    setr(nil);
+    _nsegments = 0;
+    _rsegbytes = 0;
+    _qhead = 0;
+    _qcount = 0;
+    _qbytes = 0;
+}
+
+// Set the number of queued bytes beyond which overflow waits for the
+// connection to drain instead of queueing more (0 means no limit).
+
+rpcbuf* rpcbuf::highwater(int nbytes) {
+    _highwater = (nbytes < 0) ? 0 : nbytes;
+    return this;
+}
+
+int rpcbuf::highwater() {
+    return _highwater;
+}
+
+boolean rpcbuf::congested() {
+    return _highwater > 0 && pending() >= _highwater;
+}
+
+// The Dispatcher calls a RpcFlusher when a connection with queued
+// output becomes writable again.
+
+RpcFlusher::RpcFlusher(rpcbuf* buf) : IOHandler(), _buf(buf) {}
+
+int RpcFlusher::outputReady(int) {
+    if (_buf->push() == EOF || _buf->pending() == 0) {
+	_buf->output_wait(false);
+    }
+    return 0;
 }
 
 // Empty the put area before filling the get area in case the input
-// depends on the output just flushed.  Move any unread data between
-// gptr() and egptr() to the beginning of the get area.  The get area
-// may contain unread data under nonblocking I/O because an incomplete
-// RPC request is not extracted until the rest of its data arrives.
+// depends on the output just flushed.  The get area may contain
+// unread data under nonblocking I/O because an incomplete RPC request
+// is not extracted until the rest of its data arrives.  Rather than
+// moving that data to the beginning of the get area before every
+// read, start over at the beginning only when everything has been
+// read and move unread data only when less than half of the buffer
+// is left after egptr().  (read_request has already made the buffer
+// big enough for the incomplete request, so this always leaves room.)
 // Read as much data as available into the free space between egptr()
 // and ebuf() (the get area occupies the entire buffer).  Move egptr()
 // to the end of the new data.  Return the first unread character.
@@ -475,10 +900,12 @@ int rpcbuf::underflow() {
     }
 
     int nunread = in_avail();
-    if (nunread) {
+    if (nunread == 0) {
+	setg(eback(), eback(), eback());
+    } else if (ebuf() - egptr() < (ebuf() - eback()) / 2) {
 	Memory::copy(gptr(), eback(), nunread);
+	setg(eback(), eback(), eback() + nunread);
     }
-    setg(eback(), eback(), eback() + nunread);
 
     int nread = read(_fd, egptr(), ebuf() - egptr());
     if (nread < 0) {
@@ -584,11 +1011,12 @@ boolean rpcbuf::expand_p() {
     }
 
     int nwaiting = out_waiting();
+    int roffset = rptr() ? rptr() - pbase() : -1;
     Memory::copy(pbase(), put, nwaiting);
     delete pbase();
     setp(put, put + newsize);
     pbump(nwaiting);
-    setr(put);
+    setr((roffset >= 0) ? put + roffset : nil);
 
     return true;
 }
@@ -43,7 +43,8 @@ RpcReader::RpcReader(rpcstream* _client, int nfcns) : IOHandler(),
     _function(new PF[nfcns]),
     _client(_client),
     _delete(false),
-    _fd(_client ? _client->rdbuf()->fd() : -1)
+    _fd(_client ? _client->rdbuf()->fd() : -1),
+    _batch(1)
 {
     if (_client) {
 	client().nonblocking(true);
@@ -71,7 +72,8 @@ RpcReader::RpcReader(int fd, int nfcns, boolean binary) : IOHandler(),
     _function(new PF[nfcns]),
     _client(new rpcstream),
     _delete(true),
-    _fd(fd)
+    _fd(fd),
+    _batch(1)
 {
     client().attach(fd);
     client().negotiate(binary);
@@ -102,25 +104,39 @@ RpcReader::~RpcReader() {
     delete[] _function;
 }
 
-// Read only one RPC request per call to allow the program to
-// interleave RPC requests from multiple clients.  Look up the proper
-// reader to execute the request or skip over the request's data if it
-// could not be executed.  Ask a derived class to take the appropriate
-// action (perhaps closing the file number or deleting ``this'') if no
-// more data is available or the data wasn't what we expected.
+// Read up to _batch RPC requests per call (only one by default) to
+// allow the program to interleave RPC requests from multiple clients.
+// Only the first request may need a read from the connection; after
+// that, keep going only while complete requests are already buffered.
+// Look up the proper reader to execute each request or skip over the
+// request's data if it could not be executed.  Report how many
+// requests were handled, then ask a derived class to take the
+// appropriate action (perhaps closing the file number or deleting
+// ``this'') if no more data is available or the data wasn't what we
+// expected.
 
 int RpcReader::inputReady(int fd) {
-    RpcHdr hdr;
+    int nrequests = 0;
 
-    client() >> hdr;
+    do {
+	RpcHdr hdr;
 
-    if (client().good() && !client().incomplete_request()) {
-	RpcReader* reader = map(hdr.reader());
+	client() >> hdr;
 
-	if (!execute(reader, hdr)) {
-	    client().ignore(hdr.ndata());
+	if (client().good() && !client().incomplete_request()) {
+	    RpcReader* reader = map(hdr.reader());
+
+	    if (!execute(reader, hdr)) {
+		client().ignore(hdr.ndata());
+	    }
+	    nrequests++;
 	}
-    }
+    } while (
+	(_batch == 0 || nrequests < _batch) &&
+	client().good() && !client().incomplete_request()
+    );
+
+    batchExecuted(fd, nrequests);
 
     if (client().eof() || client().fail()) {
 	connectionClosed(fd);
@@ -132,6 +148,12 @@ int RpcReader::inputReady(int fd) {
     }
 }
 
+// Called once per inputReady with the number of requests executed or
+// skipped.  Derived classes can override this to gather statistics
+// for tuning the batch size; the default does nothing.
+
+void RpcReader::batchExecuted(int, int) {}
+
 // Map the number to the reader that should unmarshall the RPC
 // request.  Return this reader itself by default; derived classes
 // could return a different reader.
@@ -91,6 +91,13 @@ RpcWriter::~RpcWriter() {
     delete _host;
 }
 
+// Tell callers to hold off on new requests while more output is
+// queued on a nonblocking connection than its high-water mark allows.
+
+boolean RpcWriter::congested() {
+    return server().rdbuf()->congested();
+}
+
 // Use a member function to open a connection to an RPC service at its
 // registered host name and port number so that a derived class's
 // constructor can retry the attempt if necessary.
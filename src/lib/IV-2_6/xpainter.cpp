@@ -670,6 +670,10 @@ void Painter::Stencil(
     if (rep->iv_xor) {
         End_xor();
     }
+    bitmap->flush();
+    if (mask != nil && mask != bitmap) {
+        mask->flush();
+    }
     int tx = TxKey(matrix, bitmap->pwidth(), bitmap->pheight());
     if (tx == 0) {
         IntCoord dx, dy;
@@ -131,6 +131,26 @@ boolean Bitmap::peek(int x, int y) const
    return false;
 }
 
+// ---------------------------------------------------------------------
+// Runs of bits, packed most significant bit first.
+// ---------------------------------------------------------------------
+void Bitmap::poke_bits(int x, int y, int count, const unsigned char* bits)
+{
+	for (int i = 0; i < count; i++)
+		poke((bits[i >> 3] & (0x80 >> (i & 7))) != 0, x + i, y);
+}
+
+void Bitmap::peek_bits(int x, int y, int count, unsigned char* bits) const
+{
+	for (int n = 0; n < (count + 7) >> 3; n++)
+		bits[n] = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (peek(x + i, y))
+			bits[i >> 3] |= 0x80 >> (i & 7);
+	}
+}
+
 // ---------------------------------------------------------------------
 // This function has absolutely no meaning in the MS-Windows 
 // implimentation.  I don't think it even has a reason to exist, and 
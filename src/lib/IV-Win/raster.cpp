@@ -165,6 +165,75 @@ void Raster::poke(
 	SetPixel(rep_->deviceContext(), x, rep_->height_ - y, pixelColor);
 }
 
+// -----------------------------------------------------------------------
+// Rectangle access in packed 8-bit samples.  The first row in the
+// buffer is the top row of the rectangle.
+// -----------------------------------------------------------------------
+void Raster::peek_pixels(
+	unsigned long x,
+	unsigned long y,
+	unsigned long w,
+	unsigned long h,
+	unsigned char* pixels,
+	PixelFormat format,
+	long stride) const
+{
+	int bytes = int(format);
+	if (stride == 0)
+		stride = long(w) * bytes;
+	for (unsigned long row = 0; row < h; row++)
+	{
+		unsigned char* p = pixels + row * stride;
+		unsigned long py = y + h - 1 - row;
+		for (unsigned long col = 0; col < w; col++)
+		{
+			ColorIntensity r, g, b;
+			float alpha;
+			peek(x + col, py, r, g, b, alpha);
+			if (format == gray8)
+				p[0] = (unsigned char) ((0.30 * r + 0.59 * g + 0.11 * b) * 255.0 + 0.5);
+			else
+			{
+				p[0] = (unsigned char) (r * 255.0 + 0.5);
+				p[1] = (unsigned char) (g * 255.0 + 0.5);
+				p[2] = (unsigned char) (b * 255.0 + 0.5);
+				if (format == rgba8)
+					p[3] = 0xff;
+			}
+			p += bytes;
+		}
+	}
+}
+
+void Raster::poke_pixels(
+	unsigned long x,
+	unsigned long y,
+	unsigned long w,
+	unsigned long h,
+	const unsigned char* pixels,
+	PixelFormat format,
+	long stride)
+{
+	int bytes = int(format);
+	if (stride == 0)
+		stride = long(w) * bytes;
+	for (unsigned long row = 0; row < h; row++)
+	{
+		const unsigned char* p = pixels + row * stride;
+		unsigned long py = y + h - 1 - row;
+		for (unsigned long col = 0; col < w; col++)
+		{
+			ColorIntensity r = p[0] / ColorIntensity(255.0);
+			if (format == gray8)
+				poke(x + col, py, r, r, r, 1.0);
+			else
+				poke(x + col, py, r, p[1] / ColorIntensity(255.0),
+					p[2] / ColorIntensity(255.0), 1.0);
+			p += bytes;
+		}
+	}
+}
+
 void Raster::flush() const
 {
 	// This is a no-op for the MS-Windows implementation.  
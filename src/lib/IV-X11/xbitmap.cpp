@@ -34,6 +34,7 @@
 #include <InterViews/font.h>
 #include <InterViews/session.h>
 #include <IV-X11/xbitmap.h>
+#include <IV-X11/xcanvas.h>
 #include <IV-X11/xfont.h>
 #include <IV-X11/xdisplay.h>
 #include <IV-X11/Xlib.h>
@@ -190,11 +191,13 @@ Bitmap::Bitmap(const Font* f, long c, float scale) {
 }    
 
 Bitmap::Bitmap(const Bitmap& bm) {
+    bm.flush();
     rep_ = new BitmapRep(bm.rep_, BitmapRep::copy);
     flush();
 }
 
 Bitmap::~Bitmap() {
+    TxImageCache::purge(this);
     delete rep_;
 }
 
@@ -223,7 +226,82 @@ boolean Bitmap::peek(int x, int y) const {
     return pixel != 0;
 }
 
-void Bitmap::flush() const { rep()->flush(); }
+/*
+ * The bitmap image is one bit deep.  When its bytes hold pixels in
+ * order (one-byte units, or units whose byte and bit orders agree)
+ * the bits are addressed directly; otherwise use XPutPixel/XGetPixel.
+ */
+
+static inline boolean bits_direct(XImage* image) {
+    return image->bits_per_pixel == 1 && (
+	image->bitmap_unit == 8 ||
+	image->byte_order == image->bitmap_bit_order
+    );
+}
+
+void Bitmap::poke_bits(int x, int y, int count, const unsigned char* bits) {
+    BitmapRep* b = rep();
+    b->fill();
+    XImage* image = b->image_;
+    int iy = b->pheight_ - 1 - y;
+    if (bits_direct(image)) {
+	unsigned char* line = (unsigned char*)(
+	    image->data + iy * image->bytes_per_line
+	);
+	boolean lsb = image->bitmap_bit_order == LSBFirst;
+	for (int i = 0; i < count; i++) {
+	    int ix = x + i;
+	    int mask = lsb ? (1 << (ix & 7)) : (0x80 >> (ix & 7));
+	    if ((bits[i >> 3] & (0x80 >> (i & 7))) != 0) {
+		line[ix >> 3] |= mask;
+	    } else {
+		line[ix >> 3] &= ~mask;
+	    }
+	}
+    } else {
+	for (int i = 0; i < count; i++) {
+	    XPutPixel(image, x + i, iy, (bits[i >> 3] >> (7 - (i & 7))) & 1);
+	}
+    }
+    b->modified_ = true;
+}
+
+void Bitmap::peek_bits(int x, int y, int count, unsigned char* bits) const {
+    BitmapRep* b = rep();
+    b->fill();
+    XImage* image = b->image_;
+    int iy = b->pheight_ - 1 - y;
+    for (int n = 0; n < (count + 7) >> 3; n++) {
+	bits[n] = 0;
+    }
+    if (bits_direct(image)) {
+	const unsigned char* line = (const unsigned char*)(
+	    image->data + iy * image->bytes_per_line
+	);
+	boolean lsb = image->bitmap_bit_order == LSBFirst;
+	for (int i = 0; i < count; i++) {
+	    int ix = x + i;
+	    int mask = lsb ? (1 << (ix & 7)) : (0x80 >> (ix & 7));
+	    if ((line[ix >> 3] & mask) != 0) {
+		bits[i >> 3] |= 0x80 >> (i & 7);
+	    }
+	}
+    } else {
+	for (int i = 0; i < count; i++) {
+	    if (XGetPixel(image, x + i, iy) != 0) {
+		bits[i >> 3] |= 0x80 >> (i & 7);
+	    }
+	}
+    }
+}
+
+void Bitmap::flush() const {
+    BitmapRep* b = rep();
+    if (b->modified_) {
+	TxImageCache::purge(this);
+    }
+    b->flush();
+}
 
 /* class BitmapRep */
 
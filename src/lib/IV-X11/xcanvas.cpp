@@ -31,7 +31,9 @@
 #include <InterViews/color.h>
 #include <InterViews/display.h>
 #include <InterViews/font.h>
+#include <InterViews/memcanvas.h>
 #include <InterViews/raster.h>
+#include <InterViews/session.h>
 #include <InterViews/style.h>
 #include <InterViews/transformer.h>
 #include <InterViews/window.h>
@@ -46,6 +48,7 @@
 #include <IV-X11/xraster.h>
 #include <OS/math.h>
 #include <OS/list.h>
+#include <OS/table.h>
 #include <OS/table2.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -61,6 +64,21 @@ implementPtrList(TransformerStack,Transformer)
 declarePtrList(ClippingStack,_XRegion)
 implementPtrList(ClippingStack,_XRegion)
 
+/*
+ * Characters on the same baseline are buffered so a line goes out
+ * as one request; each word is an item placed where layout put it.
+ */
+
+static const int text_size = 1000;
+static const int text_items = 100;
+
+/*
+ * Lines, rectangle outlines, and filled rectangles drawn with the same
+ * color and brush during a repair go out together.
+ */
+
+static const int batch_size = 1024;
+
 /* class Canvas */
 
 Canvas::Canvas() {
@@ -69,20 +87,30 @@ Canvas::Canvas() {
 
     TextRenderInfo* t = &CanvasRep::text_;
     PathRenderInfo* p = &CanvasRep::path_;
+    BatchRenderInfo* b = &CanvasRep::batch_;
     if (t->text_ == nil) {
-        t->text_ = new char[1000];
+        t->text_ = new char[text_size];
         t->cur_text_ = t->text_;
-        t->items_ = new XTextItem[100];
+        t->items_ = new XTextItem[text_items];
+        t->item_count_ = 0;
     }
     if (p->point_ == nil) {
         p->point_ = new XPoint[10];
         p->cur_point_ = p->point_;
 	p->end_point_ = p->point_ + 10;
     }
+    if (b->segments_ == nil) {
+	b->segments_ = new XSegment[batch_size];
+	b->rects_ = new XRectangle[batch_size];
+	b->count_ = 0;
+    }
     c->drawbuffer_ = CanvasRep::unbound;
     c->copybuffer_ = CanvasRep::unbound;
     c->drawgc_ = nil;
     c->copygc_ = nil;
+    c->stencilgc_ = nil;
+    c->xorgc_ = nil;
+    c->stencil_clip_ = false;
     c->brush_ = nil;
     c->brush_width_ = 0;
     c->dash_list_ = nil;
@@ -114,6 +142,10 @@ Canvas::Canvas() {
     c->damaged_ = false;
     c->on_damage_list_ = false;
     c->repairing_ = false;
+    c->damage_count_ = 0;
+    c->damage_area_ = 0;
+    c->damaged_pixels_ = 0;
+    c->redrawn_pixels_ = 0;
 
     c->status_ = unmapped;
 }
@@ -256,10 +288,12 @@ void Canvas::pop_clipping() {
     } else {
 	XSetRegion(dpy, gc, clip);
     }
+    c->stencil_clip_ = false;
 }
 
 void Canvas::front_buffer() {
     CanvasRep& c = *rep();
+    c.flush();
     if (c.copybuffer_ != CanvasRep::unbound) {
 	c.drawbuffer_ = c.copybuffer_;
     }
@@ -267,6 +301,7 @@ void Canvas::front_buffer() {
 
 void Canvas::back_buffer() {
     CanvasRep& c = *rep();
+    c.flush();
     if (c.copybuffer_ != CanvasRep::unbound) {
 	c.drawbuffer_ = c.xdrawable_;
     }
@@ -466,22 +501,39 @@ void Canvas::stroke(const Color* color, const Brush* b) {
     if (n < 2) {
 	return;
     }
-    c->flush();
-    c->color(color);
-    c->brush(b);
+    BatchRenderInfo* bi = &CanvasRep::batch_;
     XDisplay* dpy = c->display_->rep()->display_;
     XDrawable d = c->drawbuffer_;
     GC gc = c->drawgc_;
     XPoint* pt = p->point_;
     if (n == 2) {
-        XDrawLine(dpy, d, gc, pt[0].x, pt[0].y, pt[1].x, pt[1].y);
+	if (c->batch(CanvasRep::batch_segments, color, b)) {
+	    XSegment& s = bi->segments_[bi->count_++];
+	    s.x1 = pt[0].x;
+	    s.y1 = pt[0].y;
+	    s.x2 = pt[1].x;
+	    s.y2 = pt[1].y;
+	} else {
+	    XDrawLine(dpy, d, gc, pt[0].x, pt[0].y, pt[1].x, pt[1].y);
+	}
     } else if (xrect(pt, n)) {
         int x = Math::min(pt[0].x, pt[2].x);
         int y = Math::min(pt[0].y, pt[2].y);
         int w = Math::abs(pt[0].x - pt[2].x);
         int h = Math::abs(pt[0].y - pt[2].y);
-        XDrawRectangle(dpy, d, gc, x, y, w, h);
+	if (c->batch(CanvasRep::batch_rectangles, color, b)) {
+	    XRectangle& r = bi->rects_[bi->count_++];
+	    r.x = x;
+	    r.y = y;
+	    r.width = w;
+	    r.height = h;
+	} else {
+	    XDrawRectangle(dpy, d, gc, x, y, w, h);
+	}
     } else {
+	c->flush();
+	c->color(color);
+	c->brush(b);
         XDrawLines(dpy, d, gc, pt, n, CoordModeOrigin);
     }
 }
@@ -518,8 +570,7 @@ void Canvas::fill(const Color* color) {
     if (n <= 2) {
 	return;
     }
-    c->flush();
-    c->color(color);
+    BatchRenderInfo* bi = &CanvasRep::batch_;
     XDisplay* dpy = c->display_->rep()->display_;
     XDrawable d = c->drawbuffer_;
     GC gc = c->drawgc_;
@@ -529,8 +580,18 @@ void Canvas::fill(const Color* color) {
         int y = Math::min(pt[0].y, pt[2].y);
         int w = Math::abs(pt[0].x - pt[2].x);
         int h = Math::abs(pt[0].y - pt[2].y);
-        XFillRectangle(dpy, d, gc, x, y, w, h);
+	if (c->batch(CanvasRep::batch_fills, color, nil)) {
+	    XRectangle& r = bi->rects_[bi->count_++];
+	    r.x = x;
+	    r.y = y;
+	    r.width = w;
+	    r.height = h;
+	} else {
+	    XFillRectangle(dpy, d, gc, x, y, w, h);
+	}
     } else {
+	c->flush();
+	c->color(color);
         XFillPolygon(dpy, d, gc, pt, n, Complex, CoordModeOrigin);
     }
 }
@@ -571,6 +632,7 @@ void Canvas::clip() {
     XDestroyRegion(c->clipping_);
     c->clipping_ = clip;
     XSetRegion(c->dpy(), c->drawgc_, clip);
+    c->stencil_clip_ = false;
 }
 
 void Canvas::clip_rect(Coord l, Coord b, Coord r, Coord t) {
@@ -633,12 +695,23 @@ static const Bitmap* char_bitmap(Display* d, const Font* font, long c) {
     return b;
 }
 
+/*
+ * MemoryCanvas shares the cache, scaled for the default display.
+ */
+
+const Bitmap* MemoryCanvas::char_bitmap(const Font* font, long c) {
+    return ::char_bitmap(Session::instance()->default_display(), font, c);
+}
+
 void Canvas::character(
     const Font* f, long ch, Coord width, const Color* color, Coord x, Coord y
 ) {
     CanvasRep* c = rep();
     int int_ch = int(ch);
     boolean is_flush = !isprint(int_ch);
+    if (CanvasRep::batch_.count_ != 0) {
+	c->flush();
+    }
     if (f != nil && f != c->font_) {
 	c->flush();
 	c->font(f);
@@ -652,26 +725,41 @@ void Canvas::character(
         (!c->transformed_ || tx_key(m, width, width) == 0)
     ) {
 	TextRenderInfo* tr = &CanvasRep::text_;
-        if (is_flush || y != tr->cury_ ||
-	    !Math::equal(x, tr->curx_, float(0.1))
-	) {
-            c->flush();
-        }
 	char* cp = tr->cur_text_;
-        if (cp == tr->text_) {
-            Coord tx = x;
-            Coord ty = y;
-            if (c->transformed_) {
-                m.transform(tx, ty);
-            }
-            tr->canvas_ = c;
-            tr->drawgc_ = c->drawgc_;
+	boolean new_item = false;
+	if (cp != tr->text_) {
+	    if (is_flush || tr->canvas_ != c || y != tr->cury_ ||
+		cp + 2 > tr->text_ + text_size
+	    ) {
+		c->flush();
+	    } else if (cp[-1] == ' ' || !Math::equal(x, tr->curx_, float(0.1))) {
+		if (c->text_twobyte_ || tr->item_count_ == text_items) {
+		    c->flush();
+		} else {
+		    new_item = true;
+		}
+	    }
+	    cp = tr->cur_text_;
+	}
+	if (cp == tr->text_ || new_item) {
+	    Coord tx = x;
+	    Coord ty = y;
+	    if (c->transformed_) {
+		m.transform(tx, ty);
+	    }
 	    Display* d = c->display_;
-            tr->x0_ = d->to_pixels(tx);
-            tr->y0_ = c->pheight_ - d->to_pixels(ty);
-            tr->width_ = 0;
-        }
-        tr->width_ += width;
+	    XTextItem& item = tr->items_[tr->item_count_];
+	    item.chars = cp;
+	    item.delta = d->to_pixels(tx);
+	    item.font = None;
+	    tr->item_count_ += 1;
+	    if (cp == tr->text_) {
+		tr->canvas_ = c;
+		tr->drawgc_ = c->drawgc_;
+		tr->x0_ = item.delta;
+		tr->y0_ = c->pheight_ - d->to_pixels(ty);
+	    }
+	}
         tr->curx_ = x + width;
         tr->cury_ = y;
         if (c->text_twobyte_) {
@@ -683,12 +771,6 @@ void Canvas::character(
 	    *cp++ = char(ch & 0xff);
         }
 	tr->cur_text_ = cp;
-        if (ch == ' ') {
-            tr->spaces_ += 1;
-            if (cp > tr->text_ + 1) {
-		c->flush();
-	    }
-        }
         if (is_flush) {
             c->flush();
         }
@@ -698,21 +780,469 @@ void Canvas::character(
     }
 }
 
-declareTable2(TxBitmapTable,const Bitmap*,int,BitmapRep*)
-implementTable2(TxBitmapTable,const Bitmap*,int,BitmapRep*)
+/*
+ * Transformed image cache.  Each entry holds the transformed copy
+ * of a bitmap or raster, keyed by the source object and tx_key.
+ * Entries are kept on a list in order of use so that the least recently
+ * drawn ones can be freed when the pixmap budget is exceeded, and are
+ * chained by source so that they can be freed when the source changes
+ * or goes away.
+ */
+
+struct TxImage {
+    const void* source_;
+    int key_;
+    BitmapRep* bitmap_;
+    RasterRep* raster_;
+    unsigned long bytes_;
+    TxImage* prev_;
+    TxImage* next_;
+    TxImage* sibling_;
+};
+
+declareTable2(TxImageTable,const void*,int,TxImage*)
+implementTable2(TxImageTable,const void*,int,TxImage*)
+
+declareTable(TxSourceTable,const void*,TxImage*)
+implementTable(TxSourceTable,const void*,TxImage*)
+
+static TxImageTable* _tx_images;
+static TxSourceTable* _tx_sources;
+static TxImage* _tx_head;
+static TxImage* _tx_tail;
+static boolean _tx_budget_set;
+static unsigned long _tx_budget;
+static unsigned long _tx_size;
+static unsigned long _tx_count;
+static unsigned long _tx_hits;
+static unsigned long _tx_misses;
+static unsigned long _tx_evictions;
+
+static const long tx_default_budget = 8192;
+
+static void tx_init() {
+    if (_tx_images == nil) {
+	_tx_images = new TxImageTable(1024);
+	_tx_sources = new TxSourceTable(256);
+	if (!_tx_budget_set) {
+	    long kbytes = tx_default_budget;
+	    Session* s = Session::instance();
+	    if (s != nil && s->style() != nil) {
+		s->style()->find_attribute("transformedImageCache", kbytes);
+	    }
+	    _tx_budget = kbytes > 0 ? (unsigned long)kbytes << 10 : 0;
+	    _tx_budget_set = true;
+	}
+    }
+}
+
+static void tx_unlink(TxImage* t) {
+    if (t->prev_ == nil) {
+	_tx_head = t->next_;
+    } else {
+	t->prev_->next_ = t->next_;
+    }
+    if (t->next_ == nil) {
+	_tx_tail = t->prev_;
+    } else {
+	t->next_->prev_ = t->prev_;
+    }
+}
+
+static void tx_link(TxImage* t) {
+    t->prev_ = nil;
+    t->next_ = _tx_head;
+    if (_tx_head == nil) {
+	_tx_tail = t;
+    } else {
+	_tx_head->prev_ = t;
+    }
+    _tx_head = t;
+}
+
+/*
+ * Free an entry without touching its source chain.
+ */
+
+static void tx_discard(TxImage* t) {
+    tx_unlink(t);
+    _tx_images->remove(t->source_, t->key_);
+    if (t->bitmap_ != nil) {
+	delete t->bitmap_;
+    } else {
+	RasterRep* r = t->raster_;
+	XFreePixmap(r->display_->rep()->display_, r->pixmap_);
+	delete r;
+    }
+    _tx_size -= t->bytes_;
+    --_tx_count;
+    delete t;
+}
+
+/*
+ * Free an entry, removing it from the chain for its source.
+ */
+
+static void tx_evict(TxImage* t) {
+    TxImage* head;
+    if (_tx_sources->find(head, t->source_)) {
+	if (head == t) {
+	    _tx_sources->remove(t->source_);
+	    if (t->sibling_ != nil) {
+		_tx_sources->insert(t->source_, t->sibling_);
+	    }
+	} else {
+	    TxImage* prev = head;
+	    while (prev->sibling_ != nil && prev->sibling_ != t) {
+		prev = prev->sibling_;
+	    }
+	    prev->sibling_ = t->sibling_;
+	}
+    }
+    tx_discard(t);
+}
+
+/*
+ * Make room for an entry of the given size.  The entry about
+ * to be added is always kept even if it alone exceeds the budget,
+ * since the caller is going to draw it.
+ */
+
+static void tx_reserve(unsigned long bytes) {
+    while (_tx_tail != nil && _tx_size + bytes > _tx_budget) {
+	tx_evict(_tx_tail);
+	++_tx_evictions;
+    }
+}
+
+static TxImage* tx_find(const void* source, int key) {
+    tx_init();
+    TxImage* t;
+    if (_tx_images->find(t, source, key)) {
+	++_tx_hits;
+	if (t != _tx_head) {
+	    tx_unlink(t);
+	    tx_link(t);
+	}
+	return t;
+    }
+    ++_tx_misses;
+    return nil;
+}
+
+static void tx_insert(
+    const void* source, int key, BitmapRep* b, RasterRep* r,
+    unsigned long bytes
+) {
+    tx_reserve(bytes);
+    TxImage* t = new TxImage;
+    t->source_ = source;
+    t->key_ = key;
+    t->bitmap_ = b;
+    t->raster_ = r;
+    t->bytes_ = bytes;
+    TxImage* head;
+    if (_tx_sources->find_and_remove(head, source)) {
+	t->sibling_ = head;
+    } else {
+	t->sibling_ = nil;
+    }
+    _tx_sources->insert(source, t);
+    _tx_images->insert(source, key, t);
+    tx_link(t);
+    _tx_size += bytes;
+    ++_tx_count;
+}
+
+void TxImageCache::budget(unsigned long bytes) {
+    _tx_budget = bytes;
+    _tx_budget_set = true;
+    if (_tx_images != nil) {
+	tx_reserve(0);
+    }
+}
+
+unsigned long TxImageCache::budget() {
+    tx_init();
+    return _tx_budget;
+}
+
+unsigned long TxImageCache::size() { return _tx_size; }
+unsigned long TxImageCache::count() { return _tx_count; }
+unsigned long TxImageCache::hits() { return _tx_hits; }
+unsigned long TxImageCache::misses() { return _tx_misses; }
+unsigned long TxImageCache::evictions() { return _tx_evictions; }
+
+void TxImageCache::purge(const void* source) {
+    TxImage* t;
+    if (_tx_sources != nil && _tx_sources->find_and_remove(t, source)) {
+	while (t != nil) {
+	    TxImage* next = t->sibling_;
+	    tx_discard(t);
+	    t = next;
+	}
+    }
+}
+
+void TxImageCache::clear() {
+    while (_tx_tail != nil) {
+	tx_evict(_tx_tail);
+    }
+}
+
+/*
+ * Client-side affine resampling for transformed bitmaps and rasters.
+ *
+ * The inverse image of a destination row is a straight line through
+ * the source, so it is stepped in 16.16 fixed point.  Each row is
+ * first clipped to the part that falls inside the source, solving for
+ * its ends rather than searching, which leaves the inner loops free of
+ * bounds tests.  Packed 32, 8, and 1 bit per pixel images are read and
+ * written directly; other formats go through XGetPixel/XPutPixel.
+ * Rows are independent of one another, so tx_resample_rows may be
+ * applied to disjoint stripes.
+ */
+
+struct TxResample {
+    XImage* source_;
+    XImage* dest_;
+    Transformer* tx_;
+    int sx0_;
+    int sy0_;
+    int dx0_;
+    int dy0_;
+    boolean smooth_;
+};
+
+static inline long tx_fixed(Coord c) {
+    double f = c * 65536.0;
+    return long(f < 0 ? f - 0.5 : f + 0.5);
+}
+
+static inline unsigned int tx_blend(
+    unsigned int p1, unsigned int p2, unsigned int w
+) {
+    unsigned int rb = (
+	(p1 & 0xff00ff) * (256 - w) + (p2 & 0xff00ff) * w
+    ) >> 8;
+    unsigned int ag = (
+	((p1 >> 8) & 0xff00ff) * (256 - w) + ((p2 >> 8) & 0xff00ff) * w
+    );
+    return (rb & 0xff00ff) | (ag & 0xff00ff00);
+}
+
+static inline long tx_floor_div(long a, long b) {
+    return a >= 0 ? a / b : - ((- a + b - 1) / b);
+}
+
+/*
+ * Narrow [first, last] to the steps t for which 0 <= f + t * df < limit.
+ */
+
+static void tx_span(long f, long df, long limit, int& first, int& last) {
+    long lo, hi;
+    if (df > 0) {
+	lo = - tx_floor_div(f, df);
+	hi = tx_floor_div(limit - 1 - f, df);
+    } else if (df < 0) {
+	lo = - tx_floor_div(limit - 1 - f, - df);
+	hi = tx_floor_div(f, - df);
+    } else if (f >= 0 && f < limit) {
+	return;
+    } else {
+	lo = first;
+	hi = first - 1;
+    }
+    if (lo > first) {
+	first = lo > last + 1 ? last + 1 : int(lo);
+    }
+    if (hi < last) {
+	last = hi < first - 1 ? first - 1 : int(hi);
+    }
+}
+
+static void tx_resample_rows(TxResample& r, int y0, int y1) {
+    XImage* s = r.source_;
+    XImage* d = r.dest_;
+    int spw = s->width;
+    int sph = s->height;
+    int sbpl = s->bytes_per_line;
+    int dbpl = d->bytes_per_line;
+    int width = d->width;
+    int height = d->height;
+    int bpp = s->bits_per_pixel;
+    if (
+	d->bits_per_pixel != bpp ||
+	(bpp == 1 && (
+	    s->bitmap_bit_order != d->bitmap_bit_order ||
+	    (s->bitmap_unit != 8 && s->byte_order != s->bitmap_bit_order) ||
+	    (d->bitmap_unit != 8 && d->byte_order != d->bitmap_bit_order)
+	))
+    ) {
+	bpp = 0;
+    }
+    boolean lsb = s->bitmap_bit_order == LSBFirst;
+    long xlimit = long(spw) << 16;
+    long ylimit = long(sph) << 16;
+    for (int dy = y0; dy < y1; ++dy) {
+	Coord tx1, ty1, tx2, ty2;
+	r.tx_->inverse_transform(- r.dx0_, dy - r.dy0_, tx1, ty1);
+	r.tx_->inverse_transform(width - r.dx0_, dy - r.dy0_, tx2, ty2);
+	long fx = tx_fixed(tx1) + (long(r.sx0_) << 16);
+	long fy = tx_fixed(ty1) + (long(r.sy0_) << 16);
+	long dfx = tx_fixed((tx2 - tx1) / width);
+	long dfy = tx_fixed((ty2 - ty1) / width);
 
-static TxBitmapTable* _tx_bitmaps;
+	/*
+	 * The source coordinates are linear along the row,
+	 * so the pixels that land inside the source are contiguous.
+	 */
+	int first = 0;
+	int last = width - 1;
+	tx_span(fx, dfx, xlimit, first, last);
+	tx_span(fy, dfy, ylimit, first, last);
+	if (first > last) {
+	    continue;
+	}
+	fx += first * dfx;
+	fy += first * dfy;
+
+	int row = height - 1 - dy;
+	char* dline = d->data + row * dbpl;
+	int dx;
+	switch (bpp) {
+	case 32:
+	    if (r.smooth_) {
+		unsigned int* dp = (unsigned int*)dline;
+		for (dx = first; dx <= last; ++dx) {
+		    int sx = int(fx >> 16);
+		    int sy = int(fy >> 16);
+		    unsigned int wx = (unsigned int)(fx >> 8) & 0xff;
+		    unsigned int wy = (unsigned int)(fy >> 8) & 0xff;
+		    int sx1 = sx < spw - 1 ? sx + 1 : sx;
+		    int sy1 = sy < sph - 1 ? sy + 1 : sy;
+		    const unsigned int* p = (const unsigned int*)(
+			s->data + (sph - 1 - sy) * sbpl
+		    );
+		    const unsigned int* q = (const unsigned int*)(
+			s->data + (sph - 1 - sy1) * sbpl
+		    );
+		    dp[dx] = tx_blend(
+			tx_blend(p[sx], p[sx1], wx),
+			tx_blend(q[sx], q[sx1], wx),
+			wy
+		    );
+		    fx += dfx;
+		    fy += dfy;
+		}
+	    } else {
+		unsigned int* dp = (unsigned int*)dline;
+		for (dx = first; dx <= last; ++dx) {
+		    const unsigned int* p = (const unsigned int*)(
+			s->data + (sph - 1 - int(fy >> 16)) * sbpl
+		    );
+		    dp[dx] = p[int(fx >> 16)];
+		    fx += dfx;
+		    fy += dfy;
+		}
+	    }
+	    break;
+	case 8:
+	    for (dx = first; dx <= last; ++dx) {
+		const char* p = s->data + (sph - 1 - int(fy >> 16)) * sbpl;
+		dline[dx] = p[int(fx >> 16)];
+		fx += dfx;
+		fy += dfy;
+	    }
+	    break;
+	case 1:
+	    for (dx = first; dx <= last; ++dx) {
+		int sx = int(fx >> 16);
+		const char* p = s->data + (sph - 1 - int(fy >> 16)) * sbpl;
+		int bit = lsb ? (1 << (sx & 7)) : (0x80 >> (sx & 7));
+		if ((p[sx >> 3] & bit) != 0) {
+		    dline[dx >> 3] |= lsb ? (1 << (dx & 7)) : (0x80 >> (dx & 7));
+		}
+		fx += dfx;
+		fy += dfy;
+	    }
+	    break;
+	default:
+	    for (dx = first; dx <= last; ++dx) {
+		XPutPixel(
+		    d, dx, row,
+		    XGetPixel(s, int(fx >> 16), sph - 1 - int(fy >> 16))
+		);
+		fx += dfx;
+		fy += dfy;
+	    }
+	    break;
+	}
+    }
+}
+
+/*
+ * Create a zero-filled client image to resample into.
+ */
+
+static XImage* tx_image(
+    XDisplay* dpy, Visual* visual, unsigned int depth, int width, int height
+) {
+    XImage* i = XCreateImage(
+	dpy, visual, depth, ZPixmap, 0, nil, width, height, BitmapPad(dpy), 0
+    );
+    i->data = (char*)calloc(i->bytes_per_line * height, 1);
+    return i;
+}
+
+/*
+ * Bilinear filtering is used only when requested with the "smoothImages"
+ * style attribute and when the visual keeps each of red, green, and blue
+ * in a separate byte of a 32-bit pixel, so that the bytes can be
+ * blended independently.
+ */
+
+static boolean tx_smooth(WindowVisual* wv, XImage* i) {
+    static int smooth = -1;
+    if (smooth < 0) {
+	Session* s = Session::instance();
+	smooth = (
+	    s != nil && s->style() != nil &&
+	    s->style()->value_is_on("smoothImages")
+	) ? 1 : 0;
+    }
+    if (smooth == 0 || i->bits_per_pixel != 32) {
+	return false;
+    }
+    Visual* v = wv->visual();
+    if (v->c_class != TrueColor) {
+	return false;
+    }
+    unsigned long masks[3];
+    masks[0] = v->red_mask;
+    masks[1] = v->green_mask;
+    masks[2] = v->blue_mask;
+    for (int m = 0; m < 3; m++) {
+	if (
+	    masks[m] != 0xff && masks[m] != 0xff00 &&
+	    masks[m] != 0xff0000 && masks[m] != 0xff000000
+	) {
+	    return false;
+	}
+    }
+    return true;
+}
 
 static BitmapRep* tx_bitmap(const Bitmap* b, const Transformer& tx) {
     int key = tx_key(tx, b->width(), b->height());
     if (key == 0) {
         return b->rep();
     } else {
-	if (_tx_bitmaps == nil) {
-	    _tx_bitmaps = new TxBitmapTable(1024);
-	}
         BitmapRep* rep;
-        if (!_tx_bitmaps->find(rep, b, key)) {
+        TxImage* t = tx_find(b, key);
+        if (t != nil) {
+            rep = t->bitmap_;
+        } else {
 	    Display* d = b->rep()->display_;
             rep = new BitmapRep;
 
@@ -746,51 +1276,24 @@ static BitmapRep* tx_bitmap(const Bitmap* b, const Transformer& tx) {
 
 	    XDisplay* dpy = d->rep()->display_;
             BitmapRep* srep = b->rep();
-
-            XImage* source = XGetImage(
-                dpy, srep->pixmap_,
-                0, 0, srep->pwidth_, srep->pheight_, 0x01, ZPixmap
-            );
+            srep->fill();
+
+            XImage* dest = tx_image(dpy, nil, 1, width, height);
+            TxResample job;
+            job.source_ = srep->image_;
+            job.dest_ = dest;
+            job.tx_ = &v;
+            job.sx0_ = d->to_pixels(b->left_bearing());
+            job.sy0_ = d->to_pixels(b->descent());
+            job.dx0_ = d->to_pixels(-xmin);
+            job.dy0_ = d->to_pixels(-ymin);
+            job.smooth_ = false;
+            tx_resample_rows(job, 0, height);
 
             Pixmap map = XCreatePixmap(dpy, d->rep()->root_, width, height, 1);
             GC xgc = XCreateGC(dpy, map, 0, nil);
-            XSetForeground(dpy, xgc, 0);
-            XFillRectangle(dpy, map, xgc, 0, 0, width, height);
-            XImage* dest = XGetImage(
-                dpy, map, 0, 0, width, height, 0x01, ZPixmap
-            );
-
-            int dx0 = d->to_pixels(-xmin);
-            int dy0 = d->to_pixels(-ymin);
-            int sx0 = d->to_pixels(b->left_bearing());
-            int sy0 = d->to_pixels(b->descent());
-            for (int dy = 0; dy < height; ++dy) {
-                Coord tx1, ty1, tx2, ty2;
-                v.inverse_transform(- dx0, dy - dy0, tx1, ty1);
-                v.inverse_transform(width - dx0, dy - dy0, tx2, ty2);
-                float delta_x = (tx2 - tx1) / width;
-                float delta_y = (ty2 - ty1) / width;
-                int sx, sy;
-                for (int dx = 0; dx < width; ++dx) {
-                    sx = int(tx1) + sx0;
-                    sy = int(ty1) + sy0;
-                    if (
-                        sx >= 0 && sx < srep->pwidth_
-                        && sy >= 0 && sy < srep->pheight_
-                    ) {
-                        XPutPixel(
-                            dest, dx, height - 1 - dy,
-                            XGetPixel(source, sx, srep->pheight_ - 1 - sy)
-                        );
-                    }
-                    tx1 = tx1 + delta_x;
-                    ty1 = ty1 + delta_y;
-                }
-            }
-
             XPutImage(dpy, map, xgc, dest, 0, 0, 0, 0, width, height);
             XFreeGC(dpy, xgc);
-            XDestroyImage(source);
             XDestroyImage(dest);
 
 	    rep->display_ = d;
@@ -803,7 +1306,7 @@ static BitmapRep* tx_bitmap(const Bitmap* b, const Transformer& tx) {
             rep->right_ = xmax;
             rep->bottom_ = ymin;
             rep->top_ = ymax;
-            _tx_bitmaps->insert(b, key, rep);
+            tx_insert(b, key, rep, nil, ((width + 7) >> 3) * height);
         }
         return rep;
     }
@@ -831,53 +1334,66 @@ void Canvas::stencil(
     int pleft = disp->to_pixels(tx + info->left_);
     int ptop = c.pheight_ - disp->to_pixels(ty + info->top_);
 
-    XGCValues gcv;
-    unsigned long valuemask = 0;
-
-    valuemask |= GCFunction;
-    gcv.function = GXand;
-    valuemask |= GCForeground;
-    gcv.foreground = 0;
-    valuemask |= GCBackground;
-    gcv.background = AllPlanes;
-    valuemask |= GCGraphicsExposures;
-    gcv.graphics_exposures = False;
-
-    GC xgc = XCreateGC(dpy, d, valuemask, &gcv);
-    XCopyGC(dpy, c.drawgc_, GCClipMask, xgc);
+    unsigned long pixel = color->rep(c.window_->rep()->visual_)->xcolor_.pixel;
+    if (c.stencilgc_ == nil) {
+	XGCValues gcv;
+	unsigned long valuemask = 0;
+
+	valuemask |= GCFunction;
+	gcv.function = GXand;
+	valuemask |= GCForeground;
+	gcv.foreground = 0;
+	valuemask |= GCBackground;
+	gcv.background = AllPlanes;
+	valuemask |= GCGraphicsExposures;
+	gcv.graphics_exposures = False;
+	c.stencilgc_ = XCreateGC(dpy, d, valuemask, &gcv);
+
+	gcv.function = GXxor;
+	gcv.foreground = pixel;
+	gcv.background = 0;
+	c.xorgc_ = XCreateGC(dpy, d, valuemask, &gcv);
+	c.xor_pixel_ = pixel;
+	c.stencil_clip_ = false;
+    }
+    if (!c.stencil_clip_) {
+	XCopyGC(dpy, c.drawgc_, GCClipMask, c.stencilgc_);
+	XCopyGC(dpy, c.drawgc_, GCClipMask, c.xorgc_);
+	c.stencil_clip_ = true;
+    }
+    if (pixel != c.xor_pixel_) {
+	XSetForeground(dpy, c.xorgc_, pixel);
+	c.xor_pixel_ = pixel;
+    }
 
     XCopyPlane(
-	dpy, info->pixmap_, d, xgc,
+	dpy, info->pixmap_, d, c.stencilgc_,
 	0, 0, info->pwidth_, info->pheight_, pleft, ptop, 1
     );
-
-    gcv.function = GXxor;
-    gcv.foreground = color->rep(c.window_->rep()->visual_)->xcolor_.pixel;
-    gcv.background = 0;
-    valuemask &= ~GCGraphicsExposures;
-    XChangeGC(dpy, xgc, valuemask, &gcv);
     XCopyPlane(
-	dpy, info->pixmap_, d, xgc,
+	dpy, info->pixmap_, d, c.xorgc_,
 	0, 0, info->pwidth_, info->pheight_, pleft, ptop, 1
     );
-    XFreeGC(dpy, xgc);
 }
 
-declareTable2(TxRasterTable,const Raster*,int,RasterRep*)
-implementTable2(TxRasterTable,const Raster*,int,RasterRep*)
+/*
+ * Approximate server storage for a pixel of the given depth.
+ */
 
-static TxRasterTable* _tx_rasters;
+static unsigned long tx_pixel_bytes(unsigned int depth) {
+    return depth <= 8 ? 1 : depth <= 16 ? 2 : 4;
+}
 
 static RasterRep* tx_raster(const Raster* r, const Transformer& tx) {
     int key = tx_key(tx, r->width(), r->height());
     if (key == 0) {
         return r->rep();
     } else {
-	if (_tx_rasters == nil) {
-	    _tx_rasters = new TxRasterTable(1024);
-	}
         RasterRep* rep;
-        if (!_tx_rasters->find(rep, r, key)) {
+        TxImage* t = tx_find(r, key);
+        if (t != nil) {
+            rep = t->raster_;
+        } else {
 	    Display* d = r->rep()->display_;
 	    DisplayRep& dr = *d->rep();
             rep = new RasterRep;
@@ -912,56 +1428,42 @@ static RasterRep* tx_raster(const Raster* r, const Transformer& tx) {
 
             XDisplay* dpy = dr.display_;
             RasterRep* srep = r->rep();
+            WindowVisual* wv = dr.default_visual_;
 
-            XImage* source = XGetImage(
-                dpy, srep->pixmap_,
-                0, 0, srep->pwidth_, srep->pheight_, AllPlanes, ZPixmap
+            XImage* source = srep->image_;
+            if (source == nil) {
+                source = XGetImage(
+                    dpy, srep->pixmap_,
+                    0, 0, srep->pwidth_, srep->pheight_, AllPlanes, ZPixmap
+                );
+            }
+            XImage* dest = tx_image(
+                dpy, wv->visual(), wv->depth(), width, height
             );
+            TxResample job;
+            job.source_ = source;
+            job.dest_ = dest;
+            job.tx_ = &v;
+            job.sx0_ = d->to_pixels(r->left_bearing());
+            job.sy0_ = d->to_pixels(r->descent());
+            job.dx0_ = d->to_pixels(-xmin);
+            job.dy0_ = d->to_pixels(-ymin);
+            job.smooth_ = tx_smooth(wv, dest);
+            tx_resample_rows(job, 0, height);
 
             Pixmap map = XCreatePixmap(
-                dpy, dr.root_, width, height, dr.default_visual_->depth()
+                dpy, dr.root_, width, height, wv->depth()
             );
             GC xgc = XCreateGC(dpy, map, 0, nil);
-            XSetForeground(dpy, xgc, 0);
-            XFillRectangle(dpy, map, xgc, 0, 0, width, height);
-            XImage* dest = XGetImage(
-                dpy, map, 0, 0, width, height, AllPlanes, ZPixmap
-            );
-
-            int dx0 = d->to_pixels(-xmin);
-            int dy0 = d->to_pixels(-ymin);
-            int sx0 = d->to_pixels(r->left_bearing());
-            int sy0 = d->to_pixels(r->descent());
-            for (int dy = 0; dy < height; ++dy) {
-                Coord tx1, ty1, tx2, ty2;
-                v.inverse_transform(- dx0, dy - dy0, tx1, ty1);
-                v.inverse_transform(width - dx0, dy - dy0, tx2, ty2);
-                float delta_x = (tx2 - tx1) / width;
-                float delta_y = (ty2 - ty1) / width;
-                int sx, sy;
-                for (int dx = 0; dx < width; ++dx) {
-                    sx = int(tx1) + sx0;
-                    sy = int(ty1) + sy0;
-                    if (
-                        sx >= 0 && sx < srep->pwidth_ &&
-                        sy >= 0 && sy < srep->pheight_
-                    ) {
-                        XPutPixel(
-                            dest, dx, height - 1 - dy,
-                            XGetPixel(source, sx, srep->pheight_ - 1 - sy)
-                        );
-                    }
-                    tx1 = tx1 + delta_x;
-                    ty1 = ty1 + delta_y;
-                }
-            }
-
             XPutImage(dpy, map, xgc, dest, 0, 0, 0, 0, width, height);
             XFreeGC(dpy, xgc);
-            XDestroyImage(source);
+            if (source != srep->image_) {
+                XDestroyImage(source);
+            }
             XDestroyImage(dest);
 
 	    rep->display_ = d;
+            rep->modified_ = false;
             rep->pixmap_ = map;
             rep->pwidth_ = width;
             rep->pheight_ = height;
@@ -971,7 +1473,18 @@ static RasterRep* tx_raster(const Raster* r, const Transformer& tx) {
             rep->right_ = xmax;
             rep->bottom_ = ymin;
             rep->top_ = ymax;
-            _tx_rasters->insert(r, key, rep);
+            /* only the pixmap is kept; nothing ever draws into it */
+            rep->image_ = nil;
+            rep->gc_ = nil;
+            rep->damage_left_ = 0;
+            rep->damage_top_ = 0;
+            rep->damage_right_ = 0;
+            rep->damage_bottom_ = 0;
+            rep->shm_ = nil;
+            tx_insert(
+                r, key, nil, rep,
+                tx_pixel_bytes(wv->depth()) * width * height
+            );
         }
         return rep;
     }
@@ -1022,18 +1535,7 @@ void Canvas::damage(const Extension& ext) {
 
 void Canvas::damage(Coord left, Coord bottom, Coord right, Coord top) {
     CanvasRep& c = *rep();
-    CanvasDamage& damage = c.damage_;
-    if (c.damaged_) {
-	damage.left = Math::min(damage.left, left);
-	damage.bottom = Math::min(damage.bottom, bottom);
-	damage.right = Math::max(damage.right, right);
-	damage.top = Math::max(damage.top, top);
-    } else {
-	damage.left = left;
-	damage.bottom = bottom;
-	damage.right = right;
-	damage.top = top;
-    }
+    c.add_damage(left, bottom, right, top);
     c.new_damage();
 }
 
@@ -1046,11 +1548,22 @@ boolean Canvas::damaged(
 ) const {
     CanvasRep& c = *rep();
     CanvasDamage& damage = c.damage_;
-    return (
-	c.damaged_ &&
-	left < damage.right && right > damage.left &&
-	bottom < damage.top && top > damage.bottom
-    );
+    if (
+	!c.damaged_ ||
+	left >= damage.right || right <= damage.left ||
+	bottom >= damage.top || top <= damage.bottom
+    ) {
+	return false;
+    }
+    for (int i = 0; i < c.damage_count_; i++) {
+	CanvasDamage& d = c.damage_list_[i];
+	if (
+	    left < d.right && right > d.left && bottom < d.top && top > d.bottom
+	) {
+	    return true;
+	}
+    }
+    return false;
 }
 
 void Canvas::damage_area(Extension& ext) {
@@ -1061,11 +1574,8 @@ void Canvas::damage_area(Extension& ext) {
 
 void Canvas::damage_all() {
     CanvasRep& c = *rep();
-    CanvasDamage& damage = c.damage_;
-    damage.left = 0;
-    damage.bottom = 0;
-    damage.right = c.width_;
-    damage.top = c.height_;
+    c.damaged_ = false;
+    c.add_damage(0, 0, c.width_, c.height_);
     c.new_damage();
 }
 
@@ -1167,6 +1677,12 @@ void CanvasRep::unbind() {
 	    XFreeGC(dpy, c.drawgc_);
 	    c.drawgc_ = nil;
 	}
+	if (c.stencilgc_ != nil) {
+	    XFreeGC(dpy, c.stencilgc_);
+	    XFreeGC(dpy, c.xorgc_);
+	    c.stencilgc_ = nil;
+	    c.xorgc_ = nil;
+	}
     }
     c.drawbuffer_ = CanvasRep::unbound;
     Resource::unref(c.brush_);
@@ -1188,29 +1704,110 @@ static inline void restrict(int& c, int a, int b) {
     }
 }
 
-boolean CanvasRep::start_repair() {
-    CanvasRep& c = *this;
-    if (!c.damaged_) {
-	return false;
-    }
-
-    XRectangle& clip = c.clip_;
-    CanvasDamage& damage = c.damage_;
+static void pixel_rect(
+    const CanvasRep& c, const CanvasDamage& damage, XRectangle& clip
+) {
     Display& d = *c.display_;
     int d_left = d.to_pixels(damage.left);
     int d_bottom = d.to_pixels(damage.bottom);
     int d_right = d.to_pixels(damage.right);
     int d_top = d.to_pixels(damage.top);
-    restrict(d_left, 0, pwidth_);
-    restrict(d_bottom, 0, pheight_);
-    restrict(d_right, 0, pwidth_);
-    restrict(d_top, 0, pheight_);
+    restrict(d_left, 0, c.pwidth_);
+    restrict(d_bottom, 0, c.pheight_);
+    restrict(d_right, 0, c.pwidth_);
+    restrict(d_top, 0, c.pheight_);
     clip.x = d_left;
     clip.y = c.pheight_ - d_top;
     clip.width = d_right - d_left;
     clip.height = d_top - d_bottom;
-    XUnionRectWithRegion(&clip, c.empty_, c.clipping_);
-    XSetClipRectangles(dpy(), c.drawgc_, 0, 0, &clip, 1, YXBanded);
+}
+
+/*
+ * The number of pixels covered by a few possibly overlapping
+ * rectangles: split the bounds into cells along every rectangle edge
+ * and count the cells some rectangle contains.
+ */
+
+static void add_edge(int* edges, int& n, int e) {
+    int i = 0;
+    while (i < n && edges[i] < e) {
+	++i;
+    }
+    if (i < n && edges[i] == e) {
+	return;
+    }
+    for (int j = n; j > i; --j) {
+	edges[j] = edges[j - 1];
+    }
+    edges[i] = e;
+    ++n;
+}
+
+static unsigned long covered_pixels(const XRectangle* r, int count) {
+    int xs[2 * CanvasRep::max_damage];
+    int ys[2 * CanvasRep::max_damage];
+    int nx = 0, ny = 0;
+    for (int i = 0; i < count; i++) {
+	add_edge(xs, nx, r[i].x);
+	add_edge(xs, nx, r[i].x + r[i].width);
+	add_edge(ys, ny, r[i].y);
+	add_edge(ys, ny, r[i].y + r[i].height);
+    }
+    unsigned long total = 0;
+    for (int yi = 0; yi + 1 < ny; yi++) {
+	for (int xi = 0; xi + 1 < nx; xi++) {
+	    for (int k = 0; k < count; k++) {
+		if (xs[xi] >= r[k].x && xs[xi + 1] <= r[k].x + r[k].width &&
+		    ys[yi] >= r[k].y && ys[yi + 1] <= r[k].y + r[k].height
+		) {
+		    total += (xs[xi + 1] - xs[xi]) * (ys[yi + 1] - ys[yi]);
+		    break;
+		}
+	    }
+	}
+    }
+    return total;
+}
+
+/*
+ * Clip to the union of the damaged rectangles, noting the area redrawn
+ * and the area requested (in pixels) for this repair.  The rectangles
+ * may overlap, so the clip goes to the server as a region, whose
+ * rectangles are disjoint.
+ */
+
+boolean CanvasRep::start_repair() {
+    CanvasRep& c = *this;
+    if (!c.damaged_) {
+	return false;
+    }
+
+    pixel_rect(c, c.damage_, c.clip_);
+    XRectangle clip_list[max_damage];
+    int clip_count = 0;
+    for (int i = 0; i < c.damage_count_; i++) {
+	XRectangle& clip = clip_list[clip_count];
+	pixel_rect(c, c.damage_list_[i], clip);
+	if (clip.width != 0 && clip.height != 0) {
+	    clip_count += 1;
+	}
+    }
+    if (clip_count == 0) {
+	clip_list[0] = c.clip_;
+	clip_count = 1;
+    }
+    XUnionRectWithRegion(&clip_list[0], c.empty_, c.clipping_);
+    for (int j = 1; j < clip_count; j++) {
+	XUnionRectWithRegion(&clip_list[j], c.clipping_, c.clipping_);
+    }
+    XSetRegion(dpy(), c.drawgc_, c.clipping_);
+    c.stencil_clip_ = false;
+    c.redrawn_pixels_ = covered_pixels(clip_list, clip_count);
+    if (c.width_ > 0 && c.height_ > 0) {
+	c.damaged_pixels_ = (unsigned long)(
+	    c.damage_area_ * (c.pwidth_ / c.width_) * (c.pheight_ / c.height_)
+	);
+    }
     c.repairing_ = true;
     return true;
 }
@@ -1222,57 +1819,94 @@ void CanvasRep::finish_repair() {
     c.damaged_ = false;
     c.on_damage_list_ = false;
     c.repairing_ = false;
+    c.damage_count_ = 0;
+    c.damage_area_ = 0;
 }
 
+/*
+ * Draw the buffered text.  A run of items becomes one XDrawText,
+ * each item's delta taking it from where the previous one ended
+ * (by the font's metrics) to where it was placed.
+ */
+
 void CanvasRep::flush() {
+    BatchRenderInfo* b = &CanvasRep::batch_;
+    if (b->count_ != 0) {
+	CanvasRep& c = *b->canvas_;
+	XDisplay* dpy = c.dpy();
+	XDrawable d = c.drawbuffer_;
+	GC gc = c.drawgc_;
+	switch (b->kind_) {
+	case batch_segments:
+	    XDrawSegments(dpy, d, gc, b->segments_, b->count_);
+	    break;
+	case batch_rectangles:
+	    XDrawRectangles(dpy, d, gc, b->rects_, b->count_);
+	    break;
+	case batch_fills:
+	    XFillRectangles(dpy, d, gc, b->rects_, b->count_);
+	    break;
+	}
+	b->count_ = 0;
+    }
     TextRenderInfo* t = &CanvasRep::text_;
     if (t == nil) {
 	return;
     }
     unsigned int nchars = t->cur_text_ - t->text_;
     if (nchars != 0) {
-	CanvasRep& c = *this;
+	CanvasRep& c = *t->canvas_;
 	XDisplay* dpy = c.dpy();
-	XDrawable d = t->canvas_->drawbuffer_;
+	XDrawable d = c.drawbuffer_;
 	GC gc = t->drawgc_;
-        if (t->spaces_ == 0 || c.text_twobyte_) {
-            if (c.text_twobyte_) {
-                XDrawString16(
-                    dpy, d, gc, t->x0_, t->y0_, (XChar2b*)t->text_, nchars/2
-                );
-            } else {
-                XDrawString(dpy, d, gc, t->x0_, t->y0_, t->text_, nchars);
-            }
-        } else {
-            int width = XTextWidth(c.xfont_, t->text_, nchars);
-            int delta = c.display_->to_pixels(t->width_) - width;
-            int item = 0;
-            int count = 0;
-            t->items_[item].chars = t->text_;
-            t->items_[item].delta = 0;
-            t->items_[item].font = None;
-	    char* text_end = t->cur_text_;
-	    for (char* cp = t->text_; cp < text_end; cp++) {
-                if (*cp == ' ') {
-                    int d = delta / (t->spaces_ - item);
-                    delta -= d;
-                    t->items_[item].nchars = count;
-                    ++item;
-                    t->items_[item].chars = cp;
-                    t->items_[item].delta = d;
-                    t->items_[item].font = None;
-                    count = 0;
-                }
-                ++count;
-            }
-            t->items_[item].nchars = count;
-            XDrawText(
-                dpy, d, gc, t->x0_, t->y0_, t->items_, item + 1
-            );
-        }
+	if (c.text_twobyte_) {
+	    XDrawString16(
+		dpy, d, gc, t->x0_, t->y0_, (XChar2b*)t->text_, nchars/2
+	    );
+	} else if (t->item_count_ <= 1) {
+	    XDrawString(dpy, d, gc, t->x0_, t->y0_, t->text_, nchars);
+	} else {
+	    int x = t->x0_;
+	    for (int i = 0; i < t->item_count_; i++) {
+		XTextItem& item = t->items_[i];
+		char* end = (
+		    i + 1 < t->item_count_ ? t->items_[i + 1].chars : t->cur_text_
+		);
+		int start = item.delta;
+		item.nchars = end - item.chars;
+		item.delta = start - x;
+		x = start + XTextWidth(c.xfont_, item.chars, item.nchars);
+	    }
+	    XDrawText(dpy, d, gc, t->x0_, t->y0_, t->items_, t->item_count_);
+	}
         t->cur_text_ = t->text_;
-        t->spaces_ = 0;
     }
+    t->item_count_ = 0;
+}
+
+/*
+ * Set the color and brush for a line or rectangle of the given kind,
+ * drawing what was collected first unless it can join it.  Returns
+ * false outside a repair, when the caller should draw it right away.
+ */
+
+boolean CanvasRep::batch(int kind, const Color* c, const Brush* b) {
+    BatchRenderInfo* bi = &CanvasRep::batch_;
+    if (
+	bi->count_ == 0 || bi->canvas_ != this || bi->kind_ != kind ||
+	bi->count_ == batch_size ||
+	(c != nil && c != color_) || (b != nil && b != brush_)
+    ) {
+	flush();
+	color(c);
+	brush(b);
+	if (!repairing_) {
+	    return false;
+	}
+	bi->canvas_ = this;
+	bi->kind_ = kind;
+    }
+    return true;
 }
 
 void CanvasRep::swapbuffers() {
@@ -1281,11 +1915,18 @@ void CanvasRep::swapbuffers() {
 	/* not double-buffering */
 	return;
     }
+    /*
+     * Copy the repaired region in one request, clipped so that
+     * overlapping damage is copied once and undamaged pixels not at all.
+     */
+    XDisplay* dpy = c.dpy();
     XRectangle& clip = c.clip_;
+    XSetRegion(dpy, c.copygc_, c.clipping_);
     XCopyArea(
-	c.dpy(), c.drawbuffer_, c.copybuffer_, c.copygc_,
+	dpy, c.drawbuffer_, c.copybuffer_, c.copygc_,
 	clip.x, clip.y, clip.width, clip.height, clip.x, clip.y
     );
+    XSetClipMask(dpy, c.copygc_, None);
 }
 
 XDisplay* CanvasRep::dpy() const { return display_->rep()->display_; }
@@ -1394,6 +2035,65 @@ void CanvasRep::new_damage() {
 void CanvasRep::clear_damage() {
     damaged_ = false;
     on_damage_list_ = false;
+    damage_count_ = 0;
+    damage_area_ = 0;
+}
+
+static inline Coord area(const CanvasDamage& d) {
+    return (d.right - d.left) * (d.top - d.bottom);
+}
+
+static inline void extend(CanvasDamage& d, const CanvasDamage& e) {
+    d.left = Math::min(d.left, e.left);
+    d.bottom = Math::min(d.bottom, e.bottom);
+    d.right = Math::max(d.right, e.right);
+    d.top = Math::max(d.top, e.top);
+}
+
+/*
+ * Damage is kept as a short list of rectangles and their bounds.
+ * A new rectangle is merged with one whose bounds together cover
+ * no more than the two apart, which absorbs rectangles inside others,
+ * or, once the list is full, with the one it grows the least.
+ * A merged rectangle may now cover others, so it goes round again.
+ */
+
+void CanvasRep::add_damage(Coord left, Coord bottom, Coord right, Coord top) {
+    CanvasDamage r;
+    r.left = left;
+    r.bottom = bottom;
+    r.right = right;
+    r.top = top;
+    Coord w = Math::min(right, width_) - Math::max(left, Coord(0));
+    Coord h = Math::min(top, height_) - Math::max(bottom, Coord(0));
+    if (w > 0 && h > 0) {
+	damage_area_ += w * h;
+    }
+    if (!damaged_) {
+	damage_ = r;
+	damage_count_ = 0;
+    } else {
+	extend(damage_, r);
+    }
+    for (;;) {
+	int best = -1;
+	Coord best_growth = 0;
+	for (int i = 0; i < damage_count_; i++) {
+	    CanvasDamage merged = damage_list_[i];
+	    extend(merged, r);
+	    Coord growth = area(merged) - area(damage_list_[i]) - area(r);
+	    if (best < 0 || growth < best_growth) {
+		best = i;
+		best_growth = growth;
+	    }
+	}
+	if (best < 0 || (best_growth > 0 && damage_count_ < max_damage)) {
+	    break;
+	}
+	extend(r, damage_list_[best]);
+	damage_list_[best] = damage_list_[--damage_count_];
+    }
+    damage_list_[damage_count_++] = r;
 }
 
 /*
@@ -1402,6 +2102,7 @@ void CanvasRep::clear_damage() {
 
 TextRenderInfo CanvasRep::text_;
 PathRenderInfo CanvasRep::path_;
+BatchRenderInfo CanvasRep::batch_;
 
 /* Canvas anachronisms */
 unsigned int Canvas::Width() const { return pwidth(); }
@@ -140,10 +140,24 @@ boolean Color::distinguished(const Color* c) const {
     return distinguished(Session::instance()->default_display(), c);
 }
 
+/*
+ * With no display open (say, drawing on a MemoryCanvas) report the
+ * intensities the color was made with rather than those allocated.
+ */
+
 void Color::intensities(
     ColorIntensity& r, ColorIntensity& g, ColorIntensity& b
 ) const {
-    intensities(Session::instance()->default_display(), r, g, b);
+    Session* s = Session::instance();
+    Display* d = s == nil ? nil : s->default_display();
+    if (d == nil) {
+	ColorImpl* c = impl_;
+	r = c->red;
+	g = c->green;
+	b = c->blue;
+    } else {
+	intensities(d, r, g, b);
+    }
 }
 
 float Color::alpha() const {
@@ -34,9 +34,169 @@
 #include <InterViews/raster.h>
 #include <InterViews/session.h>
 #include <IV-X11/Xlib.h>
+#include <IV-X11/Xext.h>
 #include <IV-X11/Xutil.h>
+#include <IV-X11/xcanvas.h>
 #include <IV-X11/xdisplay.h>
 #include <IV-X11/xraster.h>
+#include <IV-X11/xwindow.h>
+
+#if defined(HAVE_X11_EXTENSIONS_XSHM_H) && defined(HAVE_SYS_SHM_H)
+#define IV_XSHM
+#include <sys/types.h>
+#ifdef HAVE_SYS_IPC_H
+#include <sys/ipc.h>
+#endif
+#include <sys/shm.h>
+#endif
+
+/*
+ * Large rasters keep their image in a MIT-SHM segment when the
+ * server supports it, so that a flush sends a request instead of
+ * copying the pixels through the connection.  The server reads the
+ * segment some time after XShmPutImage returns, so the first poke
+ * after a flush waits for it to catch up.  Rasters smaller than
+ * shm_threshold bytes, or on servers without the extension
+ * (such as a remote display or an Xvfb started without it),
+ * use an ordinary XImage.
+ */
+
+class RasterShm {
+public:
+#ifdef IV_XSHM
+    XShmSegmentInfo info_;
+#endif
+    boolean pending_;
+};
+
+#ifdef IV_XSHM
+
+static const unsigned long shm_threshold = 64 * 1024;
+
+static XDisplay* shm_display;
+static boolean shm_usable;
+static boolean shm_failed;
+
+static int shm_error(XDisplay*, XErrorEvent*) {
+    shm_failed = true;
+    return 0;
+}
+
+static boolean shm_available(XDisplay* dpy) {
+    if (dpy != shm_display) {
+	shm_display = dpy;
+	shm_usable = XShmQueryExtension(dpy);
+    }
+    return shm_usable;
+}
+
+static XImage* shm_image(
+    XDisplay* dpy, WindowVisual* wv, unsigned int w, unsigned int h,
+    RasterShm*& shm
+) {
+    shm = nil;
+    if (!shm_available(dpy)) {
+	return nil;
+    }
+    RasterShm* s = new RasterShm;
+    XImage* image = XShmCreateImage(
+	dpy, wv->visual(), wv->depth(), ZPixmap, nil, &s->info_, w, h
+    );
+    if (image == nil) {
+	delete s;
+	return nil;
+    }
+    unsigned long size = image->bytes_per_line * image->height;
+    if (size < shm_threshold) {
+	XDestroyImage(image);
+	delete s;
+	return nil;
+    }
+    s->info_.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (s->info_.shmid < 0) {
+	XDestroyImage(image);
+	delete s;
+	return nil;
+    }
+    s->info_.shmaddr = (char*)shmat(s->info_.shmid, 0, 0);
+    if (s->info_.shmaddr == (char*)-1) {
+	shmctl(s->info_.shmid, IPC_RMID, 0);
+	XDestroyImage(image);
+	delete s;
+	return nil;
+    }
+    image->data = s->info_.shmaddr;
+    s->info_.readOnly = False;
+
+    /*
+     * The extension may be present but unusable, as when the
+     * client and server are on different hosts.  Check once
+     * that the attach succeeded and give up on this display if not.
+     */
+    shm_failed = false;
+    int (*handler)(XDisplay*, XErrorEvent*) = XSetErrorHandler(shm_error);
+    XShmAttach(dpy, &s->info_);
+    XSync(dpy, False);
+    XSetErrorHandler(handler);
+    shmctl(s->info_.shmid, IPC_RMID, 0);
+    if (shm_failed) {
+	shm_usable = false;
+	shmdt(s->info_.shmaddr);
+	image->data = nil;
+	XDestroyImage(image);
+	delete s;
+	return nil;
+    }
+    s->pending_ = false;
+    shm = s;
+    return image;
+}
+
+static void shm_free(XDisplay* dpy, RasterShm* s) {
+    XShmDetach(dpy, &s->info_);
+    shmdt(s->info_.shmaddr);
+    delete s;
+}
+
+#endif
+
+static inline void raster_damage(
+    RasterRep* r, unsigned int x, unsigned int y,
+    unsigned int w, unsigned int h
+) {
+    if (!r->modified_) {
+	r->modified_ = true;
+	r->damage_left_ = x;
+	r->damage_top_ = y;
+	r->damage_right_ = x + w;
+	r->damage_bottom_ = y + h;
+    } else {
+	if (x < r->damage_left_) {
+	    r->damage_left_ = x;
+	}
+	if (y < r->damage_top_) {
+	    r->damage_top_ = y;
+	}
+	if (x + w > r->damage_right_) {
+	    r->damage_right_ = x + w;
+	}
+	if (y + h > r->damage_bottom_) {
+	    r->damage_bottom_ = y + h;
+	}
+    }
+}
+
+/*
+ * Wait for the server to finish reading a shared image before
+ * the client writes into it again.
+ */
+
+static inline void raster_modify(RasterRep* r) {
+    if (r->shm_ != nil && r->shm_->pending_) {
+	XSync(r->display_->rep()->display_, False);
+	r->shm_->pending_ = false;
+    }
+}
 
 Raster::Raster(unsigned long w, unsigned long h) {
     RasterRep* r = new RasterRep;
@@ -52,12 +212,23 @@ Raster::Raster(unsigned long w, unsigned long h) {
     r->bottom_ = 0;
     r->right_ = r->width_;
     r->top_ = r->height_;
+    r->shm_ = nil;
     DisplayRep* dr = r->display_->rep();
     XDisplay* dpy = dr->display_;
     r->pixmap_ = XCreatePixmap(
 	dpy, dr->root_, r->pwidth_, r->pheight_, dr->default_visual_->depth()
     );
     r->gc_ = XCreateGC(dpy, r->pixmap_, 0, nil);
+#ifdef IV_XSHM
+    r->image_ = shm_image(
+	dpy, dr->default_visual_, r->pwidth_, r->pheight_, r->shm_
+    );
+    if (r->image_ != nil) {
+	/* a new segment is zero-filled; send it with the first flush */
+	raster_damage(r, 0, 0, r->pwidth_, r->pheight_);
+	return;
+    }
+#endif
     r->image_ = XGetImage(
 	dpy, r->pixmap_, 0, 0, r->pwidth_, r->pheight_, AllPlanes, ZPixmap
     );
@@ -69,7 +240,7 @@ Raster::Raster(const Raster& raster) {
     raster.flush();
     RasterRep& rr = *(raster.rep());
     r->display_ = rr.display_;
-    r->modified_ = true;
+    r->modified_ = false;
     r->width_ = rr.width_;
     r->height_ = rr.height_;
     r->left_ = rr.left_;
@@ -78,6 +249,7 @@ Raster::Raster(const Raster& raster) {
     r->top_ = rr.top_;
     r->pwidth_ = rr.pwidth_;
     r->pheight_ = rr.pheight_;
+    r->shm_ = nil;
     DisplayRep* dr = r->display_->rep();
     XDisplay* dpy = dr->display_;
     r->pixmap_ = XCreatePixmap(
@@ -88,6 +260,15 @@ Raster::Raster(const Raster& raster) {
 	dpy, rr.pixmap_, r->pixmap_, r->gc_,
 	0, 0, r->pwidth_, r->pheight_, 0, 0
     );
+#ifdef IV_XSHM
+    r->image_ = shm_image(
+	dpy, dr->default_visual_, r->pwidth_, r->pheight_, r->shm_
+    );
+    if (r->image_ != nil) {
+	XShmGetImage(dpy, r->pixmap_, r->image_, 0, 0, AllPlanes);
+	return;
+    }
+#endif
     r->image_ = XGetImage(
 	dpy, r->pixmap_, 0, 0, r->pwidth_, r->pheight_, AllPlanes, ZPixmap
     );
@@ -96,10 +277,19 @@ Raster::Raster(const Raster& raster) {
 Raster::Raster(RasterRep* r) { rep_ = r; }
 
 Raster::~Raster() {
+    TxImageCache::purge(this);
     RasterRep* r = rep();
     XDisplay* dpy = r->display_->rep()->display_;
     XFreePixmap(dpy, r->pixmap_);
     XFreeGC(dpy, r->gc_);
+#ifdef IV_XSHM
+    if (r->shm_ != nil) {
+	XDestroyImage(r->image_);
+	shm_free(dpy, r->shm_);
+	delete r;
+	return;
+    }
+#endif
     XDestroyImage(r->image_);
     delete r;
 }
@@ -141,19 +331,279 @@ void Raster::poke(
     unsigned short sb = (unsigned short)(blue * 0xffff);
     XColor xc;
     r->display_->rep()->default_visual_->find_color(sr, sg, sb, xc);
-    XPutPixel(
-	r->image_, (unsigned int)x, r->pheight_ - (unsigned int)y - 1, xc.pixel
-    );
-    r->modified_ = true;
+    unsigned int px = (unsigned int)x;
+    unsigned int py = r->pheight_ - (unsigned int)y - 1;
+    raster_modify(r);
+    XPutPixel(r->image_, px, py, xc.pixel);
+    raster_damage(r, px, py, 1, 1);
+}
+
+/*
+ * Conversion between 8-bit samples and pixels of a visual, used by
+ * peek_pixels and poke_pixels.  On a TrueColor visual a pixel is
+ * the sum of a table entry for each sample.  Otherwise the pixels
+ * found for recent colors are remembered, since loading an image
+ * typically repeats a small number of colors many times.
+ */
+
+static const int pixel_cache_size = 4096;
+
+struct RasterPixelMap {
+    WindowVisual* visual_;
+    boolean direct_;
+    unsigned long red_[256];
+    unsigned long green_[256];
+    unsigned long blue_[256];
+    unsigned long mask_[3];
+    int shift_[3];
+    unsigned long max_[3];
+    unsigned long rgb_[pixel_cache_size];
+    unsigned long pixel_[pixel_cache_size];
+    boolean cached_[pixel_cache_size];
+    unsigned long last_pixel_;
+    XColor last_color_;
+    boolean have_last_;
+};
+
+static RasterPixelMap* pixel_map;
+
+static void pixel_channel(
+    unsigned long mask, unsigned long& m, int& shift, unsigned long& max
+) {
+    m = mask;
+    shift = 0;
+    if (mask != 0) {
+	while ((mask & 1) == 0) {
+	    mask >>= 1;
+	    ++shift;
+	}
+    }
+    max = mask;
+}
+
+static RasterPixelMap* find_pixel_map(WindowVisual* wv) {
+    RasterPixelMap* m = pixel_map;
+    if (m == nil) {
+	m = new RasterPixelMap;
+	m->visual_ = nil;
+	pixel_map = m;
+    }
+    if (m->visual_ != wv) {
+	m->visual_ = wv;
+	Visual* v = wv->visual();
+	m->direct_ = v->c_class == TrueColor;
+	m->have_last_ = false;
+	for (int c = 0; c < pixel_cache_size; c++) {
+	    m->cached_[c] = false;
+	}
+	if (m->direct_) {
+	    pixel_channel(v->red_mask, m->mask_[0], m->shift_[0], m->max_[0]);
+	    pixel_channel(
+		v->green_mask, m->mask_[1], m->shift_[1], m->max_[1]
+	    );
+	    pixel_channel(v->blue_mask, m->mask_[2], m->shift_[2], m->max_[2]);
+	    XColor xc;
+	    for (int i = 0; i < 256; i++) {
+		unsigned short s = (unsigned short)(i * 0x101);
+		wv->find_color(s, 0, 0, xc);
+		m->red_[i] = xc.pixel & v->red_mask;
+		wv->find_color(0, s, 0, xc);
+		m->green_[i] = xc.pixel & v->green_mask;
+		wv->find_color(0, 0, s, xc);
+		m->blue_[i] = xc.pixel & v->blue_mask;
+	    }
+	}
+    }
+    return m;
+}
+
+static inline unsigned long rgb_to_pixel(
+    RasterPixelMap* m, unsigned int r, unsigned int g, unsigned int b
+) {
+    if (m->direct_) {
+	return m->red_[r] | m->green_[g] | m->blue_[b];
+    }
+    unsigned long rgb = (r << 16) | (g << 8) | b;
+    int c = int((rgb ^ (rgb >> 12)) & (pixel_cache_size - 1));
+    if (!m->cached_[c] || m->rgb_[c] != rgb) {
+	XColor xc;
+	m->visual_->find_color(
+	    (unsigned short)(r * 0x101), (unsigned short)(g * 0x101),
+	    (unsigned short)(b * 0x101), xc
+	);
+	m->rgb_[c] = rgb;
+	m->pixel_[c] = xc.pixel;
+	m->cached_[c] = true;
+    }
+    return m->pixel_[c];
+}
+
+static inline unsigned int pixel_sample(
+    unsigned long pixel, unsigned long mask, int shift, unsigned long max
+) {
+    if (max == 0) {
+	return 0;
+    }
+    return (unsigned int)((((pixel & mask) >> shift) * 255 + max / 2) / max);
+}
+
+static inline void pixel_to_rgb(
+    RasterPixelMap* m, unsigned long pixel,
+    unsigned int& r, unsigned int& g, unsigned int& b
+) {
+    if (m->direct_) {
+	r = pixel_sample(pixel, m->mask_[0], m->shift_[0], m->max_[0]);
+	g = pixel_sample(pixel, m->mask_[1], m->shift_[1], m->max_[1]);
+	b = pixel_sample(pixel, m->mask_[2], m->shift_[2], m->max_[2]);
+    } else {
+	if (!m->have_last_ || m->last_pixel_ != pixel) {
+	    m->visual_->find_color(pixel, m->last_color_);
+	    m->last_pixel_ = pixel;
+	    m->have_last_ = true;
+	}
+	r = m->last_color_.red >> 8;
+	g = m->last_color_.green >> 8;
+	b = m->last_color_.blue >> 8;
+    }
+}
+
+static inline boolean host_msb_first() {
+    unsigned int one = 1;
+    return *(unsigned char*)&one == 0;
+}
+
+void Raster::peek_pixels(
+    unsigned long x, unsigned long y, unsigned long w, unsigned long h,
+    unsigned char* pixels, PixelFormat format, long stride
+) const {
+    RasterRep* r = rep();
+    RasterPixelMap* m = find_pixel_map(r->display_->rep()->default_visual_);
+    XImage* image = r->image_;
+    int bytes = int(format);
+    if (stride == 0) {
+	stride = long(w) * bytes;
+    }
+    int bpp = image->bits_per_pixel;
+    if (
+	bpp != 8 &&
+	(image->byte_order == MSBFirst) != host_msb_first()
+    ) {
+	bpp = 0;
+    }
+    unsigned int top = r->pheight_ - (unsigned int)(y + h);
+    for (unsigned long row = 0; row < h; ++row) {
+	unsigned char* p = pixels + row * stride;
+	unsigned int iy = top + (unsigned int)row;
+	const char* line = image->data + iy * image->bytes_per_line;
+	for (unsigned long col = 0; col < w; ++col) {
+	    unsigned int ix = (unsigned int)(x + col);
+	    unsigned long pixel;
+	    switch (bpp) {
+	    case 32:
+		pixel = ((const unsigned int*)line)[ix];
+		break;
+	    case 16:
+		pixel = ((const unsigned short*)line)[ix];
+		break;
+	    case 8:
+		pixel = ((const unsigned char*)line)[ix];
+		break;
+	    default:
+		pixel = XGetPixel(image, ix, iy);
+		break;
+	    }
+	    unsigned int red, green, blue;
+	    pixel_to_rgb(m, pixel, red, green, blue);
+	    if (format == gray8) {
+		p[0] = (unsigned char)((77 * red + 151 * green + 28 * blue) >> 8);
+	    } else {
+		p[0] = (unsigned char)red;
+		p[1] = (unsigned char)green;
+		p[2] = (unsigned char)blue;
+		if (format == rgba8) {
+		    p[3] = 0xff;
+		}
+	    }
+	    p += bytes;
+	}
+    }
+}
+
+void Raster::poke_pixels(
+    unsigned long x, unsigned long y, unsigned long w, unsigned long h,
+    const unsigned char* pixels, PixelFormat format, long stride
+) {
+    if (w == 0 || h == 0) {
+	return;
+    }
+    RasterRep* r = rep();
+    RasterPixelMap* m = find_pixel_map(r->display_->rep()->default_visual_);
+    XImage* image = r->image_;
+    int bytes = int(format);
+    if (stride == 0) {
+	stride = long(w) * bytes;
+    }
+    int bpp = image->bits_per_pixel;
+    if (
+	bpp != 8 &&
+	(image->byte_order == MSBFirst) != host_msb_first()
+    ) {
+	bpp = 0;
+    }
+    raster_modify(r);
+    unsigned int top = r->pheight_ - (unsigned int)(y + h);
+    for (unsigned long row = 0; row < h; ++row) {
+	const unsigned char* p = pixels + row * stride;
+	unsigned int iy = top + (unsigned int)row;
+	char* line = image->data + iy * image->bytes_per_line;
+	for (unsigned long col = 0; col < w; ++col) {
+	    unsigned int ix = (unsigned int)(x + col);
+	    unsigned long pixel;
+	    if (format == gray8) {
+		pixel = rgb_to_pixel(m, p[0], p[0], p[0]);
+	    } else {
+		pixel = rgb_to_pixel(m, p[0], p[1], p[2]);
+	    }
+	    switch (bpp) {
+	    case 32:
+		((unsigned int*)line)[ix] = (unsigned int)pixel;
+		break;
+	    case 16:
+		((unsigned short*)line)[ix] = (unsigned short)pixel;
+		break;
+	    case 8:
+		((unsigned char*)line)[ix] = (unsigned char)pixel;
+		break;
+	    default:
+		XPutPixel(image, ix, iy, pixel);
+		break;
+	    }
+	    p += bytes;
+	}
+    }
+    raster_damage(r, (unsigned int)x, top, (unsigned int)w, (unsigned int)h);
 }
 
 void Raster::flush() const {
     RasterRep* r = rep();
     if (r->modified_) {
-	XPutImage(
-	    r->display_->rep()->display_, r->pixmap_, r->gc_, r->image_,
-	    0, 0, 0, 0, r->pwidth_, r->pheight_
-	);
+	TxImageCache::purge(this);
+	XDisplay* dpy = r->display_->rep()->display_;
+	int x = r->damage_left_;
+	int y = r->damage_top_;
+	unsigned int w = r->damage_right_ - r->damage_left_;
+	unsigned int h = r->damage_bottom_ - r->damage_top_;
+#ifdef IV_XSHM
+	if (r->shm_ != nil) {
+	    XShmPutImage(
+		dpy, r->pixmap_, r->gc_, r->image_, x, y, x, y, w, h, False
+	    );
+	    r->shm_->pending_ = true;
+	    r->modified_ = false;
+	    return;
+	}
+#endif
+	XPutImage(dpy, r->pixmap_, r->gc_, r->image_, x, y, x, y, w, h);
 	r->modified_ = false;
     }
 }
@@ -0,0 +1,865 @@
+#ifdef HAVE_CONFIG_H
+#include <../../config.h>
+#endif
+/*
+ * MemoryCanvas - scan convert into an array of pixels
+ */
+
+#include <InterViews/bitmap.h>
+#include <InterViews/brush.h>
+#include <InterViews/color.h>
+#include <InterViews/font.h>
+#include <InterViews/geometry.h>
+#include <InterViews/memcanvas.h>
+#include <InterViews/raster.h>
+#include <InterViews/session.h>
+#include <InterViews/transformer.h>
+#include <OS/list.h>
+#include <OS/math.h>
+#include <OS/memory.h>
+#include <math.h>
+#include <stdlib.h>
+
+/*
+ * Path points are kept in pixels, with y growing down and pixel
+ * (i, j) covering [i, i+1) x [j, j+1).  A pixel is inside a shape
+ * when its center is.
+ */
+
+class MemoryPoint {
+public:
+    float x_;
+    float y_;
+};
+
+/*
+ * The clip is a rectangle of pixels, right and bottom exclusive,
+ * narrowed by a mask of one byte per pixel once a clip path has
+ * not been a rectangle.
+ */
+
+class MemoryClip {
+public:
+    int left_;
+    int top_;
+    int right_;
+    int bottom_;
+    unsigned char* mask_;
+};
+
+declareList(MemoryClipList,MemoryClip)
+implementList(MemoryClipList,MemoryClip)
+
+class MemoryCanvasRep {
+public:
+    unsigned int* pixels_;
+    PixelCoord pwidth_;
+    PixelCoord pheight_;
+    float scale_;
+
+    MemoryPoint* point_;
+    int count_;
+    int size_;
+    Coord curx_;
+    Coord cury_;
+
+    MemoryClip clip_;
+    MemoryClipList* clippers_;
+
+    /* how the next spans are painted */
+    unsigned int pixel_;
+    int alpha_;
+    ColorOp op_;
+
+    void allocate(PixelCoord width, PixelCoord height);
+    void device(const Canvas*, Coord x, Coord y, MemoryPoint&) const;
+    void user(const Canvas*, int i, int j, Coord& x, Coord& y) const;
+    MemoryPoint& next_point();
+    void flatten(
+	const MemoryPoint&, const MemoryPoint&,
+	const MemoryPoint&, const MemoryPoint&, int depth
+    );
+    boolean rectangle(
+	const MemoryPoint*, int n, int& l, int& t, int& r, int& b
+    ) const;
+    boolean paint(const Color*);
+    void run(unsigned int*, int n);
+    void span(int y, int x0, int x1);
+    void polygon(const MemoryPoint*, int n, unsigned char* mask);
+    void segment(const MemoryPoint&, const MemoryPoint&, float width);
+    void bounds(
+	const Canvas*, Coord l, Coord b, Coord r, Coord t,
+	int& x0, int& y0, int& x1, int& y1
+    ) const;
+};
+
+static inline int pixel_edge(float x) { return int(ceil(x - 0.5)); }
+
+static inline unsigned int rgb(
+    ColorIntensity r, ColorIntensity g, ColorIntensity b
+) {
+    return (
+	0xff000000 |
+	(((unsigned int)(r * 255 + 0.5) & 0xff) << 16) |
+	(((unsigned int)(g * 255 + 0.5) & 0xff) << 8) |
+	((unsigned int)(b * 255 + 0.5) & 0xff)
+    );
+}
+
+/*
+ * The span loops are kept simple enough for the compiler to
+ * vectorize; the blend works on red and blue together, then green.
+ */
+
+static void copy_span(unsigned int* p, int n, unsigned int pixel) {
+    for (int i = 0; i < n; i++) {
+	p[i] = pixel;
+    }
+}
+
+static void xor_span(unsigned int* p, int n, unsigned int pixel) {
+    pixel &= 0x00ffffff;
+    for (int i = 0; i < n; i++) {
+	p[i] ^= pixel;
+    }
+}
+
+static void blend_span(unsigned int* p, int n, unsigned int pixel, int a) {
+    unsigned int rb = (pixel & 0xff00ff) * a;
+    unsigned int g = (pixel & 0x00ff00) * a;
+    unsigned int na = 256 - a;
+    for (int i = 0; i < n; i++) {
+	unsigned int d = p[i];
+	p[i] = 0xff000000 |
+	    (((rb + (d & 0xff00ff) * na) >> 8) & 0xff00ff) |
+	    (((g + (d & 0x00ff00) * na) >> 8) & 0x00ff00);
+    }
+}
+
+void MemoryCanvasRep::allocate(PixelCoord width, PixelCoord height) {
+    delete [] pixels_;
+    delete [] clip_.mask_;
+    pwidth_ = Math::max(width, 0);
+    pheight_ = Math::max(height, 0);
+    pixels_ = new unsigned int[pwidth_ * pheight_];
+    copy_span(pixels_, pwidth_ * pheight_, 0xffffffff);
+    clip_.left_ = 0;
+    clip_.top_ = 0;
+    clip_.right_ = pwidth_;
+    clip_.bottom_ = pheight_;
+    clip_.mask_ = nil;
+}
+
+void MemoryCanvasRep::device(
+    const Canvas* c, Coord x, Coord y, MemoryPoint& p
+) const {
+    const Transformer& t = c->transformer();
+    Coord tx, ty;
+    if (t.identity()) {
+	tx = x;
+	ty = y;
+    } else {
+	t.transform(x, y, tx, ty);
+    }
+    p.x_ = tx * scale_;
+    p.y_ = pheight_ - ty * scale_;
+}
+
+void MemoryCanvasRep::user(
+    const Canvas* c, int i, int j, Coord& x, Coord& y
+) const {
+    x = (i + 0.5) / scale_;
+    y = (pheight_ - j - 0.5) / scale_;
+    const Transformer& t = c->transformer();
+    if (!t.identity()) {
+	t.inverse_transform(x, y);
+    }
+}
+
+MemoryPoint& MemoryCanvasRep::next_point() {
+    if (count_ == size_) {
+	int new_size = 2 * size_;
+	MemoryPoint* new_point = new MemoryPoint[new_size];
+	Memory::copy(point_, new_point, count_ * sizeof(MemoryPoint));
+	delete [] point_;
+	point_ = new_point;
+	size_ = new_size;
+    }
+    return point_[count_++];
+}
+
+/*
+ * Subdivide a Bezier curve, already in pixels, until its second
+ * differences are under half a pixel.
+ */
+
+void MemoryCanvasRep::flatten(
+    const MemoryPoint& p0, const MemoryPoint& p1,
+    const MemoryPoint& p2, const MemoryPoint& p3, int depth
+) {
+    float d = (
+	Math::abs(p0.x_ - 2 * p1.x_ + p2.x_) +
+	Math::abs(p0.y_ - 2 * p1.y_ + p2.y_) +
+	Math::abs(p1.x_ - 2 * p2.x_ + p3.x_) +
+	Math::abs(p1.y_ - 2 * p2.y_ + p3.y_)
+    );
+    if (depth == 0 || !(d > 0.5)) {
+	next_point() = p3;
+    } else {
+	MemoryPoint p01, p12, p23, p012, p123, p0123;
+	p01.x_ = (p0.x_ + p1.x_) / 2;
+	p01.y_ = (p0.y_ + p1.y_) / 2;
+	p12.x_ = (p1.x_ + p2.x_) / 2;
+	p12.y_ = (p1.y_ + p2.y_) / 2;
+	p23.x_ = (p2.x_ + p3.x_) / 2;
+	p23.y_ = (p2.y_ + p3.y_) / 2;
+	p012.x_ = (p01.x_ + p12.x_) / 2;
+	p012.y_ = (p01.y_ + p12.y_) / 2;
+	p123.x_ = (p12.x_ + p23.x_) / 2;
+	p123.y_ = (p12.y_ + p23.y_) / 2;
+	p0123.x_ = (p012.x_ + p123.x_) / 2;
+	p0123.y_ = (p012.y_ + p123.y_) / 2;
+	flatten(p0, p01, p012, p0123, depth - 1);
+	flatten(p0123, p123, p23, p3, depth - 1);
+    }
+}
+
+/*
+ * Return whether a closed path is an upright rectangle, and which
+ * pixels it covers.
+ */
+
+boolean MemoryCanvasRep::rectangle(
+    const MemoryPoint* p, int n, int& l, int& t, int& r, int& b
+) const {
+    if (n == 5 && (p[4].x_ != p[0].x_ || p[4].y_ != p[0].y_)) {
+	return false;
+    }
+    if (n != 4 && n != 5) {
+	return false;
+    }
+    if (!(
+	(p[0].x_ == p[1].x_ && p[1].y_ == p[2].y_ &&
+	 p[2].x_ == p[3].x_ && p[3].y_ == p[0].y_) ||
+	(p[0].y_ == p[1].y_ && p[1].x_ == p[2].x_ &&
+	 p[2].y_ == p[3].y_ && p[3].x_ == p[0].x_)
+    )) {
+	return false;
+    }
+    l = pixel_edge(Math::min(p[0].x_, p[2].x_));
+    r = pixel_edge(Math::max(p[0].x_, p[2].x_));
+    t = pixel_edge(Math::min(p[0].y_, p[2].y_));
+    b = pixel_edge(Math::max(p[0].y_, p[2].y_));
+    return true;
+}
+
+/*
+ * Set up the color for the following spans; return false if
+ * nothing would show.
+ */
+
+boolean MemoryCanvasRep::paint(const Color* color) {
+    if (color == nil) {
+	return false;
+    }
+    op_ = color->op();
+    if (op_ == Color::Invisible) {
+	return false;
+    }
+    ColorIntensity r, g, b;
+    color->intensities(r, g, b);
+    pixel_ = rgb(r, g, b);
+    float a = color->alpha();
+    alpha_ = a >= 1 ? 256 : a <= 0 ? 0 : int(a * 256);
+    return alpha_ != 0;
+}
+
+void MemoryCanvasRep::run(unsigned int* p, int n) {
+    if (op_ == Color::Xor) {
+	xor_span(p, n, pixel_);
+    } else if (alpha_ == 256) {
+	copy_span(p, n, pixel_);
+    } else {
+	blend_span(p, n, pixel_, alpha_);
+    }
+}
+
+/*
+ * Paint pixels [x0, x1) of row y wherever the clip allows.
+ */
+
+void MemoryCanvasRep::span(int y, int x0, int x1) {
+    if (y < clip_.top_ || y >= clip_.bottom_) {
+	return;
+    }
+    x0 = Math::max(x0, clip_.left_);
+    x1 = Math::min(x1, clip_.right_);
+    unsigned int* row = pixels_ + y * pwidth_;
+    const unsigned char* m = clip_.mask_;
+    if (m == nil) {
+	if (x0 < x1) {
+	    run(row + x0, x1 - x0);
+	}
+	return;
+    }
+    m += y * pwidth_;
+    while (x0 < x1) {
+	while (x0 < x1 && m[x0] == 0) {
+	    ++x0;
+	}
+	int x = x0;
+	while (x < x1 && m[x] != 0) {
+	    ++x;
+	}
+	if (x > x0) {
+	    run(row + x0, x - x0);
+	}
+	x0 = x;
+    }
+}
+
+/*
+ * A polygon edge, stepped a row at a time; top_ is the first row
+ * whose center it crosses and bottom_ the row after the last.
+ */
+
+class MemoryEdge {
+public:
+    float x_;
+    float dx_;
+    int top_;
+    int bottom_;
+};
+
+static int edge_order(const void* e1, const void* e2) {
+    return ((const MemoryEdge*)e1)->top_ - ((const MemoryEdge*)e2)->top_;
+}
+
+/*
+ * Scan convert a polygon by the even-odd rule, within the clip
+ * rectangle.  The spans are painted, or set in the mask if one is
+ * given.
+ */
+
+void MemoryCanvasRep::polygon(
+    const MemoryPoint* p, int n, unsigned char* mask
+) {
+    MemoryEdge* edge = new MemoryEdge[n];
+    int nedges = 0;
+    int top = clip_.bottom_, bottom = clip_.top_;
+    for (int i = 0; i < n; i++) {
+	const MemoryPoint* a = &p[i];
+	const MemoryPoint* b = &p[i + 1 == n ? 0 : i + 1];
+	if (a->y_ > b->y_) {
+	    const MemoryPoint* t = a;
+	    a = b;
+	    b = t;
+	}
+	int t = pixel_edge(a->y_);
+	int u = pixel_edge(b->y_);
+	if (t < u) {
+	    MemoryEdge& e = edge[nedges++];
+	    e.dx_ = (b->x_ - a->x_) / (b->y_ - a->y_);
+	    e.x_ = a->x_ + (t + 0.5 - a->y_) * e.dx_;
+	    e.top_ = t;
+	    e.bottom_ = u;
+	    top = Math::min(top, t);
+	    bottom = Math::max(bottom, u);
+	}
+    }
+    top = Math::max(top, clip_.top_);
+    bottom = Math::min(bottom, clip_.bottom_);
+    qsort(edge, nedges, sizeof(MemoryEdge), &edge_order);
+
+    MemoryEdge** active = new MemoryEdge*[nedges];
+    float* cross = new float[nedges];
+    int nactive = 0;
+    int next = 0;
+    for (int y = top; y < bottom; y++) {
+	int i, j;
+	for (; next < nedges && edge[next].top_ <= y; next++) {
+	    MemoryEdge& e = edge[next];
+	    e.x_ += (y - e.top_) * e.dx_;
+	    active[nactive++] = &e;
+	}
+	int ncross = 0;
+	for (i = 0, j = 0; i < nactive; i++) {
+	    MemoryEdge* e = active[i];
+	    if (e->bottom_ > y) {
+		active[j++] = e;
+		float x = e->x_;
+		int k = ncross++;
+		for (; k > 0 && cross[k - 1] > x; k--) {
+		    cross[k] = cross[k - 1];
+		}
+		cross[k] = x;
+		e->x_ += e->dx_;
+	    }
+	}
+	nactive = j;
+	for (i = 0; i + 1 < ncross; i += 2) {
+	    int x0 = pixel_edge(cross[i]);
+	    int x1 = pixel_edge(cross[i + 1]);
+	    if (mask == nil) {
+		span(y, x0, x1);
+	    } else {
+		x0 = Math::max(x0, clip_.left_);
+		x1 = Math::min(x1, clip_.right_);
+		unsigned char* row = mask + y * pwidth_;
+		for (; x0 < x1; x0++) {
+		    row[x0] = 1;
+		}
+	    }
+	}
+    }
+    delete [] cross;
+    delete [] active;
+    delete [] edge;
+}
+
+/*
+ * Lines of a pixel or less are stepped one pixel at a time;
+ * wider ones are filled as rectangles extended by half their
+ * width at each end, which fills the corners of boxes.
+ */
+
+void MemoryCanvasRep::segment(
+    const MemoryPoint& a, const MemoryPoint& b, float width
+) {
+    float dx = b.x_ - a.x_;
+    float dy = b.y_ - a.y_;
+    if (width <= 1) {
+	int x0 = int(floor(a.x_)), y0 = int(floor(a.y_));
+	int x1 = int(floor(b.x_)), y1 = int(floor(b.y_));
+	if (y0 == y1) {
+	    span(y0, Math::min(x0, x1), Math::max(x0, x1) + 1);
+	} else {
+	    int steps = Math::max(Math::abs(x1 - x0), Math::abs(y1 - y0));
+	    for (int i = 0; i <= steps; i++) {
+		int x = x0 + int(floor((x1 - x0) * float(i) / steps + 0.5));
+		int y = y0 + int(floor((y1 - y0) * float(i) / steps + 0.5));
+		span(y, x, x + 1);
+	    }
+	}
+	return;
+    }
+    float len = sqrt(dx * dx + dy * dy);
+    float ux, uy;
+    if (len == 0) {
+	ux = width / 2;
+	uy = 0;
+    } else {
+	ux = dx / len * width / 2;
+	uy = dy / len * width / 2;
+    }
+    MemoryPoint q[4];
+    q[0].x_ = a.x_ - ux - uy;
+    q[0].y_ = a.y_ - uy + ux;
+    q[1].x_ = a.x_ - ux + uy;
+    q[1].y_ = a.y_ - uy - ux;
+    q[2].x_ = b.x_ + ux + uy;
+    q[2].y_ = b.y_ + uy - ux;
+    q[3].x_ = b.x_ + ux - uy;
+    q[3].y_ = b.y_ + uy + ux;
+    polygon(q, 4, nil);
+}
+
+/*
+ * Find the pixels, within the clip rectangle, that a box in
+ * the current coordinates covers.
+ */
+
+void MemoryCanvasRep::bounds(
+    const Canvas* c, Coord l, Coord b, Coord r, Coord t,
+    int& x0, int& y0, int& x1, int& y1
+) const {
+    MemoryPoint p[4];
+    device(c, l, b, p[0]);
+    device(c, l, t, p[1]);
+    device(c, r, t, p[2]);
+    device(c, r, b, p[3]);
+    float xmin = p[0].x_, xmax = p[0].x_;
+    float ymin = p[0].y_, ymax = p[0].y_;
+    for (int i = 1; i < 4; i++) {
+	xmin = Math::min(xmin, p[i].x_);
+	xmax = Math::max(xmax, p[i].x_);
+	ymin = Math::min(ymin, p[i].y_);
+	ymax = Math::max(ymax, p[i].y_);
+    }
+    x0 = Math::max(pixel_edge(xmin), clip_.left_);
+    x1 = Math::min(pixel_edge(xmax), clip_.right_);
+    y0 = Math::max(pixel_edge(ymin), clip_.top_);
+    y1 = Math::min(pixel_edge(ymax), clip_.bottom_);
+}
+
+MemoryCanvas::MemoryCanvas(PixelCoord width, PixelCoord height, float scale) {
+    MemoryCanvasRep* m = new MemoryCanvasRep;
+    rep_ = m;
+    m->pixels_ = nil;
+    m->clip_.mask_ = nil;
+    m->scale_ = scale;
+    m->allocate(width, height);
+    m->size_ = 64;
+    m->point_ = new MemoryPoint[m->size_];
+    m->count_ = 0;
+    m->curx_ = 0;
+    m->cury_ = 0;
+    m->clippers_ = new MemoryClipList;
+    m->pixel_ = 0;
+    m->alpha_ = 256;
+    m->op_ = Color::Copy;
+}
+
+MemoryCanvas::~MemoryCanvas() {
+    MemoryCanvasRep* m = rep_;
+    for (ListItr(MemoryClipList) i(*m->clippers_); i.more(); i.next()) {
+	delete [] i.cur_ref().mask_;
+    }
+    delete m->clippers_;
+    delete [] m->clip_.mask_;
+    delete [] m->point_;
+    delete [] m->pixels_;
+    delete m;
+}
+
+void MemoryCanvas::size(Coord width, Coord height) {
+    psize(to_pixels(width), to_pixels(height));
+}
+
+void MemoryCanvas::psize(PixelCoord width, PixelCoord height) {
+    MemoryCanvasRep* m = rep_;
+    for (ListItr(MemoryClipList) i(*m->clippers_); i.more(); i.next()) {
+	delete [] i.cur_ref().mask_;
+    }
+    m->clippers_->remove_all();
+    m->allocate(width, height);
+}
+
+Coord MemoryCanvas::width() const { return rep_->pwidth_ / rep_->scale_; }
+Coord MemoryCanvas::height() const { return rep_->pheight_ / rep_->scale_; }
+PixelCoord MemoryCanvas::pwidth() const { return rep_->pwidth_; }
+PixelCoord MemoryCanvas::pheight() const { return rep_->pheight_; }
+
+PixelCoord MemoryCanvas::to_pixels(Coord p, DimensionName) const {
+    return PixelCoord(p * rep_->scale_ + ((p > 0) ? 0.5 : -0.5));
+}
+
+Coord MemoryCanvas::to_coord(PixelCoord p, DimensionName) const {
+    return p / rep_->scale_;
+}
+
+Coord MemoryCanvas::to_pixels_coord(Coord p, DimensionName d) const {
+    return to_coord(to_pixels(p, d), d);
+}
+
+void MemoryCanvas::new_path() {
+    MemoryCanvasRep* m = rep_;
+    m->count_ = 0;
+    m->curx_ = 0;
+    m->cury_ = 0;
+}
+
+void MemoryCanvas::move_to(Coord x, Coord y) {
+    MemoryCanvasRep* m = rep_;
+    m->count_ = 0;
+    m->device(this, x, y, m->next_point());
+    m->curx_ = x;
+    m->cury_ = y;
+}
+
+void MemoryCanvas::line_to(Coord x, Coord y) {
+    MemoryCanvasRep* m = rep_;
+    m->device(this, x, y, m->next_point());
+    m->curx_ = x;
+    m->cury_ = y;
+}
+
+void MemoryCanvas::curve_to(
+    Coord x, Coord y, Coord x1, Coord y1, Coord x2, Coord y2
+) {
+    MemoryCanvasRep* m = rep_;
+    MemoryPoint p0, p1, p2, p3;
+    m->device(this, m->curx_, m->cury_, p0);
+    m->device(this, x1, y1, p1);
+    m->device(this, x2, y2, p2);
+    m->device(this, x, y, p3);
+    if (m->count_ == 0) {
+	m->next_point() = p0;
+    }
+    m->flatten(p0, p1, p2, p3, 16);
+    m->curx_ = x;
+    m->cury_ = y;
+}
+
+void MemoryCanvas::close_path() {
+    MemoryCanvasRep* m = rep_;
+    if (m->count_ > 0) {
+	MemoryPoint p = m->point_[0];
+	m->next_point() = p;
+    }
+}
+
+void MemoryCanvas::stroke(const Color* color, const Brush* brush) {
+    MemoryCanvasRep* m = rep_;
+    if (m->count_ < 2 || !m->paint(color)) {
+	return;
+    }
+    float width = brush == nil ? 0 : brush->width() * m->scale_;
+    for (int i = 1; i < m->count_; i++) {
+	m->segment(m->point_[i - 1], m->point_[i], width);
+    }
+}
+
+void MemoryCanvas::fill(const Color* color) {
+    MemoryCanvasRep* m = rep_;
+    if (m->count_ <= 2 || !m->paint(color)) {
+	return;
+    }
+    int l, t, r, b;
+    if (m->rectangle(m->point_, m->count_, l, t, r, b)) {
+	t = Math::max(t, m->clip_.top_);
+	b = Math::min(b, m->clip_.bottom_);
+	for (int y = t; y < b; y++) {
+	    m->span(y, l, r);
+	}
+    } else {
+	m->polygon(m->point_, m->count_, nil);
+    }
+}
+
+void MemoryCanvas::fill_rect(
+    Coord l, Coord b, Coord r, Coord t, const Color* color
+) {
+    new_path();
+    move_to(l, b);
+    line_to(l, t);
+    line_to(r, t);
+    line_to(r, b);
+    close_path();
+    fill(color);
+}
+
+/*
+ * Characters are stenciled from the bitmaps the window system caches
+ * for the default display's fonts; with no display there are no fonts
+ * to draw.
+ */
+
+void MemoryCanvas::character(
+    const Font* font, long ch, Coord, const Color* color, Coord x, Coord y
+) {
+    Session* s = Session::instance();
+    if (s == nil || s->default_display() == nil || font == nil) {
+	return;
+    }
+    stencil(char_bitmap(font, ch), color, x, y);
+}
+
+/*
+ * Stencils and images are sampled at each pixel center, mapped
+ * back through the current transformation.
+ */
+
+void MemoryCanvas::stencil(
+    const Bitmap* mask, const Color* color, Coord x, Coord y
+) {
+    MemoryCanvasRep* m = rep_;
+    if (!m->paint(color)) {
+	return;
+    }
+    Coord l = x - mask->left_bearing();
+    Coord r = x + mask->right_bearing();
+    Coord b = y - mask->descent();
+    Coord t = y + mask->ascent();
+    int pw = mask->pwidth(), ph = mask->pheight();
+    if (pw == 0 || ph == 0 || r <= l || t <= b) {
+	return;
+    }
+    int x0, y0, x1, y1;
+    m->bounds(this, l, b, r, t, x0, y0, x1, y1);
+    float sx = pw / (r - l), sy = ph / (t - b);
+    unsigned char* bits = new unsigned char[(pw + 7) >> 3];
+    int row = -1;
+    for (int j = y0; j < y1; j++) {
+	int run = -1;
+	for (int i = x0; i <= x1; i++) {
+	    boolean set = false;
+	    if (i < x1) {
+		Coord ux, uy;
+		m->user(this, i, j, ux, uy);
+		int bx = int(floor((ux - l) * sx));
+		int by = int(floor((uy - b) * sy));
+		if (bx >= 0 && bx < pw && by >= 0 && by < ph) {
+		    if (by != row) {
+			mask->peek_bits(0, by, pw, bits);
+			row = by;
+		    }
+		    set = (bits[bx >> 3] & (0x80 >> (bx & 7))) != 0;
+		}
+	    }
+	    if (set && run < 0) {
+		run = i;
+	    } else if (!set && run >= 0) {
+		m->span(j, run, i);
+		run = -1;
+	    }
+	}
+    }
+    delete [] bits;
+}
+
+void MemoryCanvas::image(const Raster* raster, Coord x, Coord y) {
+    MemoryCanvasRep* m = rep_;
+    Coord l = x - raster->left_bearing();
+    Coord r = x + raster->right_bearing();
+    Coord b = y - raster->descent();
+    Coord t = y + raster->ascent();
+    int pw = int(raster->pwidth()), ph = int(raster->pheight());
+    if (pw == 0 || ph == 0 || r <= l || t <= b) {
+	return;
+    }
+    int x0, y0, x1, y1;
+    m->bounds(this, l, b, r, t, x0, y0, x1, y1);
+    if (x0 >= x1 || y0 >= y1) {
+	return;
+    }
+    unsigned char* rgba = new unsigned char[pw * ph * 4];
+    raster->peek_pixels(0, 0, pw, ph, rgba, Raster::rgba8);
+    float sx = pw / (r - l), sy = ph / (t - b);
+    m->op_ = Color::Copy;
+    for (int j = y0; j < y1; j++) {
+	for (int i = x0; i < x1; i++) {
+	    Coord ux, uy;
+	    m->user(this, i, j, ux, uy);
+	    int bx = int(floor((ux - l) * sx));
+	    int by = int(floor((uy - b) * sy));
+	    if (bx >= 0 && bx < pw && by >= 0 && by < ph) {
+		const unsigned char* s = rgba + ((ph - 1 - by) * pw + bx) * 4;
+		if (s[3] != 0) {
+		    m->pixel_ = 0xff000000 | (s[0] << 16) | (s[1] << 8) | s[2];
+		    m->alpha_ = s[3] == 0xff ? 256 : s[3];
+		    m->span(j, i, i + 1);
+		}
+	    }
+	}
+    }
+    delete [] rgba;
+}
+
+void MemoryCanvas::push_clipping() {
+    MemoryCanvasRep* m = rep_;
+    MemoryClip c = m->clip_;
+    if (c.mask_ != nil) {
+	long n = long(m->pwidth_) * m->pheight_;
+	c.mask_ = new unsigned char[n];
+	Memory::copy(m->clip_.mask_, c.mask_, n);
+    }
+    m->clippers_->append(c);
+}
+
+void MemoryCanvas::pop_clipping() {
+    MemoryCanvasRep* m = rep_;
+    MemoryClipList& s = *m->clippers_;
+    long n = s.count();
+    if (n == 0) {
+	return;
+    }
+    delete [] m->clip_.mask_;
+    m->clip_ = s.item(n - 1);
+    s.remove(n - 1);
+}
+
+void MemoryCanvas::clip() {
+    MemoryCanvasRep* m = rep_;
+    int n = m->count_;
+    if (n <= 2) {
+	return;
+    }
+    MemoryClip& c = m->clip_;
+    int l, t, r, b;
+    if (!m->rectangle(m->point_, n, l, t, r, b)) {
+	long size = long(m->pwidth_) * m->pheight_;
+	unsigned char* mask = new unsigned char[size];
+	Memory::zero(mask, size);
+	m->polygon(m->point_, n, mask);
+	if (c.mask_ != nil) {
+	    for (long i = 0; i < size; i++) {
+		mask[i] &= c.mask_[i];
+	    }
+	    delete [] c.mask_;
+	}
+	c.mask_ = mask;
+	float xmin = m->point_[0].x_, xmax = xmin;
+	float ymin = m->point_[0].y_, ymax = ymin;
+	for (int i = 1; i < n; i++) {
+	    xmin = Math::min(xmin, m->point_[i].x_);
+	    xmax = Math::max(xmax, m->point_[i].x_);
+	    ymin = Math::min(ymin, m->point_[i].y_);
+	    ymax = Math::max(ymax, m->point_[i].y_);
+	}
+	l = pixel_edge(xmin);
+	r = pixel_edge(xmax);
+	t = pixel_edge(ymin);
+	b = pixel_edge(ymax);
+    }
+    c.left_ = Math::max(c.left_, l);
+    c.top_ = Math::max(c.top_, t);
+    c.right_ = Math::max(c.left_, Math::min(c.right_, r));
+    c.bottom_ = Math::max(c.top_, Math::min(c.bottom_, b));
+}
+
+void MemoryCanvas::clip_rect(Coord l, Coord b, Coord r, Coord t) {
+    new_path();
+    move_to(l, b);
+    line_to(l, t);
+    line_to(r, t);
+    line_to(r, b);
+    close_path();
+    clip();
+}
+
+void MemoryCanvas::damage(const Extension&) { }
+void MemoryCanvas::damage(Coord, Coord, Coord, Coord) { }
+boolean MemoryCanvas::damaged(const Extension&) const { return true; }
+
+boolean MemoryCanvas::damaged(Coord, Coord, Coord, Coord) const {
+    return true;
+}
+
+void MemoryCanvas::damage_area(Extension& ext) {
+    ext.set_xy(this, 0, 0, width(), height());
+}
+
+void MemoryCanvas::damage_all() { }
+boolean MemoryCanvas::any_damage() const { return true; }
+void MemoryCanvas::restrict_damage(const Extension&) { }
+void MemoryCanvas::restrict_damage(Coord, Coord, Coord, Coord) { }
+
+void MemoryCanvas::clear(const Color* color) {
+    MemoryCanvasRep* m = rep_;
+    unsigned int pixel = 0xffffffff;
+    if (color != nil) {
+	ColorIntensity r, g, b;
+	color->intensities(r, g, b);
+	pixel = rgb(r, g, b);
+    }
+    copy_span(m->pixels_, m->pwidth_ * m->pheight_, pixel);
+}
+
+const unsigned int* MemoryCanvas::pixels() const { return rep_->pixels_; }
+
+void MemoryCanvas::write(ostream& out) const {
+    MemoryCanvasRep* m = rep_;
+    out << "P6\n" << m->pwidth_ << " " << m->pheight_ << "\n255\n";
+    char* row = new char[m->pwidth_ * 3];
+    for (int y = 0; y < m->pheight_; y++) {
+	const unsigned int* p = m->pixels_ + y * m->pwidth_;
+	for (int x = 0; x < m->pwidth_; x++) {
+	    row[3 * x] = char(p[x] >> 16);
+	    row[3 * x + 1] = char(p[x] >> 8);
+	    row[3 * x + 2] = char(p[x]);
+	}
+	out.write(row, m->pwidth_ * 3);
+    }
+    delete [] row;
+}
@@ -199,26 +199,26 @@ Raster* TIFFRasterImpl::load(const char* filename) {
     if (raster_ != nil && gt(width, height)) {
 	/* create raster_ from packed image data */
 	r = new Raster(width, height);
+	u_char* row = new u_char[width * 3];
 	for (long i = height - 1; i >= 0; i--) {
 	    u_char* c = (u_char*) (raster_ + i*width);
-	    /* should use a lookup table here */
+	    u_char* p = row;
 	    for (long j = 0; j < width; j++) {
-		r->poke(
-		    j, i,
 #ifdef LINUX
-		    ColorIntensity(float(c[0]) / float(0xff)),
-		    ColorIntensity(float(c[1]) / float(0xff)),
-		    ColorIntensity(float(c[2]) / float(0xff)),
+		p[0] = c[0];
+		p[1] = c[1];
+		p[2] = c[2];
 #else
-		    ColorIntensity(float(c[3]) / float(0xff)),
-		    ColorIntensity(float(c[2]) / float(0xff)),
-		    ColorIntensity(float(c[1]) / float(0xff)),
+		p[0] = c[3];
+		p[1] = c[2];
+		p[2] = c[1];
 #endif
-		    1.0
-		);
+		p += 3;
 		c += sizeof (u_long);
 	    }
+	    r->poke_pixels(0, i, width, 1, row, Raster::rgb8);
 	}
+	delete [] row;
     }
     TIFFClose(tif_);
     delete raster_;
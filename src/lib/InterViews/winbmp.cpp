@@ -96,62 +96,58 @@ Raster* BMPRaster::load(const char *filename)
 
  // read in bitmap image data
  // assume no RLE compression
+ // scan lines must end on 4-byte boundaries
+ int length = (width * bitCount + 7) / 8;
+ if (length % 4)
+   length += 4 - (length % 4);
+ unsigned char* data = new unsigned char[length];
+ unsigned char* rgb = new unsigned char[width * 3];
+
    for (int row=height-1; row>=0; row--)
     {
-     unsigned char data[32];
-
-     // scan lines must end on 4-byte boundaries
-     int length = width * bitCount / 8;
-     if (length % 4)
-       length += 4 - (length % 4);
      for (int k=0; k<length; k++)
        readChar(in,&(data[k]));
 
-
-
+     unsigned char* p = rgb;
      for (int col=0; col<width; col++)
       {
-        long int color = 0;
         if (bitCount == 24)
           {
            int index = col * 3;
-           color = data[index];
-           color <<= 8;
-           color |= data[index+1];
-           color <<= 8;
-           color |= data[index+2];
+           p[0] = data[index];
+           p[1] = data[index+1];
+           p[2] = data[index+2];
           }
-        else if (bitCount == 8)
-          color = data[col];
-        else if (bitCount == 4)
-          {
-           unsigned char temp = data[col/2];
-           if (col % 2)
-            color = temp & 0x0f;
-           else
-            color = (temp & 0xf0) >> 4;
-          }
-        else if (bitCount == 1)
-          {
-            int whichByte = col / 8;
-            int whichBit = col % 8;
-            color = !!(data[whichByte] & (1 << (7 - whichBit)));
-          }
-
-        if (bitCount == 24 || bitCount == 4 || bitCount == 1)
+        else
           {
-//            printf("%d %d: %d\n",row,col,color);
-            int r = (bitCount == 24) ? (color >> 16)          : red[color];
-            int g = (bitCount == 24) ? ((color >> 8) & 0xff)  : green[color];
-            int b = (bitCount == 24) ? (color & 0xff)         : blue[color];
-//            printf(" --> %d %d %d\n",r,g,b);
-            res->poke(col,row,
-                      float(r)/255.0f, float(g)/255.0f, float(b)/255.0f,
-                      1.0f);
+           int color = 0;
+           if (bitCount == 8)
+             color = data[col];
+           else if (bitCount == 4)
+             {
+              unsigned char temp = data[col/2];
+              if (col % 2)
+               color = temp & 0x0f;
+              else
+               color = (temp & 0xf0) >> 4;
+             }
+           else if (bitCount == 1)
+             {
+               int whichByte = col / 8;
+               int whichBit = col % 8;
+               color = !!(data[whichByte] & (1 << (7 - whichBit)));
+             }
+           p[0] = red[color];
+           p[1] = green[color];
+           p[2] = blue[color];
           }
+        p += 3;
       }
+     res->poke_pixels(0, row, width, 1, rgb, Raster::rgb8);
     }
 
+ delete [] data;
+ delete [] rgb;
 
  fclose(in);
 
@@ -36,11 +36,13 @@
 #include <Unidraw/creator.h>
 #include <Unidraw/editorinfo.h>
 #include <Unidraw/globals.h>
+#include <Unidraw/iterator.h>
 #include <Unidraw/statevars.h>
 #include <Unidraw/transfn.h>
 #include <Unidraw/uarray.h>
 #include <Unidraw/uformat.h>
 #include <Unidraw/ulist.h>
+#include <Unidraw/uscanner.h>
 
 #include <Unidraw/Commands/command.h>
 
@@ -54,9 +56,11 @@
 
 #include <InterViews/bitmap.h>
 #include <InterViews/raster.h>
+#include <InterViews/resource.h>
 #include <InterViews/transformer.h>
 #include <IV-2_6/InterViews/world.h>
 
+#include <OS/math.h>
 #include <OS/memory.h>
 #include <OS/types.h>
 
@@ -76,6 +80,7 @@
 #include <unistd.h>
 #endif
 #include <sys/file.h>
+#include <sys/stat.h>
 
 #ifdef __DECCXX
 extern "C" {
@@ -98,17 +103,6 @@ static char hexcharmap[] = {
      'a', 'b', 'c', 'd', 'e', 'f'
 };
 
-static unsigned int hexintmap[] = {
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0,
-     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
-};
-
 static const char* HexEncode (
     ColorIntensity ir, ColorIntensity ig, ColorIntensity ib
 ) {
@@ -129,29 +123,17 @@ static const char* HexEncode (
     return enc;
 }
 
-static void HexDecode (
-    const char* enc, 
-    ColorIntensity& ir, ColorIntensity& ig, ColorIntensity& ib
+static unsigned int GrayLevel (
+    ColorIntensity ir, ColorIntensity ig, ColorIntensity ib
 ) {
-    unsigned int r, g, b;
-
-    r  = hexintmap[enc[0]] << 4;
-    r |= hexintmap[enc[1]];
-    g  = hexintmap[enc[2]] << 4;
-    g |= hexintmap[enc[3]];
-    b  = hexintmap[enc[4]] << 4;
-    b |= hexintmap[enc[5]];
-
-    ir = float(r) / float(color_base);
-    ig = float(g) / float(color_base);
-    ib = float(b) / float(color_base);
+    ColorIntensity igray = 0.30 * ir + 0.59 * ig + 0.11 * ib;
+    return iv26_round(igray * color_base);
 }
 
 static const char* HexGrayEncode (
     ColorIntensity ir, ColorIntensity ig, ColorIntensity ib
 ) {
-    ColorIntensity igray = 0.30 * ir + 0.59 * ig + 0.11 * ib;
-    unsigned int gray = iv26_round(igray * color_base);
+    unsigned int gray = GrayLevel(ir, ig, ib);
 
     static char enc[hex_gray_encode+1];
     enc[hex_gray_encode] = '\0';
@@ -162,13 +144,246 @@ static const char* HexGrayEncode (
     return enc;
 }
 
-static void HexGrayDecode (const char* enc, ColorIntensity& ig) {
-    unsigned int g;
+/*****************************************************************************/
+
+/*
+ * The binary format writes integers as zigzag-encoded groups of seven
+ * bits, least significant first, and floats as their four IEEE bytes,
+ * least significant first.
+ */
+
+static const int int_encode = sizeof(long) * 8 / 7 + 1;   // at most
+
+static int EncodeInt (long n, unsigned char* dst) {
+    unsigned long u = ((unsigned long) n << 1) ^ (n < 0 ? ~0UL : 0UL);
+    int i = 0;
+
+    while (u >= 0x80) {
+        dst[i++] = (unsigned char) ((u & 0x7f) | 0x80);
+        u >>= 7;
+    }
+    dst[i++] = (unsigned char) u;
+    return i;
+}
+
+static void PutInt (long n, ostream& out) {
+    unsigned char b[int_encode];
+    out.write((char*) b, EncodeInt(n, b));
+}
+
+static long GetInt (istream& in) {
+    unsigned long u = 0;
+    int bits = sizeof(long) * 8;
+    char c;
+
+    for (int shift = 0; shift < bits && in.get(c); shift += 7) {
+        u |= (unsigned long) (c & 0x7f) << shift;
+
+        if ((c & 0x80) == 0) {
+            break;
+        }
+    }
+    return long(u >> 1) ^ -long(u & 1);
+}
+
+static void PutFloat (float f, ostream& out) {
+    unsigned int u;
+    Memory::copy(&f, &u, sizeof(u));
+
+    for (int i = 0; i < 4; ++i, u >>= 8) {
+        out.put(char(u & 0xff));
+    }
+}
+
+static float GetFloat (istream& in) {
+    unsigned char b[4];
+    unsigned int u = 0;
+    float f;
+
+    in.read((char*) b, 4);
+
+    for (int i = 3; i >= 0; --i) {
+        u = u << 8 | b[i];
+    }
+    Memory::copy(&u, &f, sizeof(f));
+    return f;
+}
+
+/*
+ * Pixel data go out a row at a time, each row as a block prefixed by
+ * twice its length in bytes, plus one if the block holds the row
+ * run-length encoded as in TIFF's PackBits rather than the row itself.
+ * PackBits gives up, returning n, once the encoding is no shorter.
+ * From UV_BINARY_INDEXED on, an image's blocks follow their total
+ * length so that a reader can pass over them.
+ */
+
+inline int PackedSize (int n) { return n + 129; }
+
+static int PackBits (const unsigned char* src, int n, unsigned char* dst) {
+    unsigned char* d = dst;
+    int i = 0;
+
+    while (i < n) {
+        if (d - dst >= n) {
+            return n;
+        }
+        int run = 1;
+
+        while (i + run < n && run < 128 && src[i + run] == src[i]) {
+            ++run;
+        }
+        if (run > 1) {
+            *d++ = (unsigned char) (257 - run);
+            *d++ = src[i];
+            i += run;
+
+        } else {
+            int lit = 1;
+
+            while (
+                i + lit < n && lit < 128 && (
+                    i + lit + 2 >= n || src[i + lit] != src[i + lit + 1] ||
+                    src[i + lit] != src[i + lit + 2]
+                )
+            ) {
+                ++lit;
+            }
+            *d++ = (unsigned char) (lit - 1);
+            Memory::copy(&src[i], d, lit);
+            d += lit;
+            i += lit;
+        }
+    }
+    return Math::min(int(d - dst), n);
+}
+
+static void UnpackBits (
+    const unsigned char* src, int len, unsigned char* dst, int n
+) {
+    const unsigned char* end = src + len;
+    unsigned char* d = dst;
+    unsigned char* dend = dst + n;
+
+    while (src < end && d < dend) {
+        int header = *src++;
+
+        if (header < 128) {
+            int lit = Math::min(header + 1, int(end - src));
+            lit = Math::min(lit, int(dend - d));
+            Memory::copy(src, d, lit);
+            src += lit;
+            d += lit;
+
+        } else if (header > 128 && src < end) {
+            int run = Math::min(257 - header, int(dend - d));
+            memset(d, *src++, run);
+            d += run;
+        }
+    }
+    Memory::zero(d, dend - d);
+}
+
+static void GetBlock (
+    unsigned char* row, int n, unsigned char* packed, istream& in
+) {
+    long tag = GetInt(in);
+    long len = tag >> 1;
 
-    g  = hexintmap[enc[0]] << 4;
-    g |= hexintmap[enc[1]];
+    if (tag & 1 && 0 <= len && len < n) {
+        in.read((char*) packed, int(len));
+        UnpackBits(packed, int(len), row, n);
 
-    ig = float(g) / float(color_base);
+    } else if (tag == 2 * n) {
+        in.read((char*) row, n);
+
+    } else {
+        in.clear(ios::badbit);
+        Memory::zero(row, n);
+    }
+}
+
+static void GetBitmapRows (Bitmap* bitmap, istream& in) {
+    int nbits = int(bitmap->Width());
+    int nbytes = (nbits + 7) / 8;
+    unsigned char* bits = new unsigned char[nbytes + 1];
+    unsigned char* packed = new unsigned char[nbytes];
+
+    for (int j = bitmap->Height()-1; j >= 0; --j) {
+        GetBlock(bits, nbytes, packed, in);
+        bitmap->poke_bits(0, j, nbits, bits);
+    }
+    delete [] packed;
+    delete [] bits;
+}
+
+static void GetRasterRows (
+    Raster* raster, Raster::PixelFormat format, istream& in
+) {
+    int w = int(raster->Width());
+    int n = w * int(format);
+    unsigned char* pixels = new unsigned char[n];
+    unsigned char* packed = new unsigned char[n];
+
+    for (int j = raster->Height()-1; j >= 0; --j) {
+        GetBlock(pixels, n, packed, in);
+        raster->poke_pixels(0, j, w, 1, pixels, format);
+    }
+    delete [] packed;
+    delete [] pixels;
+}
+
+class CatalogBlocks {
+public:
+    CatalogBlocks(int n);               // for rows n bytes long
+    ~CatalogBlocks();
+
+    void Add(const unsigned char* row);
+    void Write(ostream&);
+private:
+    int _n;
+    unsigned char* _packed;
+    unsigned char* _data;
+    long _len, _size;
+};
+
+CatalogBlocks::CatalogBlocks (int n) {
+    _n = n;
+    _packed = new unsigned char[PackedSize(n)];
+    _size = 4 * (n + int_encode);
+    _data = new unsigned char[_size];
+    _len = 0;
+}
+
+CatalogBlocks::~CatalogBlocks () {
+    delete [] _packed;
+    delete [] _data;
+}
+
+void CatalogBlocks::Add (const unsigned char* row) {
+    if (_len + _n + int_encode > _size) {
+        _size = 2 * _size;
+        unsigned char* data = new unsigned char[_size];
+        Memory::copy(_data, data, _len);
+        delete [] _data;
+        _data = data;
+    }
+    int len = PackBits(row, _n, _packed);
+
+    if (len < _n) {
+        _len += EncodeInt(2 * len + 1, &_data[_len]);
+        Memory::copy(_packed, &_data[_len], len);
+        _len += len;
+    } else {
+        _len += EncodeInt(2 * _n, &_data[_len]);
+        Memory::copy(row, &_data[_len], _n);
+        _len += _n;
+    }
+}
+
+void CatalogBlocks::Write (ostream& out) {
+    PutInt(_len, out);
+    out.write((char*) _data, _len);
 }
 
 /*****************************************************************************/
@@ -212,11 +427,9 @@ public:
 
     void* GetObject(const char*);
     const char* GetName(void* obj);
-protected:
-    virtual UMapElem* FindTag(void*);
 };
 
-NameMap::NameMap () { }
+NameMap::NameMap () : UMap(false, true) { }
 
 void NameMap::Register (void* object, const char* name) {
     UMap::Register(new NameMapElem(object, name));
@@ -250,17 +463,451 @@ const char* NameMap::GetName (void* object) {
     return (elem == nil) ? nil : (char*) elem->tag();
 }
 
-UMapElem* NameMap::FindTag (void* tag) {
-    const char* string = (char*) tag;
+/*****************************************************************************/
+
+class CatalogRefElem : public UHashElem {
+public:
+    CatalogRefElem(int index);
+public:
+    int _index;
+};
+
+CatalogRefElem::CatalogRefElem (int index) { _index = index; }
+
+class CatalogRefTable : public UHashTable {
+public:
+    CatalogRefTable(boolean strings);
+protected:
+    virtual int Hash(void*);
+    virtual boolean Equal(void*, void*);
+private:
+    boolean _strings;
+};
+
+CatalogRefTable::CatalogRefTable (boolean strings) : UHashTable(64) {
+    _strings = strings;
+}
+
+int CatalogRefTable::Hash (void* key) {
+    if (!_strings) {
+        return UHashTable::Hash(key);
+    }
+    unsigned int h = 2166136261U;
+
+    for (const char* s = (const char*) key; *s != '\0'; ++s) {
+        h = (h ^ (unsigned char) *s) * 16777619U;
+    }
+    return int(h & 0x7fffffff);
+}
+
+boolean CatalogRefTable::Equal (void* key1, void* key2) {
+    if (!_strings) {
+        return key1 == key2;
+    }
+    return strcmp((const char*) key1, (const char*) key2) == 0;
+}
+
+/*
+ * CatalogRefs numbers the brushes, colors, fonts, patterns, and strings
+ * of a binary file in the order they first appear in it.  Writing looks
+ * them up to find their numbers; reading only adds them, since distinct
+ * ones written may read back as the same object.
+ */
+
+class CatalogRefs {
+public:
+    CatalogRefs();
+    ~CatalogRefs();
+
+    int Find(void*);                    // -1 if not defined
+    int Find(const char*);
+    void Define(void*);
+    void Define(const char*);           // defines a copy
+
+    void Add(void*);
+    void Add(const char*);              // adds a copy
+    void* Get(int index);
+private:
+    CatalogRefTable _objs;
+    CatalogRefTable _strings;
+    UArray _refs;
+    UArray _copies;
+};
+
+CatalogRefs::CatalogRefs () : _objs(false), _strings(true), _refs(64) { }
+
+CatalogRefs::~CatalogRefs () {
+    for (int i = 0; i < _copies.Count(); ++i) {
+        delete [] (char*) _copies[i];
+    }
+}
+
+int CatalogRefs::Find (void* obj) {
+    CatalogRefElem* elem = (CatalogRefElem*) _objs.Find(obj);
+    return (elem == nil) ? -1 : elem->_index;
+}
+
+int CatalogRefs::Find (const char* string) {
+    CatalogRefElem* elem = (CatalogRefElem*) _strings.Find((void*) string);
+    return (elem == nil) ? -1 : elem->_index;
+}
+
+void CatalogRefs::Define (void* obj) {
+    int index = _refs.Count();
+    _objs.Register(obj, new CatalogRefElem(index));
+    Add(obj);
+}
+
+void CatalogRefs::Define (const char* string) {
+    int index = _refs.Count();
+    Add(string);
+    _strings.Register(_refs[index], new CatalogRefElem(index));
+}
+
+void CatalogRefs::Add (void* obj) { _refs.Insert(obj, _refs.Count()); }
+
+void CatalogRefs::Add (const char* string) {
+    char* copy = strnew(string);
+    _copies.Insert(copy, _copies.Count());
+    Add((void*) copy);
+}
+
+void* CatalogRefs::Get (int index) {
+    return (0 <= index && index < _refs.Count()) ? _refs[index] : nil;
+}
+
+/*****************************************************************************/
+
+/*
+ * A binary file retrieved lazily leaves the rows of its bitmaps and
+ * rasters unread until something draws, copies, or examines them.  The
+ * CatalogFile stays open while any are left, and reads them all in
+ * before the file is saved over.
+ */
+
+class CatalogFile;
+
+class CatalogRows : public UHashElem {
+public:
+    enum { bitmap, graymap, raster };
+
+    CatalogRows(CatalogFile*, int kind, long offset);
+
+    void Load();                        // deletes this
+    void Forget();                      // deletes this
+private:
+    CatalogFile* _file;
+    int _kind;
+    long _offset;
+};
+
+class CatalogFile : public Resource {
+public:
+    CatalogFile();
+    virtual ~CatalogFile();
+
+    boolean Open(const char*);
+    boolean Same(const char*);
+    istream& Stream();
+
+    CatalogRows* Defer(void* image, int kind, istream&);
+    void Loaded(CatalogRows*);
+    void LoadAll();
+
+    static void LoadAll(const char*);
+private:
+    filebuf _fbuf;
+    istream* _in;
+    dev_t _dev;
+    ino_t _ino;
+    UHashTable _rows;
+
+    static UList* _files;
+};
+
+class CatalogBitmap : public Bitmap {
+public:
+    CatalogBitmap(unsigned int width, unsigned int height);
+    virtual ~CatalogBitmap();
+
+    virtual void poke(boolean set, int x, int y);
+    virtual boolean peek(int x, int y) const;
+    virtual void poke_bits(int x, int y, int count, const unsigned char*);
+    virtual void peek_bits(int x, int y, int count, unsigned char*) const;
+    virtual void flush() const;
+
+    void Load() const;
+
+    CatalogRows* _rows;                 // nil once read in
+};
+
+class CatalogRaster : public Raster {
+public:
+    CatalogRaster(unsigned long width, unsigned long height);
+    virtual ~CatalogRaster();
+
+    virtual void peek(
+        unsigned long x, unsigned long y,
+        ColorIntensity& red, ColorIntensity& green, ColorIntensity& blue,
+        float& alpha
+    ) const;
+    virtual void poke(
+        unsigned long x, unsigned long y,
+        ColorIntensity red, ColorIntensity green, ColorIntensity blue,
+        float alpha
+    );
+    virtual void peek_pixels(
+        unsigned long x, unsigned long y,
+        unsigned long width, unsigned long height,
+        unsigned char* pixels, PixelFormat, long stride = 0
+    ) const;
+    virtual void poke_pixels(
+        unsigned long x, unsigned long y,
+        unsigned long width, unsigned long height,
+        const unsigned char* pixels, PixelFormat, long stride = 0
+    );
+    virtual void flush() const;
+
+    void Load() const;
+
+    CatalogRows* _rows;                 // nil once read in
+};
+
+CatalogRows::CatalogRows (CatalogFile* file, int kind, long offset) {
+    _file = file;
+    _kind = kind;
+    _offset = offset;
+}
+
+/*
+ * The stream may be in the middle of reading the catalog file that
+ * deferred us, so put it back where it was when done.
+ */
+
+void CatalogRows::Load () {
+    istream& in = _file->Stream();
+    ios::iostate state = in.rdstate();
+    in.clear();
+    long pos = in.tellg();
+    in.seekg(_offset, ios::beg);
+
+    if (_kind == bitmap) {
+        CatalogBitmap* b = (CatalogBitmap*) GetKey();
+        b->_rows = nil;
+        GetBitmapRows(b, in);
+        b->Bitmap::flush();
+
+    } else {
+        CatalogRaster* r = (CatalogRaster*) GetKey();
+        r->_rows = nil;
+        Raster::PixelFormat format =
+            (_kind == graymap) ? Raster::gray8 : Raster::rgb8;
+        GetRasterRows(r, format, in);
+        r->Raster::flush();
+    }
+    in.clear();
+
+    if (pos >= 0) {
+        in.seekg(pos, ios::beg);
+    }
+    in.clear(state);
+    _file->Loaded(this);
+}
+
+void CatalogRows::Forget () { _file->Loaded(this); }
+
+UList* CatalogFile::_files;
+
+CatalogFile::CatalogFile () : _rows(64) {
+    _in = nil;
+    _dev = 0;
+    _ino = 0;
+
+    if (_files == nil) {
+        _files = new UList;
+    }
+    _files->Append(new UList(this));
+}
+
+CatalogFile::~CatalogFile () {
+    _files->Delete(this);
+    delete _in;
+}
+
+boolean CatalogFile::Open (const char* name) {
+    struct stat st;
+
+    if (_fbuf.open((char*) name, IOS_IN) == 0 || stat(name, &st) < 0) {
+        return false;
+    }
+    _dev = st.st_dev;
+    _ino = st.st_ino;
+    _in = new istream(&_fbuf);
+    return true;
+}
+
+boolean CatalogFile::Same (const char* name) {
+    struct stat st;
+    return
+        _in != nil && stat(name, &st) == 0 &&
+        st.st_dev == _dev && st.st_ino == _ino;
+}
+
+istream& CatalogFile::Stream () { return *_in; }
+
+/*
+ * Note where the rows start and skip past them.
+ */
+
+CatalogRows* CatalogFile::Defer (void* image, int kind, istream& in) {
+    long len = GetInt(in);
+    long offset = in.tellg();
+    CatalogRows* rows = new CatalogRows(this, kind, offset);
+
+    in.seekg(len, ios::cur);
+    _rows.Register(image, rows);
+    ref();
+    return rows;
+}
+
+void CatalogFile::Loaded (CatalogRows* rows) {
+    _rows.Unregister(rows->GetKey());
+    unref();
+}
+
+void CatalogFile::LoadAll () {
+    UArray images(_rows.Count());
+    Iterator i;
 
-    for (int i = 0; i < _elems.Count(); ++i) {
-        const char* elemString = (char*) Elem(i)->tag();
+    for (_rows.First(i); !_rows.Done(i); _rows.Next(i)) {
+        images.Insert(_rows.GetElem(i)->GetKey(), images.Count());
+    }
+    ref();
+
+    for (int k = 0; k < images.Count(); ++k) {
+        ((CatalogRows*) _rows.Find(images[k]))->Load();
+    }
+    unref();
+}
+
+void CatalogFile::LoadAll (const char* name) {
+    if (_files == nil) {
+        return;
+    }
+    for (UList* u = _files->First(); u != _files->End(); ) {
+        CatalogFile* file = (CatalogFile*) (*u)();
+        u = u->Next();
 
-        if (strcmp(string, elemString) == 0) {
-            return (UMapElem*) _elems[i];
+        if (file->Same(name)) {
+            file->LoadAll();
         }
     }
-    return nil;
+}
+
+CatalogBitmap::CatalogBitmap (
+    unsigned int width, unsigned int height
+) : Bitmap((void*) nil, width, height) {
+    _rows = nil;
+}
+
+CatalogBitmap::~CatalogBitmap () {
+    if (_rows != nil) {
+        _rows->Forget();
+    }
+}
+
+void CatalogBitmap::Load () const {
+    if (_rows != nil) {
+        _rows->Load();
+    }
+}
+
+void CatalogBitmap::poke (boolean set, int x, int y) {
+    Load();
+    Bitmap::poke(set, x, y);
+}
+
+boolean CatalogBitmap::peek (int x, int y) const {
+    Load();
+    return Bitmap::peek(x, y);
+}
+
+void CatalogBitmap::poke_bits (
+    int x, int y, int count, const unsigned char* bits
+) {
+    Load();
+    Bitmap::poke_bits(x, y, count, bits);
+}
+
+void CatalogBitmap::peek_bits (
+    int x, int y, int count, unsigned char* bits
+) const {
+    Load();
+    Bitmap::peek_bits(x, y, count, bits);
+}
+
+void CatalogBitmap::flush () const {
+    Load();
+    Bitmap::flush();
+}
+
+CatalogRaster::CatalogRaster (
+    unsigned long width, unsigned long height
+) : Raster(width, height) {
+    _rows = nil;
+}
+
+CatalogRaster::~CatalogRaster () {
+    if (_rows != nil) {
+        _rows->Forget();
+    }
+}
+
+void CatalogRaster::Load () const {
+    if (_rows != nil) {
+        _rows->Load();
+    }
+}
+
+void CatalogRaster::peek (
+    unsigned long x, unsigned long y,
+    ColorIntensity& red, ColorIntensity& green, ColorIntensity& blue,
+    float& alpha
+) const {
+    Load();
+    Raster::peek(x, y, red, green, blue, alpha);
+}
+
+void CatalogRaster::poke (
+    unsigned long x, unsigned long y,
+    ColorIntensity red, ColorIntensity green, ColorIntensity blue,
+    float alpha
+) {
+    Load();
+    Raster::poke(x, y, red, green, blue, alpha);
+}
+
+void CatalogRaster::peek_pixels (
+    unsigned long x, unsigned long y,
+    unsigned long width, unsigned long height,
+    unsigned char* pixels, PixelFormat format, long stride
+) const {
+    Load();
+    Raster::peek_pixels(x, y, width, height, pixels, format, stride);
+}
+
+void CatalogRaster::poke_pixels (
+    unsigned long x, unsigned long y,
+    unsigned long width, unsigned long height,
+    const unsigned char* pixels, PixelFormat format, long stride
+) {
+    Load();
+    Raster::poke_pixels(x, y, width, height, pixels, format, stride);
+}
+
+void CatalogRaster::flush () const {
+    Load();
+    Raster::flush();
 }
 
 /*****************************************************************************/
@@ -281,6 +928,11 @@ Catalog::Catalog (const char* domainName, Creator* creator, float version) {
 
     _curMap = nil;
     _substMap = new ObjectMap(nil, COMPONENT);
+    _binary = false;
+    _fileFormat = 0;
+    _inRefs = _outRefs = nil;
+    _lazy = false;
+    _inFile = nil;
     _clipboard = new Clipboard;
 #if defined(__xlC__) || defined(__GNUG__)
     _tmpfile = nil;
@@ -297,6 +949,15 @@ void Catalog::Init (World* w) {
     const char* fg = GetAttribute("foreground");
     const char* bg = GetAttribute("background");
     const char* font = GetAttribute("font");
+    const char* format = GetAttribute("catalogFormat");
+    const char* lazy = GetAttribute("catalogLazy");
+
+    if (format != nil) {
+        _binary = strcmp(format, "binary") == 0;
+    }
+    if (lazy != nil) {
+        _lazy = strcmp(lazy, "true") == 0;
+    }
 
     pssingle = FindBrush(0xffff, 0);
     psnonebr = FindNoneBrush();
@@ -575,6 +1236,8 @@ Tool* Catalog::Copy (Tool* tool) { return (Tool*) CopyObject(tool, TOOL); }
 
 void Catalog::SetClipboard (Clipboard* o) { _clipboard = o; }
 void Catalog::SetEditorInfo (EditorInfo* o) { _edInfo = o; }
+void Catalog::SetBinary (boolean binary) { _binary = binary; }
+void Catalog::SetLazy (boolean lazy) { _lazy = lazy; }
 
 const char* Catalog::GetName (EditorInfo* edInfo) {
     return _edInfoMap->GetName(edInfo);
@@ -667,6 +1330,62 @@ void Catalog::ReadExtraData (
     }
 }
 
+/*
+ * In the binary format a brush, color, font, or pattern is written in
+ * full only where it first appears; after that its index stands for it.
+ * ReadRef returns false when the full text form follows, which the
+ * caller reads and then passes to DefineRef.
+ */
+
+boolean Catalog::ReadRef (istream& in, void*& obj) {
+    if (_inRefs == nil) {
+        return false;
+    }
+    long ref = GetInt(in);
+
+    if (ref == 1) {
+        return false;
+    }
+    obj = (ref == 0) ? nil : _inRefs->Get(int(ref - 2));
+    return true;
+}
+
+void Catalog::DefineRef (void* obj) {
+    if (_inRefs != nil) {
+        _inRefs->Add(obj);
+    }
+}
+
+boolean Catalog::WriteRef (void* obj, ostream& out) {
+    if (_outRefs == nil) {
+        return false;
+
+    } else if (obj == nil) {
+        PutInt(0, out);
+        return true;
+    }
+    int ref = _outRefs->Find(obj);
+
+    if (ref < 0) {
+        _outRefs->Define(obj);
+        PutInt(1, out);
+        return false;
+    }
+    PutInt(ref + 2, out);
+    return true;
+}
+
+/*
+ * Images can wait only in an indexed binary file being read lazily.
+ */
+
+CatalogFile* Catalog::LazyFile (istream& in) {
+    boolean lazy =
+        _inFile != nil && &in == &_inFile->Stream() &&
+        _inRefs != nil && _fileFormat >= UV_BINARY_INDEXED;
+    return lazy ? _inFile : nil;
+}
+
 void* Catalog::CopyObject (void* obj, ClassId base_id) {
     void* copy = nil;
 
@@ -847,20 +1566,42 @@ void Catalog::WriteObject (void* obj, ClassId base_id, ostream& out) {
 }    
 
 boolean Catalog::SaveObject (void* obj, ClassId base_id, ostream& out) {
+    CatalogRefs* prevRefs = _outRefs;
+    _outRefs = _binary ? new CatalogRefs : nil;
+
     WriteVersion(_version, out);
     WriteObject(obj, base_id, out);
     csolver->Write(out);
+
+    delete _outRefs;
+    _outRefs = prevRefs;
     return out.good();
 }    
 
 boolean Catalog::RetrieveObject (istream& in, void*& obj) {
+    CatalogRefs* prevRefs = _inRefs;
+    _inRefs = nil;
+    _fileFormat = 0;
     _fileVersion = ReadVersion(in);
+
+    if (_fileFormat > UV_BINARY_LATEST) {
+        _inRefs = prevRefs;
+        obj = nil;
+        return false;
+    }
+    _inRefs = (_fileFormat > 0) ? new CatalogRefs : nil;
+
     obj = ReadObject(in);
     csolver->Read(in);
+
+    delete _inRefs;
+    _inRefs = prevRefs;
     return in.good();
 }
 
 boolean Catalog::FileSave (void* obj, ClassId base_id, const char* name) {
+    CatalogFile::LoadAll(name);
+
     filebuf fbuf;
     boolean ok = fbuf.open((char*) name, IOS_OUT) != 0;
 
@@ -872,11 +1613,25 @@ boolean Catalog::FileSave (void* obj, ClassId base_id, const char* name) {
 }    
 
 boolean Catalog::FileRetrieve (const char* name, void*& obj) {
-    filebuf fbuf;
-    boolean ok = fbuf.open((char*) name, IOS_IN) != 0;
+    if (_lazy) {
+        CatalogFile* file = new CatalogFile;
+        file->ref();
+        boolean ok = file->Open(name);
+
+        if (ok) {
+            CatalogFile* prevFile = _inFile;
+            _inFile = file;
+            ok = RetrieveObject(file->Stream(), obj);
+            _inFile = prevFile;
+        }
+        file->unref();
+        return ok;
+    }
+    UScanner scanner(name);
+    boolean ok = scanner.Valid();
 
     if (ok) {
-        istream in(&fbuf);
+        istream in(&scanner);
         ok = RetrieveObject(in, obj);
     }
     return ok;
@@ -929,16 +1684,29 @@ void Catalog::Mark (ostream& out) {
     out << "\n" << MARK << " ";
 }
 
+/*
+ * A binary file's version is followed by the revision of the binary
+ * format; everything after that is read with the binary format in effect.
+ */
+
 float Catalog::ReadVersion (istream& in) {
     float version;
 
     Skip(in);
-    in >> buf >> version;
+    in >> buf >> version >> ws;
+
+    if (in.peek() == 'b') {
+        in >> buf >> _fileFormat;
+    }
     return version;
 }
 
 void Catalog::WriteVersion (float version, ostream& out) {
     out << MARK << " Unidraw " << version << " ";
+
+    if (_outRefs != nil) {
+        out << "binary " << UV_BINARY_LATEST << " ";
+    }
 }
 
 ClassId Catalog::ReadClassId (
@@ -948,7 +1716,19 @@ ClassId Catalog::ReadClassId (
 
     Skip(in);
 
-    if (FileVersion() < UV_ORIGINAL) {
+    if (_inRefs != nil) {
+        classId = GetInt(in);
+        id = int(GetInt(in));
+        subst_id = (ClassId) GetInt(in);
+
+        if (subst_id != UNDEFINED_CLASS) {
+            int n = Math::min(int(GetInt(in)), CHARBUFSIZE - 1);
+            in.read(buf, Math::max(n, 0));
+            buf[Math::max(n, 0)] = '\0';
+            delim = buf;
+        }
+
+    } else if (FileVersion() < UV_ORIGINAL) {
         in >> classId >> id;
         subst_id = UNDEFINED_CLASS;
 
@@ -971,10 +1751,24 @@ void Catalog::WriteClassId (
     const char* delim
 ) {
     Mark(out);
-    out << classId << " " << inst_id << " " << subst_id << " ";
 
-    if (subst_id != UNDEFINED_CLASS) {
-        out << delim << " ";
+    if (_outRefs != nil) {
+        PutInt(classId, out);
+        PutInt(inst_id, out);
+        PutInt(subst_id, out);
+
+        if (subst_id != UNDEFINED_CLASS) {
+            int n = strlen(delim);
+            PutInt(n, out);
+            out.write(delim, n);
+        }
+
+    } else {
+        out << classId << " " << inst_id << " " << subst_id << " ";
+
+        if (subst_id != UNDEFINED_CLASS) {
+            out << delim << " ";
+        }
     }
 }
 
@@ -1015,6 +1809,18 @@ Transformer* Catalog::ReadTransformer (istream& in) {
     char lookahead;
 
     Skip(in);
+
+    if (_inRefs != nil) {
+        if (GetInt(in) != 0) {
+            float a[6];
+
+            for (int i = 0; i < 6; ++i) {
+                a[i] = GetFloat(in);
+            }
+            t = new Transformer(a[0], a[1], a[2], a[3], a[4], a[5]);
+        }
+        return t;
+    }
     in >> buf;
 
     if (buf[0] == 't') {
@@ -1032,6 +1838,20 @@ Transformer* Catalog::ReadTransformer (istream& in) {
 
 void Catalog::WriteTransformer (Transformer* t, ostream& out) {
     Mark(out);
+
+    if (_outRefs != nil) {
+        PutInt(t == nil ? 0 : 1, out);
+
+        if (t != nil) {
+            float a[6];
+            t->GetEntries(a[0], a[1], a[2], a[3], a[4], a[5]);
+
+            for (int i = 0; i < 6; ++i) {
+                PutFloat(a[i], out);
+            }
+        }
+        return;
+    }
     out << "t ";
 
     if (t == nil) {
@@ -1047,6 +1867,10 @@ void Catalog::WriteTransformer (Transformer* t, ostream& out) {
 
 void Catalog::WriteBrush (PSBrush* brush, ostream& out) {
     Mark(out);
+
+    if (WriteRef(brush, out)) {
+        return;
+    }
     out << "b ";
 
     if (brush == nil) {
@@ -1066,6 +1890,10 @@ PSBrush* Catalog::ReadBrush (istream& in) {
     PSBrush* brush = nil;
 
     Skip(in);
+
+    if (ReadRef(in, (void*&) brush)) {
+        return brush;
+    }
     in >> buf;
 
     if (buf[0] == 'b') {
@@ -1098,6 +1926,7 @@ PSBrush* Catalog::ReadBrush (istream& in) {
             }
         }
     }
+    DefineRef(brush);
     return brush;
 }
 
@@ -1162,6 +1991,10 @@ PSBrush* Catalog::ReadBrush (const char* n, int index) {
 
 void Catalog::WriteColor (PSColor* color, ostream& out) {
     Mark(out);
+
+    if (WriteRef(color, out)) {
+        return;
+    }
     out << "c ";
 
     if (color == nil) {
@@ -1186,6 +2019,10 @@ PSColor* Catalog::ReadColor (istream& in) {
     PSColor* color = nil;
 
     Skip(in);
+
+    if (ReadRef(in, (void*&) color)) {
+        return color;
+    }
     in >> buf;
 
     if (buf[0] == 'c') {
@@ -1211,6 +2048,7 @@ PSColor* Catalog::ReadColor (istream& in) {
             color = FindColor(name, ir, ig, ib);
         }
     }
+    DefineRef(color);
     return color;
 }
 
@@ -1261,6 +2099,10 @@ PSColor* Catalog::ReadColor (const char* n, int index) {
 
 void Catalog::WriteFont (PSFont* font, ostream& out) {
     Mark(out);
+
+    if (WriteRef(font, out)) {
+        return;
+    }
     out << "f ";
 
     if (font == nil) {
@@ -1290,6 +2132,10 @@ PSFont* Catalog::ReadFont (istream& in) {
     PSFont* font = nil;
 
     Skip(in);
+
+    if (ReadRef(in, (void*&) font)) {
+        return font;
+    }
     in >> buf;
 
     if (buf[0] == 'f') {
@@ -1314,6 +2160,7 @@ PSFont* Catalog::ReadFont (istream& in) {
             font = FindFont(name, &printfont[1], printsize);
         }
     }
+    DefineRef(font);
     return font;
 }
 
@@ -1441,6 +2288,10 @@ static const int* ExpandToFullSize (const int* orig_data, int size) {
 
 void Catalog::WritePattern (PSPattern* pattern, ostream& out) {
     Mark(out);
+
+    if (WriteRef(pattern, out)) {
+        return;
+    }
     out << "p ";
 
     if (pattern == nil) {
@@ -1479,6 +2330,10 @@ PSPattern* Catalog::ReadPattern (istream& in) {
     PSPattern* pattern = nil;
 
     Skip(in);
+
+    if (ReadRef(in, (void*&) pattern)) {
+        return pattern;
+    }
     in >> buf;
 
     if (buf[0] == 'p') {
@@ -1534,6 +2389,7 @@ PSPattern* Catalog::ReadPattern (istream& in) {
             }
         }
     }
+    DefineRef(pattern);
     return pattern;
 }
 
@@ -1650,6 +2506,26 @@ char* Catalog::ReadString (istream& in) {
     char* string = nil;
 
     Skip(in);
+
+    if (_inRefs != nil) {
+        long ref = GetInt(in);
+
+        if (ref == 1) {
+            count = int(GetInt(in));
+
+            if (count >= 0) {
+                string = new char[count+1];
+                in.read(string, count);
+                string[count] = '\0';
+                _inRefs->Add(string);
+            }
+
+        } else if (ref > 1) {
+            const char* s = (const char*) _inRefs->Get(int(ref - 2));
+            string = (s == nil) ? nil : strnew(s);
+        }
+        return string;
+    }
     in >> count;
     
     if (count >= 0) {
@@ -1665,7 +2541,24 @@ char* Catalog::ReadString (istream& in) {
 void Catalog::WriteString (const char* string, ostream& out) {
     Mark(out);
 
-    if (string == nil) {
+    if (_outRefs != nil) {
+        int ref = (string == nil) ? -1 : _outRefs->Find(string);
+
+        if (string == nil) {
+            PutInt(0, out);
+
+        } else if (ref < 0) {
+            int count = strlen(string);
+            _outRefs->Define(string);
+            PutInt(1, out);
+            PutInt(count, out);
+            out.write(string, count);
+
+        } else {
+            PutInt(ref + 2, out);
+        }
+
+    } else if (string == nil) {
         out << -1;
     } else {
         out << strlen(string) << "\"" << string << "\"";
@@ -1677,31 +2570,47 @@ Bitmap* Catalog::ReadBitmap (istream& in) {
     Coord w, h;
     in >> w >> h;
 
-    Bitmap* bitmap = new Bitmap((void*) nil, w, h);
-    ReadBitmapData(bitmap, in);
+    CatalogFile* file = LazyFile(in);
+    Bitmap* bitmap;
 
+    if (file != nil) {
+        CatalogBitmap* b = new CatalogBitmap(w, h);
+        Skip(in);
+        b->_rows = file->Defer(b, CatalogRows::bitmap, in);
+        bitmap = b;
+
+    } else {
+        bitmap = new Bitmap((void*) nil, w, h);
+        ReadBitmapData(bitmap, in);
+    }
     return bitmap;
 }
 
 void Catalog::ReadBitmapData (Bitmap* bitmap, istream& in) {
     Coord w = bitmap->Width();
     Coord h = bitmap->Height();
-    
-    for (int j = h-1; j >= 0; --j) { 
+    int nbits = int(w);
+    int nbytes = (nbits + 7) / 8;
+    unsigned char* bits = new unsigned char[nbytes + 1];
+
+    if (_inRefs != nil) {
         Skip(in);
 
-        for (int k = 0; k < w; k += 4) {
-            char hexchar;
-            in >> hexchar;
-            unsigned int val = hexintmap[hexchar];
+        if (_fileFormat >= UV_BINARY_INDEXED) {
+            GetInt(in);
+        }
+        GetBitmapRows(bitmap, in);
+
+    } else {
+        for (int j = h-1; j >= 0; --j) { 
+            Skip(in);
 
-	    int i = k;
-	    if (i < w) bitmap->poke(val & 0x8, i++, j);
-	    if (i < w) bitmap->poke(val & 0x4, i++, j);
-	    if (i < w) bitmap->poke(val & 0x2, i++, j);
-	    if (i < w) bitmap->poke(val & 0x1, i,   j);
+            int n = UScanner::GetHex(in.rdbuf(), bits, nbytes);
+            Memory::zero(&bits[n], nbytes - n);
+            bitmap->poke_bits(0, j, nbits, bits);
         }
     }
+    delete [] bits;
     bitmap->flush();
 }
 
@@ -1718,26 +2627,37 @@ void Catalog::WriteBitmap (Bitmap* bitmap, ostream& out) {
 void Catalog::WriteBitmapData (Bitmap* bitmap, ostream& out) {
     Coord w = bitmap->Width();
     Coord h = bitmap->Height();
+    int nbits = int(w);
+    int nbytes = (nbits + 7) / 8;
+    unsigned char* bits = new unsigned char[nbytes + 1];
 
-    for (int j = h-1; j >= 0; --j) {
+    if (_outRefs != nil) {
+        CatalogBlocks blocks(nbytes);
         Mark(out);
 
-	int nybbles = 0;
-        for (int k = 0; k < w; k += 4) {
-            unsigned int bits = 0;
+        for (int j = h-1; j >= 0; --j) {
+            bitmap->peek_bits(0, j, nbits, bits);
+            blocks.Add(bits);
+        }
+        blocks.Write(out);
 
-            for (int i = k; i < k+4 && k < w; ++i) {
-                unsigned int val = bitmap->peek(i, j);
-                int pos = 3 - i % 4;
-                bits |= val << pos;
+    } else {
+        for (int j = h-1; j >= 0; --j) {
+            Mark(out);
+            bitmap->peek_bits(0, j, nbits, bits);
+
+            int nybbles = 0;
+            for (int k = 0; k < nbits; k += 4) {
+                unsigned int byte = bits[k / 8];
+                out << hexcharmap[k % 8 == 0 ? byte >> 4 : byte & 0xf];
+                ++nybbles;
+            }
+            if (nybbles%2 != 0) {
+                out << '0';
             }
-            out << hexcharmap[bits];
-            ++nybbles;
         }
-	if (nybbles%2 != 0) {
-	    out << '0';
-	}
     }
+    delete [] bits;
 }
 
 Raster* Catalog::ReadGraymap (istream& in) {
@@ -1745,29 +2665,45 @@ Raster* Catalog::ReadGraymap (istream& in) {
     Coord w, h;
     in >> w >> h;
 
-    Raster* raster = new Raster(w, h);
-    ReadGraymapData(raster, in);
+    CatalogFile* file = LazyFile(in);
+    Raster* raster;
 
+    if (file != nil) {
+        CatalogRaster* r = new CatalogRaster(w, h);
+        Skip(in);
+        r->_rows = file->Defer(r, CatalogRows::graymap, in);
+        raster = r;
+
+    } else {
+        raster = new Raster(w, h);
+        ReadGraymapData(raster, in);
+    }
     return raster;
 }
 
 void Catalog::ReadGraymapData (Raster* raster, istream& in) {
     Coord w = raster->Width();
     Coord h = raster->Height();
-    ColorIntensity g;
-
-    char enc[hex_gray_encode+1];
-    enc[hex_gray_encode] = '\0';
+    unsigned char* pixels = new unsigned char[int(w)];
 
-    for (int j = h-1; j >= 0; --j) {
+    if (_inRefs != nil) {
         Skip(in);
 
-        for (int i = 0; i < w; ++i) {
-            in.get(enc, hex_gray_encode+1);
-            HexGrayDecode(enc, g);
-            raster->poke(i, j, g, g, g, 1);
+        if (_fileFormat >= UV_BINARY_INDEXED) {
+            GetInt(in);
+        }
+        GetRasterRows(raster, Raster::gray8, in);
+
+    } else {
+        for (int j = h-1; j >= 0; --j) {
+            Skip(in);
+
+            int n = UScanner::GetHex(in.rdbuf(), pixels, int(w));
+            Memory::zero(&pixels[n], int(w) - n);
+            raster->poke_pixels(0, j, int(w), 1, pixels, Raster::gray8);
         }
     }
+    delete [] pixels;
     raster->flush();
 }
 
@@ -1784,17 +2720,41 @@ void Catalog::WriteGraymap (Raster* raster, ostream& out) {
 void Catalog::WriteGraymapData (Raster* raster, ostream& out) {
     Coord w = raster->Width();
     Coord h = raster->Height();
-    ColorIntensity r, g, b;
-    float alpha;
+    unsigned char* pixels = new unsigned char[int(w) * 3];
 
-    for (int j = h-1; j >= 0; --j) {
+    if (_outRefs != nil) {
+        CatalogBlocks blocks((int) w);
         Mark(out);
 
-        for (int i = 0; i < w; ++i) {
-            raster->peek(i, j, r, g, b, alpha);
-            out << HexGrayEncode(r, g, b);
+        for (int j = h-1; j >= 0; --j) {
+            raster->peek_pixels(0, j, int(w), 1, pixels, Raster::rgb8);
+
+            unsigned char* p = pixels;
+            for (int i = 0; i < w; ++i, p += 3) {
+                pixels[i] = GrayLevel(
+                    float(p[0]) / color_base, float(p[1]) / color_base,
+                    float(p[2]) / color_base
+                );
+            }
+            blocks.Add(pixels);
+        }
+        blocks.Write(out);
+
+    } else {
+        for (int j = h-1; j >= 0; --j) {
+            Mark(out);
+            raster->peek_pixels(0, j, int(w), 1, pixels, Raster::rgb8);
+
+            unsigned char* p = pixels;
+            for (int i = 0; i < w; ++i, p += 3) {
+                out << HexGrayEncode(
+                    float(p[0]) / color_base, float(p[1]) / color_base,
+                    float(p[2]) / color_base
+                );
+            }
         }
     }
+    delete [] pixels;
 }
 
 Raster* Catalog::ReadRaster (istream& in) {
@@ -1802,29 +2762,45 @@ Raster* Catalog::ReadRaster (istream& in) {
     Coord w, h;
     in >> w >> h;
 
-    Raster* raster = new Raster(w, h);
-    ReadRasterData(raster, in);
+    CatalogFile* file = LazyFile(in);
+    Raster* raster;
+
+    if (file != nil) {
+        CatalogRaster* r = new CatalogRaster(w, h);
+        Skip(in);
+        r->_rows = file->Defer(r, CatalogRows::raster, in);
+        raster = r;
 
+    } else {
+        raster = new Raster(w, h);
+        ReadRasterData(raster, in);
+    }
     return raster;
 }
 
 void Catalog::ReadRasterData (Raster* raster, istream& in) {
     Coord w = raster->Width();
     Coord h = raster->Height();
-    ColorIntensity r, g, b;
-    
-    char enc[hex_encode+1];
-    enc[hex_encode] = '\0';
+    unsigned char* pixels = new unsigned char[int(w) * 3];
 
-    for (int j = h-1; j >= 0; --j) {
+    if (_inRefs != nil) {
         Skip(in);
 
-        for (int i = 0; i < w; ++i) {
-            in.get(enc, hex_encode+1);
-            HexDecode(enc, r, g, b);
-            raster->poke(i, j, r, g, b, 1);
+        if (_fileFormat >= UV_BINARY_INDEXED) {
+            GetInt(in);
+        }
+        GetRasterRows(raster, Raster::rgb8, in);
+
+    } else {
+        for (int j = h-1; j >= 0; --j) {
+            Skip(in);
+
+            int n = UScanner::GetHex(in.rdbuf(), pixels, int(w) * 3);
+            Memory::zero(&pixels[n], int(w) * 3 - n);
+            raster->poke_pixels(0, j, int(w), 1, pixels, Raster::rgb8);
         }
     }
+    delete [] pixels;
     raster->flush();
 }
 
@@ -1841,17 +2817,33 @@ void Catalog::WriteRaster (Raster* raster, ostream& out) {
 void Catalog::WriteRasterData (Raster* raster, ostream& out) {
     Coord w = raster->Width();
     Coord h = raster->Height();
-    ColorIntensity r, g, b;
-    float alpha;
+    unsigned char* pixels = new unsigned char[int(w) * 3];
 
-    for (int j = h-1; j >= 0; --j) {
+    if (_outRefs != nil) {
+        CatalogBlocks blocks(int(w) * 3);
         Mark(out);
 
-        for (int i = 0; i < w; ++i) {
-            raster->peek(i, j, r, g, b, alpha);
-            out << HexEncode(r, g, b);
+        for (int j = h-1; j >= 0; --j) {
+            raster->peek_pixels(0, j, int(w), 1, pixels, Raster::rgb8);
+            blocks.Add(pixels);
+        }
+        blocks.Write(out);
+
+    } else {
+        for (int j = h-1; j >= 0; --j) {
+            Mark(out);
+            raster->peek_pixels(0, j, int(w), 1, pixels, Raster::rgb8);
+
+            unsigned char* p = pixels;
+            for (int i = 0; i < w; ++i, p += 3) {
+                out << HexEncode(
+                    float(p[0]) / color_base, float(p[1]) / color_base,
+                    float(p[2]) / color_base
+                );
+            }
         }
     }
+    delete [] pixels;
 }
 
 ControlInfo* Catalog::ReadControlInfo (istream& in) {
@@ -2015,7 +3007,7 @@ inline UArray* ObjectMapElem::GetExtraData () { return _extra_data; }
 
 /*****************************************************************************/
 
-static const int SLOTS = 1000;
+static const int SLOTS = 64;
 
 /*****************************************************************************/
 
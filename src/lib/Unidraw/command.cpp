@@ -37,20 +37,34 @@
 #include <Unidraw/iterator.h>
 #include <Unidraw/selection.h>
 #include <Unidraw/uhash.h>
+#include <Unidraw/ulist.h>
 #include <Unidraw/unidraw.h>
 #include <Unidraw/viewer.h>
 
 #include <Unidraw/Components/grcomp.h>
 #include <Unidraw/Components/grview.h>
+#include <Unidraw/Components/rastercomp.h>
+#include <Unidraw/Components/stencilcomp.h>
+#include <Unidraw/Components/vertices.h>
 
 #include <Unidraw/Commands/command.h>
 #include <Unidraw/Commands/datas.h>
 
+#include <Unidraw/Graphic/rasterrect.h>
+#include <Unidraw/Graphic/ustencil.h>
+#include <Unidraw/Graphic/verts.h>
+
+#include <InterViews/bitmap.h>
+#include <InterViews/raster.h>
+
 #include <IV-2_6/_enter.h>
 
 /*****************************************************************************/
 
-static const int DATACACHE_SIZE = 255;
+static const int DATACACHE_SIZE = 16;
+static const int DATA_SIZE = 256;       /* a Data and the state it copies */
+static const int COMP_SIZE = 256;       /* a component and its graphic */
+static const int RASTER_PIXEL_SIZE = 4;  /* bytes per raster pixel */
 
 /*****************************************************************************/
 
@@ -115,6 +129,49 @@ DataElem* DataCache::Find (Component* comp) {
 
 /*****************************************************************************/
 
+/*
+ * Estimates the memory a component and its children hold: a fixed
+ * amount for the component and its graphic, plus the vertices, bitmaps
+ * and rasters it keeps.  Image sizes come from their dimensions, so
+ * images the catalog has yet to read stay unread.
+ */
+
+static long CompSize (GraphicComp* comp) {
+    long size = COMP_SIZE;
+
+    if (comp->IsA(VERTICES_COMP)) {
+        const Coord* x, *y;
+        int n = ((VerticesComp*) comp)->GetVertices()->GetOriginal(x, y);
+        size += 2 * n * sizeof(Coord);
+
+    } else if (comp->IsA(STENCIL_COMP)) {
+        Bitmap* image, *mask;
+        ((StencilComp*) comp)->GetStencil()->GetOriginal(image, mask);
+
+        if (image != nil) {
+            size += long((image->pwidth() + 7) / 8) * image->pheight();
+        }
+        if (mask != nil && mask != image) {
+            size += long((mask->pwidth() + 7) / 8) * mask->pheight();
+        }
+
+    } else if (comp->IsA(RASTER_COMP)) {
+        Raster* r = ((RasterComp*) comp)->GetRasterRect()->GetOriginal();
+
+        if (r != nil) {
+            size += long(r->pwidth() * r->pheight() * RASTER_PIXEL_SIZE);
+        }
+    }
+    Iterator i;
+
+    for (comp->First(i); !comp->Done(i); comp->Next(i)) {
+        size += CompSize(comp->GetComp(i));
+    }
+    return size;
+}
+
+/*****************************************************************************/
+
 ClassId Command::GetClassId () { return COMMAND; }
 ClassId Command::GetSubstId (const char*&) { return UNDEFINED_CLASS; }
 boolean Command::IsA (ClassId id) { return COMMAND == id; }
@@ -287,6 +344,32 @@ boolean Command::Reversible () {
 
 void Command::Log () { unidraw->Log(this); }
 
+/*
+ * Count the undo data and the clipboard, including an estimate of any
+ * components the command keeps outside a document.
+ */
+
+long Command::Size () {
+    long size = sizeof(Command);
+
+    if (_cache != nil) {
+        size += _cache->Count() * (sizeof(DataElem) + DATA_SIZE);
+    }
+    if (_clipboard != nil) {
+        Iterator i;
+
+        for (_clipboard->First(i); !_clipboard->Done(i); _clipboard->Next(i)) {
+            GraphicComp* comp = _clipboard->GetComp(i);
+
+            if (comp->GetParent() == nil) {
+                size += CompSize(comp);
+            }
+            size += sizeof(UList);
+        }
+    }
+    return size;
+}
+
 ControlInfo* Command::CopyControlInfo () {
     ControlInfo* ci = GetControlInfo();
     return (ci == nil) ? nil : ci->Copy();
@@ -51,6 +51,11 @@
 #include <math.h>
 #include <string.h>
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define CS_THREADS
+#include <pthread.h>
+#endif
+
 /*****************************************************************************/
 
 class CSGlue {
@@ -186,7 +191,7 @@ public:
     void ApplyToSeries(CCnxn*, CCnxn*);
     void ApplyToParallel(CCnxn*, CCnxn*);
     void ApplyToY(CCnxn* eqb, CCnxn* eqc, CCnxn* ca, CCnxn* cb, CCnxn* cc);
-    void ApplyNatural();
+    void ApplyNatural(float lbCenter, float rtCenter);
 
     void Limit();
     void Reverse();
@@ -194,6 +199,9 @@ public:
     boolean Contains(Connector*);
     virtual float GetCenter(Connector*);
 
+    void Record();
+    boolean Moved();
+
     virtual CCnxn* Copy();
     void Read(istream&);
     void Write(ostream&);
@@ -201,6 +209,8 @@ public:
     Connector* _lbConn, *_rtConn;
     CSGlue* _glue;
     float _pos, _deform;
+    float _lbAt, _rtAt;                 /* centers when last solved */
+    boolean _lbFixed, _rtFixed;         /* mobilities when last solved */
 };
 
 inline void CCnxn::Limit () { 
@@ -226,6 +236,8 @@ CCnxn::CCnxn (Connector* lb, Connector* rt, CSGlue* g) {
     _rtConn = rt;
     _glue = g;
     _pos = _deform = 0;
+    _lbAt = _rtAt = 0;
+    _lbFixed = _rtFixed = false;
 }
 
 CCnxn::~CCnxn () { delete _glue; }
@@ -299,17 +311,17 @@ void CCnxn::ApplyToY (CCnxn*, CCnxn* eqc, CCnxn* ca, CCnxn* cb, CCnxn* cc) {
     cb->_pos = cc->_pos = ca->_pos + ca->_glue->_natural + ca->_deform;
 }
 
-void CCnxn::ApplyNatural () {
+void CCnxn::ApplyNatural (float lbCenter, float rtCenter) {
     if (IsFixed()) {
-        _pos = GetCenter(_lbConn);
-        _deform = GetCenter(_rtConn) - _pos - _glue->_natural;
+        _pos = lbCenter;
+        _deform = rtCenter - _pos - _glue->_natural;
 
     } else {
         _deform = 0;
         if (_rtConn->GetMobility() == Fixed) {
-            _pos = GetCenter(_rtConn) - _glue->_natural;
+            _pos = rtCenter - _glue->_natural;
         } else {
-            _pos = GetCenter(_lbConn);
+            _pos = lbCenter;
         }
     }
 }
@@ -330,6 +342,26 @@ boolean CCnxn::IsFixed () {
 boolean CCnxn::Contains (Connector* c) { return _lbConn == c || _rtConn == c; }
 float CCnxn::GetCenter (Connector*) { return 0; }
 
+void CCnxn::Record () {
+    _lbAt = GetCenter(_lbConn);
+    _rtAt = GetCenter(_rtConn);
+    _lbFixed = _lbConn->GetMobility() == Fixed;
+    _rtFixed = _rtConn->GetMobility() == Fixed;
+}
+
+/*
+ * A solution depends only on the network's topology and glue, which
+ * CSolver tracks, and on the position and mobility of its connectors,
+ * which can change behind its back.
+ */
+
+boolean CCnxn::Moved () {
+    return
+        GetCenter(_lbConn) != _lbAt || GetCenter(_rtConn) != _rtAt ||
+        (_lbConn->GetMobility() == Fixed) != _lbFixed ||
+        (_rtConn->GetMobility() == Fixed) != _rtFixed;
+}
+
 void CCnxn::Read (istream& in) {
     Catalog* cat = unidraw->GetCatalog();
 
@@ -434,11 +466,16 @@ public:
     virtual CNet* CreateNetwork(CCnxn* = nil);
     boolean Includes(Connector*);
     boolean IsDegenerate();
+
+    void Record();
+    boolean Moved();
+public:
+    boolean _changed;                   /* must be solved and updated */
 protected:
     CNet(CCnxn* = nil);
 };
 
-CNet::CNet (CCnxn* c) : UList(c) { }
+CNet::CNet (CCnxn* c) : UList(c) { _changed = true; }
 inline CCnxn* CNet::Cnxn () { return (CCnxn*) _object; }
 inline CNet* CNet::First () { return (CNet*) UList::First(); }
 inline CNet* CNet::Last () { return (CNet*) UList::Last(); }
@@ -461,6 +498,22 @@ CNet* CNet::CreateNetwork (CCnxn*) { return nil; }
 void CNet::Append (CNet* nw) { UList::Append(nw); }
 void CNet::Remove (CNet* nw) { UList::Remove(nw); }
 
+void CNet::Record () {
+    for (CNet* nw = First(); nw != End(); nw = nw->Next()) {
+        nw->Cnxn()->Record();
+    }
+    _changed = false;
+}
+
+boolean CNet::Moved () {
+    for (CNet* nw = First(); nw != End(); nw = nw->Next()) {
+        if (nw->Cnxn()->Moved()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 boolean CNet::Includes (Connector* c) {
     for (CNet* nw = First(); nw != End(); nw = nw->Next()) {
         CCnxn* cnxn = nw->Cnxn();
@@ -512,7 +565,7 @@ CCnxn* VNet::CreateCnxn (Connector* lb, Connector* rt, CSGlue* g) {
 
 /*****************************************************************************/
 
-static const int SLOTS = 1000;
+static const int SLOTS = 64;
 
 /*****************************************************************************/
 
@@ -565,45 +618,18 @@ inline void CU_HashElem::SetY (float py) { _py = py; }
 
 class CS_HashTable : public UHashTable {
 public:
-    virtual ~CS_HashTable();
-
-    void First(Iterator&);
-    void Next(Iterator&);
-    boolean Done(Iterator);
     void Remove(Iterator&);
-    UHashElem* GetElem(Iterator);
-
-    virtual void Register(void* key, UHashElem* = nil);
 protected:
     CS_HashTable();
-    UList* ULElem(Iterator);
-    UHashElem* Elem(UList*);
-private:
-    UList* _elems;
 };
 
-UHashElem* CS_HashTable::Elem (UList* r) { return (UHashElem*) (*r)(); }
-UList* CS_HashTable::ULElem (Iterator i) { return (UList*) i.GetValue(); }
-boolean CS_HashTable::Done (Iterator i) { return ULElem(i) == _elems->End(); }
-void CS_HashTable::First (Iterator& i) { i.SetValue(_elems->First()); }
-void CS_HashTable::Next (Iterator& i) { i.SetValue(ULElem(i)->Next()); }
-UHashElem* CS_HashTable::GetElem (Iterator i) { return Elem(ULElem(i)); }
-
-void CS_HashTable::Remove (Iterator& i) {
-    UList* doomed = ULElem(i);
-    Next(i);
-    _elems->Remove(doomed);
-    delete doomed;
-}
-
-CS_HashTable::CS_HashTable () : UHashTable(SLOTS) { _elems = new UList; }
-CS_HashTable::~CS_HashTable () { delete _elems; }
+/*
+ * UHashTable iterates in registration order, which keeps the solver's
+ * output stable.
+ */
 
-void CS_HashTable::Register (void* key, UHashElem* elem) {
-    UHashTable::Register(key, elem);
-    elem = (elem == nil) ? Find(key) : elem;
-    _elems->Append(new UList(elem));
-}
+CS_HashTable::CS_HashTable () : UHashTable(SLOTS) { }
+void CS_HashTable::Remove (Iterator& i) { Unregister(i); }
 
 /*****************************************************************************/
 
@@ -803,6 +829,8 @@ public:
     void SetNetwork(CNet*);
     int NumPeers();
     int NumParallels();
+public:
+    float _center;                  // connector's center when solving
 private:
     PeerInfo* Info(UList*);
     UList* Elem(Iterator);
@@ -843,6 +871,7 @@ ConnInfo::ConnInfo (CNet* nw) {
     _net = nw; 
     _peers = new UList; 
     _npeers = _nparallels = 0;
+    _center = 0;
 }
 
 ConnInfo::~ConnInfo () {
@@ -951,6 +980,7 @@ CSolver::CSolver () {
     _vnets = new UList;
     _hwritten = new CCnxn_HashTable;
     _vwritten = new CCnxn_HashTable;
+    _threads = 1;
 }
 
 CSolver::~CSolver () {
@@ -1012,10 +1042,135 @@ void CSolver::Solve () {
     Update();
 }
 
+void CSolver::SetThreads (int threads) {
+    _threads = (threads < 1) ? 1 : threads;
+}
+
+int CSolver::GetThreads () { return _threads; }
+
+/*
+ * Only networks that changed since they were last solved are solved
+ * again; the others keep their connections' positions and deformations.
+ * Connector centers are read here, before solving, because graphics
+ * can't be asked for them from several threads at once.
+ */
+
 void CSolver::SolveAll (UList* nets, Orientation orient) {
-    for (UList* u = nets->First(); u != nets->End(); u = u->Next()) {
-        Solve(Network(u), orient);
+    UList* u;
+    int n = 0;
+
+    for (u = nets->First(); u != nets->End(); u = u->Next()) {
+        CNet* net = Network(u);
+
+        if (net->_changed || net->Moved()) {
+            net->_changed = true;
+            Capture(net, orient);
+            ++n;
+        }
     }
+    if (n == 0) {
+        return;
+    }
+    CNet** work = new CNet*[n];
+    int i = 0;
+
+    for (u = nets->First(); u != nets->End(); u = u->Next()) {
+        CNet* net = Network(u);
+
+        if (net->_changed) {
+            work[i++] = net;
+        }
+    }
+    SolveAll(work, n, orient);
+    delete [] work;
+}
+
+void CSolver::Capture (CNet* net, Orientation orient) {
+    for (CNet* nw = net->First(); nw != net->End(); nw = nw->Next()) {
+        CCnxn* cnxn = nw->Cnxn();
+
+        Info(cnxn->_lbConn, orient)->_center = cnxn->GetCenter(cnxn->_lbConn);
+        Info(cnxn->_rtConn, orient)->_center = cnxn->GetCenter(cnxn->_rtConn);
+    }
+}
+
+float CSolver::Captured (Connector* c, Orientation orient) {
+    return Info(c, orient)->_center;
+}
+
+/*
+ * Networks in one orientation share no connectors, so with more than
+ * one thread they are handed out to workers in turn.  Each network's
+ * solution is the same whichever thread computes it, and CUpdater
+ * applies them all afterwards in list order.  Horizontal and vertical
+ * networks are never solved at the same time, since pseudo-fixed
+ * substitution changes a connector's mobility while it works.
+ */
+
+class CSWork {
+public:
+    CSolver* _solver;
+    CNet** _nets;
+    int _count;
+    int _next;
+    Orientation _orient;
+#ifdef CS_THREADS
+    pthread_mutex_t _lock;
+#endif
+};
+
+void* CSolver::SolveNetworks (void* arg) {
+    CSWork* work = (CSWork*) arg;
+
+    for (;;) {
+        int i;
+#ifdef CS_THREADS
+        pthread_mutex_lock(&work->_lock);
+        i = work->_next++;
+        pthread_mutex_unlock(&work->_lock);
+#else
+        i = work->_next++;
+#endif
+        if (i >= work->_count) {
+            break;
+        }
+        work->_solver->Solve(work->_nets[i], work->_orient);
+    }
+    return nil;
+}
+
+void CSolver::SolveAll (CNet** nets, int n, Orientation orient) {
+    CSWork work;
+    work._solver = this;
+    work._nets = nets;
+    work._count = n;
+    work._next = 0;
+    work._orient = orient;
+
+#ifdef CS_THREADS
+    int nthreads = (n < _threads) ? n : _threads;
+    pthread_t* threads = new pthread_t[nthreads];
+    int started = 0;
+
+    pthread_mutex_init(&work._lock, nil);
+
+    for (; started < nthreads - 1; ++started) {
+        if (pthread_create(
+            &threads[started], nil, &CSolver::SolveNetworks, &work
+        ) != 0) {
+            break;
+        }
+    }
+    SolveNetworks(&work);
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], nil);
+    }
+    pthread_mutex_destroy(&work._lock);
+    delete [] threads;
+#else
+    SolveNetworks(&work);
+#endif
 }
 
 void CSolver::Solve (CNet* net, Orientation orient) {
@@ -1024,7 +1179,7 @@ void CSolver::Solve (CNet* net, Orientation orient) {
     boolean rva, rvb, rvc;
 
     if (net->IsDegenerate()) {
-        DefaultPosition(net);
+        DefaultPosition(net, orient);
 
     } else if (FoundFixed(net, nwa)) {
         SubstFixedEquiv(net, nwa, eqa, orient);
@@ -1052,31 +1207,74 @@ void CSolver::Solve (CNet* net, Orientation orient) {
         ReplacePseudoFixed(net, c1, c2, eqa, orient);
 
     } else {
-        DefaultPosition(net);
+        DefaultPosition(net, orient);
     }
 }
 
+CNet* CSolver::Partner (CNet* net, Orientation orient) {
+    CCnxn* cnxn = net->First()->Cnxn();
+    return Info(cnxn->_lbConn, orient)->GetNetwork();
+}
+
+/*
+ * Horizontal and vertical networks span the same connectors, and a
+ * connector is updated from both, so a network solved in either
+ * direction has its counterpart updated along with it.
+ */
+
 void CSolver::Update () {
     CUpdater cupdater;
-    UList* hu, *vu;
+    UList* u;
+    CNet* net, *nw;
 
-    for (
-        hu = _hnets->First(), vu = _vnets->First(); 
-        hu != _hnets->End(); 
-        hu = hu->Next(), vu = vu->Next()
-    ) {
-        CNet* hcl = Network(hu);
-        CNet* vcl = Network(vu);
-        CNet* nw;
+    for (u = _hnets->First(); u != _hnets->End(); u = u->Next()) {
+        net = Network(u);
+
+        if (net->_changed && (nw = Partner(net, Vertical)) != nil) {
+            nw->_changed = true;
+        }
+    }
+    for (u = _vnets->First(); u != _vnets->End(); u = u->Next()) {
+        net = Network(u);
 
-        for (nw = hcl->First(); nw != hcl->End(); nw = nw->Next()) {
-            cupdater.AddHCnxn(nw->Cnxn());
+        if (net->_changed && (nw = Partner(net, Horizontal)) != nil) {
+            nw->_changed = true;
         }
-        for (nw = vcl->First(); nw != vcl->End(); nw = nw->Next()) {
-            cupdater.AddVCnxn(nw->Cnxn());
+    }
+    for (u = _hnets->First(); u != _hnets->End(); u = u->Next()) {
+        net = Network(u);
+
+        if (net->_changed) {
+            for (nw = net->First(); nw != net->End(); nw = nw->Next()) {
+                cupdater.AddHCnxn(nw->Cnxn());
+            }
+        }
+    }
+    for (u = _vnets->First(); u != _vnets->End(); u = u->Next()) {
+        net = Network(u);
+
+        if (net->_changed) {
+            for (nw = net->First(); nw != net->End(); nw = nw->Next()) {
+                cupdater.AddVCnxn(nw->Cnxn());
+            }
         }
     }
     cupdater.Update();
+
+    for (u = _hnets->First(); u != _hnets->End(); u = u->Next()) {
+        net = Network(u);
+
+        if (net->_changed) {
+            net->Record();
+        }
+    }
+    for (u = _vnets->First(); u != _vnets->End(); u = u->Next()) {
+        net = Network(u);
+
+        if (net->_changed) {
+            net->Record();
+        }
+    }
 }
 
 void CSolver::InitInfo (Connector* conn) {
@@ -1138,6 +1336,7 @@ void CSolver::UpdateInfo (
 
     lbinfo->Include(cnxn->_rtConn);
     rtinfo->Include(cnxn->_lbConn);
+    lbinfo->GetNetwork()->_changed = true;
 }    
 
 void CSolver::CreateNetwork (
@@ -1196,6 +1395,8 @@ void CSolver::DeleteCnxnsTo (Connector* c, CNet* net, UList* nets) {
     CNet* next;
 
     if (net != nil) {
+        net->_changed = true;
+
         for (CNet* nw = net->First(); nw != net->End(); nw = next) {
             CCnxn* cnxn = nw->Cnxn();
             next = nw->Next();
@@ -1249,6 +1450,8 @@ void CSolver::DeleteCnxnsBetween (Connector* c1, Connector* c2, CNet* net) {
     CNet* next;
 
     if (net != nil) {
+        net->_changed = true;
+
         for (CNet* nw = net->First(); nw != net->End(); nw = next) {
             CCnxn* cnxn = nw->Cnxn();
             next = nw->Next();
@@ -1728,11 +1931,7 @@ void CSolver::SubstYEquiv (
 void CSolver::SubstPseudoFixed (
     CNet* net, Connector* c1, Connector* c2, CNet*& equiv, Orientation orient
 ) {
-    float cx1, cy1, cx2, cy2; 
-    c1->GetCenter(cx1, cy1);
-    c2->GetCenter(cx2, cy2);
-    
-    float nat = (orient == Horizontal) ? (cx2 - cx1) : (cy2 - cy1);
+    float nat = Captured(c2, orient) - Captured(c1, orient);
 
     equiv = net->CreateNetwork(
         net->CreateCnxn(c1, c2, new CSGlue(nat, 0, 0, 0, 0))
@@ -1746,8 +1945,12 @@ void CSolver::SubstPseudoFixed (
 void CSolver::ReplaceFixed (
     CNet*, CNet* nw, CNet*& next, Orientation orient
 ) {
+    CCnxn* cnxn = nw->Cnxn();
+
     ReplaceFixedInfo(nw, orient);
-    nw->Cnxn()->ApplyNatural();
+    cnxn->ApplyNatural(
+        Captured(cnxn->_lbConn, orient), Captured(cnxn->_rtConn, orient)
+    );
     next->Append(nw);
 }
 
@@ -1843,9 +2046,13 @@ void CSolver::ReplacePseudoFixed (
     c2->SetMobility(Fixed);
 }
 
-void CSolver::DefaultPosition (CNet* net) {
+void CSolver::DefaultPosition (CNet* net, Orientation orient) {
     for (CNet* nw = net->First(); nw != net->End(); nw = nw->Next()) {
-        nw->Cnxn()->ApplyNatural();
+        CCnxn* cnxn = nw->Cnxn();
+
+        cnxn->ApplyNatural(
+            Captured(cnxn->_lbConn, orient), Captured(cnxn->_rtConn, orient)
+        );
     }
 }
 
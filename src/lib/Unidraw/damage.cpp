@@ -41,20 +41,166 @@
 
 #include <IV-2_6/_enter.h>
 
+#include <stdlib.h>
+
+/*****************************************************************************/
+
+static const int AREA_LIMIT = 16;
+static const int DISJOINT_LIMIT = 3;    /* disjoint boxes per area, at most */
+
+static double Pixels (BoxObj& b) {
+    return double(b._right - b._left + 1) * double(b._top - b._bottom + 1);
+}
+
+static int CompareCoord (const void* a, const void* b) {
+    Coord c1 = *(Coord*) a, c2 = *(Coord*) b;
+    return (c1 < c2) ? -1 : (c1 > c2) ? 1 : 0;
+}
+
+static int CompareLeft (const void* a, const void* b) {
+    Coord c1 = ((BoxObj*) a)->_left, c2 = ((BoxObj*) b)->_left;
+    return (c1 < c2) ? -1 : (c1 > c2) ? 1 : 0;
+}
+
+/*
+ * Break the union of n boxes into disjoint ones, returning the number of
+ * pixels it covers.  The union is cut into horizontal bands wherever a box
+ * starts or ends; each band holds the runs of x that it covers, and a band
+ * whose runs match those of the band below it extends them.  The result
+ * (at most 2*n*n boxes) is stored in out, if it is not nil.
+ */
+
+static double Decompose (BoxObj* box, int n, BoxObj* out, int& nout) {
+    Coord* y = new Coord[2*n + 1];
+    BoxObj* spans = new BoxObj[n + 1];
+    BoxObj* runs = new BoxObj[n + 1];
+    BoxObj* open = new BoxObj[n + 1];
+    int ny = 0, nopen = 0, i, j, k;
+    double pixels = 0;
+
+    for (i = 0; i < n; ++i) {
+        y[ny++] = box[i]._bottom;
+        y[ny++] = box[i]._top + 1;
+    }
+    qsort(y, ny, sizeof(Coord), &CompareCoord);
+    for (i = 0, j = 0; i < ny; ++i) {
+        if (j == 0 || y[i] != y[j-1]) {
+            y[j++] = y[i];
+        }
+    }
+    ny = j;
+    nout = 0;
+
+    for (k = 0; k + 1 < ny; ++k) {
+        Coord y0 = y[k], y1 = y[k+1];
+        int nspans = 0, nruns = 0;
+
+        for (i = 0; i < n; ++i) {
+            if (box[i]._bottom <= y0 && box[i]._top + 1 >= y1) {
+                spans[nspans++] = box[i];
+            }
+        }
+        qsort(spans, nspans, sizeof(BoxObj), &CompareLeft);
+
+        for (i = 0; i < nspans; ++i) {
+            Coord x0 = spans[i]._left, x1 = spans[i]._right + 1;
+
+            if (nruns > 0 && x0 <= runs[nruns-1]._right) {
+                runs[nruns-1]._right = max(runs[nruns-1]._right, x1);
+            } else {
+                runs[nruns]._left = x0;
+                runs[nruns]._right = x1;
+                ++nruns;
+            }
+        }
+        for (i = 0; i < nruns; ++i) {
+            pixels += double(runs[i]._right - runs[i]._left) * double(y1 - y0);
+        }
+
+        if (out != nil) {
+            boolean same = nruns == nopen;
+
+            for (i = 0; same && i < nruns; ++i) {
+                same = open[i]._top == y0 &&
+                    open[i]._left == runs[i]._left &&
+                    open[i]._right == runs[i]._right;
+            }
+            if (same) {
+                for (i = 0; i < nopen; ++i) {
+                    open[i]._top = y1;
+                }
+            } else {
+                for (i = 0; i < nopen; ++i) {
+                    out[nout++] = BoxObj(
+                        open[i]._left, open[i]._bottom,
+                        open[i]._right - 1, open[i]._top - 1
+                    );
+                }
+                for (i = 0; i < nruns; ++i) {
+                    open[i] = runs[i];
+                    open[i]._bottom = y0;
+                    open[i]._top = y1;
+                }
+                nopen = nruns;
+            }
+        }
+    }
+    for (i = 0; out != nil && i < nopen; ++i) {
+        out[nout++] = BoxObj(
+            open[i]._left, open[i]._bottom, open[i]._right - 1, open[i]._top - 1
+        );
+    }
+    delete [] y;
+    delete [] spans;
+    delete [] runs;
+    delete [] open;
+    return pixels;
+}
+
+/*
+ * Copy the boxes in the list, clipped to the visible part of the canvas,
+ * into a new array.
+ */
+
+static BoxObj* VisibleBoxes (UList* list, BoxObj& visible, int& n) {
+    UList* u;
+
+    n = 0;
+    for (u = list->First(); u != list->End(); u = u->Next()) {
+        ++n;
+    }
+    BoxObj* box = new BoxObj[n + 1];
+
+    n = 0;
+    for (u = list->First(); u != list->End(); u = u->Next()) {
+        BoxObj* b = (BoxObj*) (*u)();
+
+        if (b->Intersects(visible)) {
+            box[n++] = *b - visible;
+        }
+    }
+    return box;
+}
+
 /*****************************************************************************/
 
 Damage::Damage (Canvas* c, Painter* p, Graphic* g) {
     _areas = new UList;
     _additions = new UList;
+    _incurred = new UList;
     _canvas = c;
     _output = p;
     Ref(_output);
     _graphic = g;
+    _limit = AREA_LIMIT;
+    _instrument = false;
+    _damaged = _repainted = 0;
 }
 
 Damage::~Damage () {
     Unref(_output);
     DeleteAreas();
+    DeleteIncurred();
     delete _additions;
 }
 
@@ -62,17 +208,39 @@ int Damage::Area (BoxObj& b) {
     return (b._right - b._left) * (b._top - b._bottom);
 }
 
+/*
+ * Areas may overlap, so they are redrawn as the disjoint boxes covering
+ * their union, each pixel being cleared and drawn once.  Staggered
+ * areas can cut the union into many small boxes, though, and each
+ * costs a traversal of the graphic; past a few per area it is cheaper
+ * to redraw the areas themselves, overlaps and all.
+ */
+
 void Damage::DrawAreas () {
     BoxObj visible(0, 0, _canvas->Width() - 1, _canvas->Height() - 1);
-    BoxObj b, *a;
-    Iterator i;
+    int n, nout;
+    BoxObj* box = VisibleBoxes(_areas, visible, n);
+    BoxObj* out = new BoxObj[2*n*n + 1];
+    double pixels = Decompose(box, n, out, nout);
+
+    if (nout > DISJOINT_LIMIT * n) {
+        pixels = 0;
+
+        for (int i = 0; i < n; ++i) {
+            out[i] = box[i];
+            pixels += Pixels(box[i]);
+        }
+        nout = n;
+    }
+    _repainted += (unsigned long) pixels;
 
-    for (FirstArea(i); !Done(i); Next(i)) {
-        a = GetArea(i);
-        b = *a - visible;
+    for (int i = 0; i < nout; ++i) {
+        BoxObj& b = out[i];
 	_output->ClearRect(_canvas, b._left, b._bottom, b._right, b._top);
 	_graphic->DrawClipped(_canvas, b._left, b._bottom, b._right, b._top);
     }
+    delete [] box;
+    delete [] out;
 }    
 
 void Damage::DrawAdditions () {
@@ -86,50 +254,66 @@ void Damage::DrawAdditions () {
 }
 
 void Damage::Merge (BoxObj& newb) {
-    BoxObj* a1, *a2;
-    int newArea, area1, area2, diff1, diff2, diff3, maximum;
     Iterator i;
 
-    FirstArea(i);
-    a1 = GetArea(i);
-    Next(i);
-    a2 = GetArea(i);
-    BoxObj merge1(*a1 + newb);
-    BoxObj merge2(*a2 + newb);
-    BoxObj merge3(*a1 + *a2);
-
-    newArea = Area(newb);
-    area1 = Area(*a1);
-    area2 = Area(*a2);
-    diff1 = area1 + newArea - Area(merge1);
-    diff2 = area2 + newArea - Area(merge2);
-    diff3 = area1 + area2 - Area(merge3);
-    maximum = max(max(diff1, diff2), diff3);
-
-    if (maximum == diff1) {
-	if (a2->Intersects(merge1)) {
-	    *a1 = merge1 + *a2;
-            DeleteArea(a2);
-	} else {
-	    *a1 = merge1;
-	}
-
-    } else if (maximum == diff2) {
-	if (a1->Intersects(merge2)) {
-	    *a2 = merge2 + *a1;
-            DeleteArea(a1);
-	} else {
-	    *a2 = merge2;
-	}
-
-    } else {
-	if (newb.Intersects(merge3)) {
-	    *a1 = merge3 + newb;
-            DeleteArea(a2);
-	} else {
-	    *a1 = merge3;
-	    *a2 = newb;
-	}
+    for (FirstArea(i); !Done(i); Next(i)) {
+        if (newb.Within(*GetArea(i))) {
+            return;
+        }
+    }
+    _areas->Append(new UList(new BoxObj(&newb)));
+    Coalesce();
+}
+
+/*
+ * Merge pairs of areas, least wasteful first, until no more than the limit
+ * remain.  A pair whose bounding box covers no pixel that the two do not
+ * already cover is merged regardless of the limit, and areas that end up
+ * inside a merged one are dropped.
+ */
+
+void Damage::Coalesce () {
+    for (;;) {
+        UList* u, *v, *best1 = nil, *best2 = nil;
+        double waste, least = 0;
+        int count = 0;
+
+        for (u = _areas->First(); u != _areas->End(); u = u->Next()) {
+            BoxObj* a1 = (BoxObj*) (*u)();
+            ++count;
+
+            for (v = u->Next(); v != _areas->End(); v = v->Next()) {
+                BoxObj* a2 = (BoxObj*) (*v)();
+                BoxObj merged(*a1 + *a2);
+
+                waste = Pixels(merged) - Pixels(*a1) - Pixels(*a2);
+                if (a1->Intersects(*a2)) {
+                    BoxObj overlap(*a1 - *a2);
+                    waste += Pixels(overlap);
+                }
+                if (best1 == nil || waste < least) {
+                    least = waste;
+                    best1 = u;
+                    best2 = v;
+                }
+            }
+        }
+        if (best1 == nil || (least > 0 && count <= _limit)) {
+            break;
+        }
+        BoxObj* a1 = (BoxObj*) (*best1)();
+        BoxObj* a2 = (BoxObj*) (*best2)();
+        *a1 = *a1 + *a2;
+        DeleteArea(a2);
+
+        for (u = _areas->First(); u != _areas->End(); u = v) {
+            BoxObj* a = (BoxObj*) (*u)();
+            v = u->Next();
+
+            if (u != best1 && a->Within(*a1)) {
+                DeleteArea(a);
+            }
+        }
     }
 }
 
@@ -154,30 +338,24 @@ void Damage::Incur (Coord l, Coord b, Coord r, Coord t) {
 }
 
 void Damage::Incur (BoxObj& newb) {
-    BoxObj* b;
-    Iterator i;
-
-    if (_areas->IsEmpty()) {
-	_areas->Prepend(new UList(new BoxObj(&newb)));
-
-    } else if (_areas->First() == _areas->Last()) {
-        FirstArea(i);
-        b = GetArea(i);
-	if (newb.Intersects(*b)) {
-	    if (!newb.Within(*b)) {
-		*b = *b + newb;
-	    }
-	} else {
-	    _areas->Prepend(new UList(new BoxObj(&newb)));
-	}
-    } else {
-	Merge(newb);
+    if (_instrument) {
+        _incurred->Append(new UList(new BoxObj(&newb)));
     }
+    Merge(newb);
 }
 
 void Damage::Repair () {
     DrawAreas();
     DrawAdditions();
+
+    if (_instrument) {
+        BoxObj visible(0, 0, _canvas->Width() - 1, _canvas->Height() - 1);
+        int n, nout;
+        BoxObj* box = VisibleBoxes(_incurred, visible, n);
+
+        _damaged += (unsigned long) Decompose(box, n, nil, nout);
+        delete [] box;
+    }
     Reset();
 }
 
@@ -186,6 +364,8 @@ void Damage::Reset () {
     _areas = new UList;
     delete _additions;
     _additions = new UList;
+    DeleteIncurred();
+    _incurred = new UList;
 }
 
 void Damage::SetCanvas (Canvas* c) {
@@ -214,6 +394,33 @@ Graphic* Damage::GetGraphic () {
     return _graphic;
 }
 
+void Damage::SetAreaLimit (int limit) {
+    _limit = max(limit, 1);
+    Coalesce();
+}
+
+int Damage::GetAreaLimit () {
+    return _limit;
+}
+
+/*
+ * When instrumented, Repair counts both the pixels that were incurred
+ * and the (never fewer) pixels that it cleared and redrew.
+ */
+
+void Damage::Instrument (boolean on) {
+    _instrument = on;
+}
+
+void Damage::GetStatistics (unsigned long& damaged, unsigned long& repainted) {
+    damaged = _damaged;
+    repainted = _repainted;
+}
+
+void Damage::ResetStatistics () {
+    _damaged = _repainted = 0;
+}
+
 BoxObj* Damage::GetArea (Iterator i) { 
     UList* area = Elem(i); 
     return (BoxObj*) (*area) (); 
@@ -246,8 +453,8 @@ UList* Damage::Elem (Iterator i) {
 }
 
 void Damage::DeleteArea (BoxObj* area) {
-    delete area;
     _areas->Delete(area);
+    delete area;
 }
 
 void Damage::DeleteAreas () {
@@ -258,3 +465,12 @@ void Damage::DeleteAreas () {
     }
     delete _areas;
 }
+
+void Damage::DeleteIncurred () {
+    UList* u;
+
+    for (u = _incurred->First(); u != _incurred->End(); u = u->Next()) {
+        delete (BoxObj*) (*u)();
+    }
+    delete _incurred;
+}
@@ -61,7 +61,7 @@ void* StringStringElem::tag () { return _tagstring; }
 
 /*****************************************************************************/
 
-EditorInfo::EditorInfo () { }
+EditorInfo::EditorInfo () : UMap(true, true) { }
 EditorInfo::~EditorInfo () { unidraw->GetCatalog()->Forget(this); }
 
 void EditorInfo::Register (const char* name, const char* info) {
@@ -107,21 +107,3 @@ const char* EditorInfo::GetInfo (const char* name) {
 const char* EditorInfo::GetInfo (int index) {
     return (char*) Elem(index)->tag();
 }
-
-UMapElem* EditorInfo::FindId (void* id) {
-    for (int i = 0; i < _elems.Count(); ++i) {
-        if (strcmp(GetName(i), (char*) id) == 0) {
-            return (UMapElem*) _elems[i];
-        }
-    }
-    return nil;
-}
-
-UMapElem* EditorInfo::FindTag (void* tag) {
-    for (int i = 0; i < _elems.Count(); ++i) {
-        if (strcmp(GetInfo(i), (char*) tag) == 0) {
-            return (UMapElem*) _elems[i];
-        }
-    }
-    return nil;
-}
@@ -594,12 +594,14 @@ void Graphic::cachingOff () { _caching = false; }
 boolean Graphic::extentCached () { return false; }
 void Graphic::uncacheExtent () { }
 void Graphic::uncacheChildren () { }
+void Graphic::uncacheChild (Graphic*) { }
 
 void Graphic::uncacheParents () {
     Graphic* p = Parent();
 
     if (p != nil) {
         p->uncacheExtent();
+        p->uncacheChild(this);
 	p->uncacheParents();
     }
 }
@@ -42,7 +42,7 @@
 
 /*****************************************************************************/
 
-static const int SLOTS = 1000;
+static const int SLOTS = 64;
 
 /*****************************************************************************/
 
@@ -31,6 +31,7 @@
 #include <Unidraw/clipboard.h>
 #include <Unidraw/editor.h>
 #include <Unidraw/unidraw.h>
+#include <Unidraw/uscanner.h>
 #include <Unidraw/viewer.h>
 
 #include <Unidraw/Commands/edit.h>
@@ -51,6 +52,7 @@
 #include <InterViews/window.h>
 
 #include <TIFF/format.h>
+#include <OS/memory.h>
 #include <OS/string.h>
 
 #include <stdio.h>
@@ -58,19 +60,6 @@
 
 /*****************************************************************************/
 
-static int hexmap[] = {
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0,
-     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
-     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
-};
-
-/*****************************************************************************/
-
 static FILE* CheckCompression(
 	FILE* file, const char *filename, boolean& compressed
 ) {
@@ -171,12 +160,6 @@ static const char* ReadCreator (const char* filename) {
     return buf;
 }
 
-static int gethex (FILE* file) {
-    int c;
-    while ((c = getc(file)) == ' ' || c == '\n') { }
-    return (hexmap[c] << 4) + hexmap[getc(file)];
-}
-
 /*****************************************************************************/
 
 ClassId ImportCmd::GetClassId () { return IMPORT_CMD; }
@@ -295,56 +278,56 @@ GraphicComp* ImportCmd::TIFF_Image (const char* filename) {
 
 GraphicComp* ImportCmd::PGM_Image (const char* filename) {
     GraphicComp* comp = nil;
-    FILE* file = fopen(filename, "r");
+    UScanner scanner(filename);
 
-    if (file != nil) {
+    if (scanner.Valid()) {
         char line[1000];
-        do {
-            fgets(line, 1000, file);
-        } while (strcmp(line, "gsave\n") != 0);
-
-        fgets(line, 1000, file);                    // translate
-        fgets(line, 1000, file);                    // scale
-        fgets(line, 1000, file);                    // sizes
-        int w, h, d;
+        while (
+            UScanner::GetLine(&scanner, line, 1000) &&
+            strcmp(line, "gsave\n") != 0
+        ) { }
+
+        UScanner::GetLine(&scanner, line, 1000);    // translate
+        UScanner::GetLine(&scanner, line, 1000);    // scale
+        UScanner::GetLine(&scanner, line, 1000);    // sizes
+        int w = 0, h = 0, d = 0;
         sscanf(line, "%d %d %d", &w, &h, &d);
-        fgets(line, 1000, file);                    // [ ... ]
-        fgets(line, 1000, file);                    // { ... }
-        fgets(line, 1000, file);                    // image
+        UScanner::GetLine(&scanner, line, 1000);    // [ ... ]
+        UScanner::GetLine(&scanner, line, 1000);    // { ... }
+        UScanner::GetLine(&scanner, line, 1000);    // image
 
 	if (d == 1) {
 	    Bitmap* bm = new Bitmap((void*)nil, w, h);
+	    int nbytes = (w + 7) / 8;
+	    unsigned char* bits = new unsigned char[nbytes];
 
 	    for (int row = h - 1; row >= 0; --row) {
-		for (int column = 0; column < w; column += 8) {
-		    int byte = gethex(file);
-		    int bit = 0x80;
-		    int limit = column + 8;
-
-		    for (int pos = column; pos < limit; ++pos, bit >>= 1) {
-			boolean value = !(byte & bit);
-			bm->poke(value, pos, row);
-		    }
+		int n = UScanner::GetHex(&scanner, bits, nbytes);
+
+		for (int i = 0; i < n; ++i) {
+		    bits[i] = ~bits[i];
 		}
+		Memory::zero(&bits[n], nbytes - n);
+		bm->poke_bits(0, row, w, bits);
 	    }
+	    delete [] bits;
 	    bm->flush();
 	    comp = new StencilComp(new UStencil(bm, bm, stdgraphic));
 
 	} else {
 	    Raster* raster = new Raster(w, h);
+	    unsigned char* pixels = new unsigned char[w];
 
 	    for (int row = h - 1; row >= 0; --row) {
-		for (int column = 0; column < w; ++column) {
-		    int byte = gethex(file);
-		    float g = float(byte) / 0xff;
-		    raster->poke(column, row, g, g, g, 1.0);
-		}
+		int n = UScanner::GetHex(&scanner, pixels, w);
+		Memory::zero(&pixels[n], w - n);
+		raster->poke_pixels(0, row, w, 1, pixels, Raster::gray8);
 	    }
+	    delete [] pixels;
 	    raster->flush();
 	    comp = new RasterComp(new RasterRect(raster), filename);
 	}
     }
-    fclose(file);
     return comp;
 }
 
@@ -353,68 +336,68 @@ GraphicComp* ImportCmd::PPM_Image (const char* filename) {
     FILE* file = fopen(filename, "r");
     boolean compressed;
     file = CheckCompression(file, filename, compressed);
+    UScanner* scanner = nil;
 
-    if (file != nil) {
+    if (file != nil && compressed) {
+        scanner = new UScanner(file);
+        pclose(file);
+
+    } else if (file != nil) {
+        fclose(file);
+        scanner = new UScanner(filename);
+    }
+
+    if (scanner != nil && scanner->Valid()) {
         char line[1000];
-        do {
-            fgets(line, 1000, file);
-        } while (strcmp(line, "gsave\n") != 0);
-
-        fgets(line, 1000, file);                    // translate
-        fgets(line, 1000, file);                    // scale
-        fgets(line, 1000, file);                    // scale
-        fgets(line, 1000, file);                    // sizes
-        int w, h, d;
+        while (
+            UScanner::GetLine(scanner, line, 1000) &&
+            strcmp(line, "gsave\n") != 0
+        ) { }
+
+        UScanner::GetLine(scanner, line, 1000);     // translate
+        UScanner::GetLine(scanner, line, 1000);     // scale
+        UScanner::GetLine(scanner, line, 1000);     // scale
+        UScanner::GetLine(scanner, line, 1000);     // sizes
+        int w = 0, h = 0, d = 0;
         sscanf(line, "%d %d %d", &w, &h, &d);
-        fgets(line, 1000, file);                    // [ ... ]
-        fgets(line, 1000, file);                    // { ... }
-        fgets(line, 1000, file);                    // false 3
-        fgets(line, 1000, file);                    // colorimage
+        UScanner::GetLine(scanner, line, 1000);     // [ ... ]
+        UScanner::GetLine(scanner, line, 1000);     // { ... }
+        UScanner::GetLine(scanner, line, 1000);     // false 3
+        UScanner::GetLine(scanner, line, 1000);     // colorimage
 
 	if (d == 1) {
 	    Bitmap* bm = new Bitmap((void*)nil, w, h);
+	    int nbytes = (w + 7) / 8;
+	    unsigned char* bits = new unsigned char[nbytes];
 
 	    for (int row = h - 1; row >= 0; --row) {
-		for (int column = 0; column < w; column += 8) {
-		    int byte = gethex(file);
-		    int bit = 0x80;
-		    int limit = column + 8;
-
-		    for (int pos = column; pos < limit; ++pos, bit >>= 1) {
-			boolean value = !(byte & bit);
-			bm->poke(value, pos, row);
-		    }
+		int n = UScanner::GetHex(scanner, bits, nbytes);
+
+		for (int i = 0; i < n; ++i) {
+		    bits[i] = ~bits[i];
 		}
+		Memory::zero(&bits[n], nbytes - n);
+		bm->poke_bits(0, row, w, bits);
 	    }
+	    delete [] bits;
 	    bm->flush();
 	    comp = new StencilComp(new UStencil(bm, bm, stdgraphic));
 
 	} else {
 	    Raster* raster = new Raster(w, h);
+	    unsigned char* pixels = new unsigned char[w * 3];
 
 	    for (int row = h - 1; row >= 0; --row) {
-		for (int column = 0; column < w; ++column) {
-		    int red = gethex(file);
-		    int green = gethex(file);
-		    int blue = gethex(file);
-		    raster->poke(
-			column, row,
-			float(red)/0xff, float(green)/0xff, float(blue)/0xff,
-			1.0
-		    );
-		}
+		int n = UScanner::GetHex(scanner, pixels, w * 3);
+		Memory::zero(&pixels[n], w * 3 - n);
+		raster->poke_pixels(0, row, w, 1, pixels, Raster::rgb8);
 	    }
+	    delete [] pixels;
 	    raster->flush();
 	    comp = new RasterComp(new RasterRect(raster), filename);
 	}
     }
-    
-    if (compressed) {
-        pclose(file);
-
-    } else {
-        fclose(file);
-    }
+    delete scanner;
     return comp;
 }
 
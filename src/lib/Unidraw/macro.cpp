@@ -108,6 +108,16 @@ boolean MacroCmd::Reversible () {
     return false;
 }
 
+long MacroCmd::Size () {
+    long size = Command::Size();
+    Iterator i;
+
+    for (First(i); !Done(i); Next(i)) {
+        size += GetCommand(i)->Size();
+    }
+    return size;
+}
+
 UList* MacroCmd::Elem (Iterator& i) { return (UList*) i.GetValue(); }
 void MacroCmd::First (Iterator& i) { i.SetValue(_cmds->First()); }
 void MacroCmd::Last (Iterator& i) { i.SetValue(_cmds->Last()); }
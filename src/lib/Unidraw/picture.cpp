@@ -29,21 +29,396 @@
  */
 
 #include <Unidraw/iterator.h>
+#include <Unidraw/uhash.h>
 #include <Unidraw/ulist.h>
 #include <Unidraw/Graphic/picture.h>
 
 #include <InterViews/transformer.h>
 
+#include <OS/memory.h>
+
 #include <IV-2_6/_enter.h>
 
+#include <math.h>
+#include <stdlib.h>
+
+/*****************************************************************************/
+
+/*
+ * A picture with many children indexes them by bounding box, so that
+ * hit-testing and clipped drawing look only at the children near the
+ * point or box in question.  Boxes are kept in the picture's own
+ * coordinate space (before its transformer is applied); transforming
+ * the picture therefore leaves them valid.  The index is a packed R-tree.
+ * Children added or changed since it was packed wait on a pending list
+ * that is folded into the tree once it grows long enough.
+ */
+
+static const int INDEX_THRESHOLD = 64;	/* children needed to build index */
+static const int INDEX_FANOUT = 16;
+static const int INDEX_LEVELS = 16;
+
+class PictureEntry : public UHashElem {
+public:
+    PictureEntry(long seq);
+
+    boolean Overlaps(float, float, float, float);
+public:
+    long _seq;				/* z-order within the picture */
+    boolean _boxed;
+    float _l, _b, _r, _t, _tol;
+    int _leaf;				/* slot in packed tree, or -1 */
+    int _pending;			/* slot in pending list, or -1 */
+};
+
+PictureEntry::PictureEntry (long seq) {
+    _seq = seq;
+    _boxed = false;
+    _l = _b = _r = _t = _tol = 0;
+    _leaf = _pending = -1;
+}
+
+inline boolean PictureEntry::Overlaps (float l, float b, float r, float t) {
+    return _l <= r && l <= _r && _b <= t && b <= _t;
+}
+
+class PictureNode {
+public:
+    float _l, _b, _r, _t;
+};
+
+class PictureIndex : public UHashTable {
+public:
+    PictureIndex(int nslots, PSBrush*, PSFont*);
+    virtual ~PictureIndex();
+
+    PictureEntry* Find(Graphic*);
+    boolean Append(Graphic*);
+    boolean Prepend(Graphic*);
+    boolean Insert(Graphic*);
+    void Remove(Graphic*);
+    void Invalidate(Graphic*);
+
+    boolean Stale();
+    void Pack();
+    void Search(float, float, float, float);
+
+    int Hits();
+    Graphic* Hit(int);
+public:
+    PSBrush* _brush;			/* graphics state the boxes assume */
+    PSFont* _font;
+    long _first, _last;
+    boolean _ordered;
+    float _tol;
+
+    PictureEntry** _pending;
+    int _npending;
+private:
+    boolean Add(Graphic*, long seq);
+    void AddPending(PictureEntry*);
+    void RemovePending(PictureEntry*);
+    void RemoveLeaf(PictureEntry*);
+    void SearchNode(int level, int n, float, float, float, float);
+private:
+    int _maxpending;
+    PictureEntry** _leaves;
+    int _nleaves, _dead;
+    PictureNode* _nodes;
+    int _levels;
+    int _offset[INDEX_LEVELS], _size[INDEX_LEVELS];
+    PictureEntry** _hits;
+    int _nhits, _maxhits;
+};
+
+static PictureEntry** GrowEntries (PictureEntry** a, int n, int& max) {
+    max = (max == 0) ? 64 : max * 2;
+    PictureEntry** b = new PictureEntry*[max];
+    Memory::copy(a, b, n * sizeof(PictureEntry*));
+    delete [] a;
+    return b;
+}
+
+static int CompareX (const void* a, const void* b) {
+    PictureEntry* e1 = *(PictureEntry**) a;
+    PictureEntry* e2 = *(PictureEntry**) b;
+    float x1 = e1->_l + e1->_r, x2 = e2->_l + e2->_r;
+    return (x1 < x2) ? -1 : (x1 > x2) ? 1 : 0;
+}
+
+static int CompareY (const void* a, const void* b) {
+    PictureEntry* e1 = *(PictureEntry**) a;
+    PictureEntry* e2 = *(PictureEntry**) b;
+    float y1 = e1->_b + e1->_t, y2 = e2->_b + e2->_t;
+    return (y1 < y2) ? -1 : (y1 > y2) ? 1 : 0;
+}
+
+static int CompareSeq (const void* a, const void* b) {
+    PictureEntry* e1 = *(PictureEntry**) a;
+    PictureEntry* e2 = *(PictureEntry**) b;
+    return (e1->_seq < e2->_seq) ? -1 : (e1->_seq > e2->_seq) ? 1 : 0;
+}
+
+PictureIndex::PictureIndex (
+    int nslots, PSBrush* br, PSFont* font
+) : UHashTable(nslots) {
+    _brush = br;
+    _font = font;
+    _first = 0;
+    _last = -1;
+    _ordered = true;
+    _tol = 0;
+    _pending = nil;
+    _npending = _maxpending = 0;
+    _leaves = nil;
+    _nleaves = _dead = 0;
+    _nodes = nil;
+    _levels = 0;
+    _hits = nil;
+    _nhits = _maxhits = 0;
+}
+
+PictureIndex::~PictureIndex () {
+    delete [] _pending;
+    delete [] _leaves;
+    delete [] _nodes;
+    delete [] _hits;
+}
+
+PictureEntry* PictureIndex::Find (Graphic* g) {
+    return (PictureEntry*) UHashTable::Find(g);
+}
+
+boolean PictureIndex::Append (Graphic* g) { return Add(g, ++_last); }
+boolean PictureIndex::Prepend (Graphic* g) { return Add(g, --_first); }
+
+boolean PictureIndex::Insert (Graphic* g) {
+    _ordered = false;
+    return Add(g, _last);
+}
+
+boolean PictureIndex::Add (Graphic* g, long seq) {
+    if (Find(g) != nil) {
+        return false;
+    }
+    PictureEntry* e = new PictureEntry(seq);
+    Register(g, e);
+    AddPending(e);
+    return true;
+}
+
+void PictureIndex::Remove (Graphic* g) {
+    PictureEntry* e = Find(g);
+
+    if (e != nil) {
+        if (e->_leaf >= 0) {
+            RemoveLeaf(e);
+        }
+        if (e->_pending >= 0) {
+            RemovePending(e);
+        }
+        Unregister(g);
+    }
+}
+
+void PictureIndex::Invalidate (Graphic* g) {
+    PictureEntry* e = Find(g);
+
+    if (e != nil) {
+        if (e->_leaf >= 0) {
+            RemoveLeaf(e);
+        }
+        if (e->_pending < 0) {
+            AddPending(e);
+        }
+        e->_boxed = false;
+    }
+}
+
+void PictureIndex::AddPending (PictureEntry* e) {
+    if (_npending == _maxpending) {
+        _pending = GrowEntries(_pending, _npending, _maxpending);
+    }
+    e->_pending = _npending;
+    _pending[_npending++] = e;
+}
+
+void PictureIndex::RemovePending (PictureEntry* e) {
+    PictureEntry* last = _pending[--_npending];
+
+    _pending[e->_pending] = last;
+    last->_pending = e->_pending;
+    e->_pending = -1;
+}
+
+void PictureIndex::RemoveLeaf (PictureEntry* e) {
+    /* the enclosing nodes keep their (now loose) boxes until repacked */
+    _leaves[e->_leaf] = nil;
+    e->_leaf = -1;
+    ++_dead;
+}
+
+boolean PictureIndex::Stale () {
+    int limit = _nleaves / 8;
+
+    if (limit < 32) {
+        limit = 32;
+    }
+    return _npending > limit || _dead > _nleaves / 4;
+}
+
+/*
+ * Pack all entries into a new tree, sort-tile-recursive fashion: sort by x,
+ * cut into vertical slices of whole leaf nodes, sort each slice by y, and
+ * group consecutive entries (and then nodes) INDEX_FANOUT at a time.
+ */
+
+void PictureIndex::Pack () {
+    int n = _nleaves - _dead + _npending;
+    PictureEntry** all = new PictureEntry*[n + 1];
+    int i, j = 0;
+
+    for (i = 0; i < _nleaves; ++i) {
+        if (_leaves[i] != nil) {
+            all[j++] = _leaves[i];
+        }
+    }
+    for (i = 0; i < _npending; ++i) {
+        all[j++] = _pending[i];
+    }
+    delete [] _leaves;
+    _leaves = all;
+    _nleaves = n;
+    _npending = 0;
+    _dead = 0;
+
+    int leafnodes = (n + INDEX_FANOUT - 1) / INDEX_FANOUT;
+    int slice = int(ceil(sqrt(double(leafnodes)))) * INDEX_FANOUT;
+
+    qsort(all, n, sizeof(PictureEntry*), &CompareX);
+    for (i = 0; i < n; i += slice) {
+        qsort(all + i, min(slice, n - i), sizeof(PictureEntry*), &CompareY);
+    }
+    _tol = 0;
+    for (i = 0; i < n; ++i) {
+        all[i]->_leaf = i;
+        all[i]->_pending = -1;
+        _tol = max(_tol, all[i]->_tol);
+    }
+
+    int total = 0, size = n;
+    _levels = 0;
+    do {
+        size = (size + INDEX_FANOUT - 1) / INDEX_FANOUT;
+        _offset[_levels] = total;
+        _size[_levels] = size;
+        total += size;
+        ++_levels;
+    } while (size > 1);
+
+    delete [] _nodes;
+    _nodes = new PictureNode[total + 1];
+
+    for (int level = 0; level < _levels; ++level) {
+        int below = (level == 0) ? n : _size[level-1];
+
+        for (i = 0; i < _size[level]; ++i) {
+            PictureNode& node = _nodes[_offset[level] + i];
+            int lo = i * INDEX_FANOUT;
+            int hi = min(lo + INDEX_FANOUT, below);
+
+            for (j = lo; j < hi; ++j) {
+                float l, b, r, t;
+
+                if (level == 0) {
+                    PictureEntry* e = all[j];
+                    l = e->_l; b = e->_b; r = e->_r; t = e->_t;
+                } else {
+                    PictureNode& child = _nodes[_offset[level-1] + j];
+                    l = child._l; b = child._b; r = child._r; t = child._t;
+                }
+                if (j == lo) {
+                    node._l = l; node._b = b; node._r = r; node._t = t;
+                } else {
+                    node._l = min(node._l, l);
+                    node._b = min(node._b, b);
+                    node._r = max(node._r, r);
+                    node._t = max(node._t, t);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Collect the entries whose boxes overlap the given one, in z-order.
+ */
+
+void PictureIndex::Search (float l, float b, float r, float t) {
+    _nhits = 0;
+
+    if (_levels > 0 && _size[_levels-1] > 0) {
+        SearchNode(_levels-1, 0, l, b, r, t);
+    }
+    for (int i = 0; i < _npending; ++i) {
+        PictureEntry* e = _pending[i];
+
+        if (e->Overlaps(l, b, r, t)) {
+            if (_nhits == _maxhits) {
+                _hits = GrowEntries(_hits, _nhits, _maxhits);
+            }
+            _hits[_nhits++] = e;
+        }
+    }
+    qsort(_hits, _nhits, sizeof(PictureEntry*), &CompareSeq);
+}
+
+void PictureIndex::SearchNode (
+    int level, int n, float l, float b, float r, float t
+) {
+    PictureNode& node = _nodes[_offset[level] + n];
+
+    if (node._l <= r && l <= node._r && node._b <= t && b <= node._t) {
+        int lo = n * INDEX_FANOUT;
+
+        if (level == 0) {
+            int hi = min(lo + INDEX_FANOUT, _nleaves);
+
+            for (int i = lo; i < hi; ++i) {
+                PictureEntry* e = _leaves[i];
+
+                if (e != nil && e->Overlaps(l, b, r, t)) {
+                    if (_nhits == _maxhits) {
+                        _hits = GrowEntries(_hits, _nhits, _maxhits);
+                    }
+                    _hits[_nhits++] = e;
+                }
+            }
+        } else {
+            int hi = min(lo + INDEX_FANOUT, _size[level-1]);
+
+            for (int i = lo; i < hi; ++i) {
+                SearchNode(level-1, i, l, b, r, t);
+            }
+        }
+    }
+}
+
+int PictureIndex::Hits () { return _nhits; }
+Graphic* PictureIndex::Hit (int i) { return (Graphic*) _hits[i]->GetKey(); }
+
 /*****************************************************************************/
 
 Picture::Picture (Graphic* gr) : FullGraphic(gr) {
     _extent = nil;
+    _index = nil;
     _kids = new UList();
 }
 
 Picture::~Picture () {
+    delete _index;
+    _index = nil;
+
     while (!_kids->IsEmpty()) {
 	UList* cur = _kids->First();
 	_kids->Remove(cur);
@@ -86,6 +461,15 @@ void Picture::Append (Graphic* g0, Graphic* g1, Graphic* g2, Graphic* g3) {
 	_kids->Append(new UList(g3));
 	setParent(g3, this);
     }
+    if (_index != nil && !(
+        _index->Append(g0) &&
+        (g1 == nil || _index->Append(g1)) &&
+        (g2 == nil || _index->Append(g2)) &&
+        (g3 == nil || _index->Append(g3))
+    )) {
+        delete _index;
+        _index = nil;
+    }
     uncacheExtent();
     uncacheParents();
 }
@@ -109,6 +493,15 @@ void Picture::Prepend (Graphic* g0, Graphic* g1, Graphic* g2, Graphic* g3) {
     invalidateCachesGraphic(g0);
     _kids->Prepend(new UList(g0));
     setParent(g0, this);
+    if (_index != nil && !(
+        (g3 == nil || _index->Prepend(g3)) &&
+        (g2 == nil || _index->Prepend(g2)) &&
+        (g1 == nil || _index->Prepend(g1)) &&
+        _index->Prepend(g0)
+    )) {
+        delete _index;
+        _index = nil;
+    }
     uncacheExtent();
     uncacheParents();
 }
@@ -117,6 +510,10 @@ void Picture::InsertBefore (Iterator i, Graphic* g) {
     invalidateCachesGraphic(g);
     Elem(i)->Append(new UList(g));
     setParent(g, this);
+    if (_index != nil && !_index->Insert(g)) {
+        delete _index;
+        _index = nil;
+    }
     uncacheExtent();
     uncacheParents();
 }
@@ -125,6 +522,10 @@ void Picture::InsertAfter (Iterator i, Graphic* g) {
     invalidateCachesGraphic(g);
     Elem(i)->Prepend(new UList(g));
     setParent(g, this);
+    if (_index != nil && !_index->Insert(g)) {
+        delete _index;
+        _index = nil;
+    }
     uncacheExtent();
     uncacheParents();
 }
@@ -132,6 +533,9 @@ void Picture::InsertAfter (Iterator i, Graphic* g) {
 void Picture::Remove (Graphic* g) {
     unsetParent(g);
     _kids->Delete(g);
+    if (_index != nil) {
+        _index->Remove(g);
+    }
     uncacheExtent();
     uncacheParents();
 }
@@ -144,11 +548,20 @@ void Picture::Remove (Iterator& i) {
     unsetParent(g);
     _kids->Remove(doomed);
     delete doomed;
+    if (_index != nil) {
+        _index->Remove(g);
+    }
     uncacheExtent();
     uncacheParents();
 }
 
 Graphic* Picture::FirstGraphicContaining (PointObj& pt) {
+    BoxObj box(pt._x, pt._y, pt._x, pt._y);
+    Graphic* hit;
+
+    if (searchHits(box, HitContains, false, hit)) {
+        return hit;
+    }
     Iterator i;
 
     for (First(i); !Done(i); Next(i)) {
@@ -162,6 +575,12 @@ Graphic* Picture::FirstGraphicContaining (PointObj& pt) {
 }
 
 Graphic* Picture::LastGraphicContaining (PointObj& pt) {
+    BoxObj box(pt._x, pt._y, pt._x, pt._y);
+    Graphic* hit;
+
+    if (searchHits(box, HitContains, true, hit)) {
+        return hit;
+    }
     Iterator i;
 
     for (Last(i); !Done(i); Prev(i)) {
@@ -175,6 +594,11 @@ Graphic* Picture::LastGraphicContaining (PointObj& pt) {
 }
 
 Graphic* Picture::FirstGraphicIntersecting (BoxObj& b) {
+    Graphic* hit;
+
+    if (searchHits(b, HitIntersects, false, hit)) {
+        return hit;
+    }
     Iterator i;
 
     for (First(i); !Done(i); Next(i)) {
@@ -188,6 +612,11 @@ Graphic* Picture::FirstGraphicIntersecting (BoxObj& b) {
 }
 
 Graphic* Picture::LastGraphicIntersecting (BoxObj& b) {
+    Graphic* hit;
+
+    if (searchHits(b, HitIntersects, true, hit)) {
+        return hit;
+    }
     Iterator i;
 
     for (Last(i); !Done(i); Prev(i)) {
@@ -203,6 +632,11 @@ Graphic* Picture::LastGraphicIntersecting (BoxObj& b) {
 Graphic* Picture::FirstGraphicWithin (BoxObj& userb) {
     Iterator i;
     BoxObj b;
+    Graphic* hit;
+
+    if (searchHits(userb, HitWithin, false, hit)) {
+        return hit;
+    }
 
     for (First(i); !Done(i); Next(i)) {
 	Graphic* subgr = GetGraphic(i);
@@ -218,6 +652,11 @@ Graphic* Picture::FirstGraphicWithin (BoxObj& userb) {
 Graphic* Picture::LastGraphicWithin (BoxObj& userb) {
     Iterator i;
     BoxObj b;
+    Graphic* hit;
+
+    if (searchHits(userb, HitWithin, true, hit)) {
+        return hit;
+    }
 
     for (Last(i); !Done(i); Prev(i)) {
 	Graphic* subgr = GetGraphic(i);
@@ -233,6 +672,9 @@ Graphic* Picture::LastGraphicWithin (BoxObj& userb) {
 void Picture::Bequeath () {
     Iterator i;
 
+    delete _index;	/* children's boxes absorb our transformation */
+    _index = nil;
+
     for (First(i); !Done(i); Next(i)) {
 	Graphic* gr = GetGraphic(i);
 	concatGraphic(gr, gr, this, gr);
@@ -281,11 +723,22 @@ void Picture::drawClipped (
         FullGraphic gstemp;
         Transformer ttemp;
 	gstemp.SetTransformer(&ttemp);
-
-        for (First(i); !Done(i); Next(i)) {
-	    Graphic* gr = GetGraphic(i);
-	    concatGraphic(gr, gr, gs, &gstemp);
-	    drawClippedGraphic(gr, c, l, b, r, t, &gstemp);
+        PictureIndex* pi = indexing() ? searchIndex(
+            l, b, r, t, gs, false
+        ) : nil;
+
+        if (pi != nil) {
+            for (int n = 0; n < pi->Hits(); ++n) {
+                Graphic* gr = pi->Hit(n);
+                concatGraphic(gr, gr, gs, &gstemp);
+                drawClippedGraphic(gr, c, l, b, r, t, &gstemp);
+            }
+        } else {
+            for (First(i); !Done(i); Next(i)) {
+                Graphic* gr = GetGraphic(i);
+                concatGraphic(gr, gr, gs, &gstemp);
+                drawClippedGraphic(gr, c, l, b, r, t, &gstemp);
+            }
 	}
 	gstemp.SetTransformer(nil); /* to avoid deleting ttemp explicitly */
     }
@@ -348,8 +801,24 @@ boolean Picture::contains (PointObj& po, Graphic* gs) {
 	getBox(b, gs);
 
 	if (b.Contains(po)) {
+            PictureIndex* pi = indexing() ? searchIndex(
+                po._x, po._y, po._x, po._y, gs, false
+            ) : nil;
 	    gstemp.SetTransformer(&ttemp);
 
+            if (pi != nil) {
+                for (int n = 0; n < pi->Hits(); ++n) {
+                    Graphic* gr = pi->Hit(n);
+                    concatGraphic(gr, gr, gs, &gstemp);
+
+                    if (containsGraphic(gr, po, &gstemp)) {
+                        gstemp.SetTransformer(nil);
+                        return true;
+                    }
+                }
+                gstemp.SetTransformer(nil);
+                return false;
+            }
             for (First(i); !Done(i); Next(i)) {
                 Graphic* gr = GetGraphic(i);
 		concatGraphic(gr, gr, gs, &gstemp);
@@ -375,8 +844,24 @@ boolean Picture::intersects (BoxObj& userb, Graphic* gs) {
 	getBox(b, gs);
 
 	if (b.Intersects(userb)) {
+            PictureIndex* pi = indexing() ? searchIndex(
+                userb._left, userb._bottom, userb._right, userb._top, gs, false
+            ) : nil;
 	    gstemp.SetTransformer(&ttemp);
 
+            if (pi != nil) {
+                for (int n = 0; n < pi->Hits(); ++n) {
+                    Graphic* gr = pi->Hit(n);
+                    concatGraphic(gr, gr, gs, &gstemp);
+
+                    if (intersectsGraphic(gr, userb, &gstemp)) {
+                        gstemp.SetTransformer(nil);
+                        return true;
+                    }
+                }
+                gstemp.SetTransformer(nil);
+                return false;
+            }
             for (First(i); !Done(i); Next(i)) {
 		Graphic* gr = GetGraphic(i);
 		concatGraphic(gr, gr, gs, &gstemp);
@@ -426,3 +911,187 @@ void Picture::uncacheChildren () {
 	uncacheChildrenGraphic(subgr);
     }
 }
+
+void Picture::uncacheChild (Graphic* g) {
+    if (_index != nil) {
+        _index->Invalidate(g);
+    }
+}
+
+boolean Picture::indexing () {
+    if (_index == nil) {
+        int n = 0;
+
+        for (UList* u = _kids->First(); n < INDEX_THRESHOLD; u = u->Next()) {
+            if (u == _kids->End()) {
+                return false;
+            }
+            ++n;
+        }
+    }
+    return true;
+}
+
+/*
+ * Return the index, bringing it up to date for the given graphics state.
+ * Boxes depend on the brush and font the children inherit; if those have
+ * changed the index is rebuilt only when rebind is true.
+ */
+
+PictureIndex* Picture::findIndex (Graphic* gs, boolean rebind) {
+    PSBrush* br = gs->GetBrush();
+    PSFont* font = gs->GetFont();
+    UList* u;
+
+    if (_index != nil && (_index->_brush != br || _index->_font != font)) {
+        if (!rebind) {
+            return nil;
+        }
+        delete _index;
+        _index = nil;
+    }
+    if (_index == nil) {
+        int n = 0;
+
+        for (u = _kids->First(); u != _kids->End(); u = u->Next()) {
+            ++n;
+        }
+        _index = new PictureIndex(2*n, br, font);
+
+        for (u = _kids->First(); u != _kids->End(); u = u->Next()) {
+            if (!_index->Append(graphic(u))) {
+                delete _index;	/* same graphic appears twice */
+                _index = nil;
+                return nil;
+            }
+        }
+
+    } else if (!_index->_ordered) {
+        long seq = 0;
+
+        for (u = _kids->First(); u != _kids->End(); u = u->Next()) {
+            _index->Find(graphic(u))->_seq = seq++;
+        }
+        _index->_first = 0;
+        _index->_last = seq - 1;
+        _index->_ordered = true;
+    }
+
+    for (int i = 0; i < _index->_npending; ++i) {
+        PictureEntry* e = _index->_pending[i];
+
+        if (!e->_boxed) {
+            getLocalBox(
+                (Graphic*) e->GetKey(), gs, e->_l, e->_b, e->_r, e->_t, e->_tol
+            );
+            e->_boxed = true;
+            _index->_tol = max(_index->_tol, e->_tol);
+        }
+    }
+    if (_index->Stale()) {
+        _index->Pack();
+    }
+    return _index;
+}
+
+/*
+ * Search the index for children that might touch the given box, which is
+ * in canvas coordinates.  The box is grown by the largest tolerance of any
+ * child and mapped back into the picture's coordinate space.
+ */
+
+PictureIndex* Picture::searchIndex (
+    float l, float b, float r, float t, Graphic* gs, boolean rebind
+) {
+    PictureIndex* pi = findIndex(gs, rebind);
+
+    if (pi != nil) {
+        float m = pi->_tol + 1;
+        float x0, y0, x1, y1, x2, y2, x3, y3;
+
+        invTransform(l - m, b - m, x0, y0, gs);
+        invTransform(r + m, b - m, x1, y1, gs);
+        invTransform(r + m, t + m, x2, y2, gs);
+        invTransform(l - m, t + m, x3, y3, gs);
+
+        /* one more unit covers rounding in the children's own tests */
+        l = min(min(x0, x1), min(x2, x3)) - 1;
+        b = min(min(y0, y1), min(y2, y3)) - 1;
+        r = max(max(x0, x1), max(x2, x3)) + 1;
+        t = max(max(y0, y1), max(y2, y3)) + 1;
+
+        if (l <= r && b <= t) {
+            pi->Search(l, b, r, t);
+            return pi;
+        }
+    }
+    return nil;
+}
+
+/*
+ * Apply a hit test to the children the index finds near the box, in
+ * drawing order or (if last is true) in reverse, and set found to the
+ * first one that passes or nil if none does.  Return false if there is
+ * no index to search, in which case the caller must test every child.
+ */
+
+boolean Picture::searchHits (
+    BoxObj& box, HitTest test, boolean last, Graphic*& found
+) {
+    if (!indexing()) {
+        return false;
+    }
+    FullGraphic gs;
+    totalGS(gs);
+    PictureIndex* pi = searchIndex(
+        box._left, box._bottom, box._right, box._top, &gs, true
+    );
+
+    if (pi == nil) {
+        return false;
+    }
+    PointObj pt(box._left, box._bottom);
+    BoxObj b;
+    int nhits = pi->Hits();
+
+    found = nil;
+    for (int n = 0; n < nhits && found == nil; ++n) {
+        Graphic* subgr = pi->Hit(last ? nhits - 1 - n : n);
+        boolean hit = false;
+
+        switch (test) {
+        case HitContains:
+            hit = subgr->Contains(pt);
+            break;
+        case HitIntersects:
+            hit = subgr->Intersects(box);
+            break;
+        case HitWithin:
+            subgr->GetBox(b);
+            hit = b.Within(box);
+            break;
+        }
+        if (hit) {
+            found = subgr;
+        }
+    }
+    return true;
+}
+
+void Picture::getLocalBox (
+    Graphic* gr, Graphic* gs,
+    float& l, float& b, float& r, float& t, float& tol
+) {
+    FullGraphic gstemp;
+    Transformer ttemp;
+    float cx, cy;
+
+    gstemp.SetTransformer(&ttemp);
+    concatGSGraphic(gr, gr, gs, &gstemp);
+    concatTransformerGraphic(gr, nil, gr->GetTransformer(), &ttemp);
+    l = b = cx = cy = tol = 0;
+    getExtentGraphic(gr, l, b, cx, cy, tol, &gstemp);
+    r = 2*cx - l;
+    t = 2*cy - b;
+    gstemp.SetTransformer(nil); /* to avoid deleting ttemp explicitly */
+}
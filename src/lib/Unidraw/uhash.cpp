@@ -29,140 +29,233 @@
 
 #include <Unidraw/iterator.h>
 #include <Unidraw/uhash.h>
-#include <Unidraw/ulist.h>
 
 #include <OS/memory.h>
 
 /*****************************************************************************/
 
+static const int EMPTY = -1;		/* slot never used */
+static const int DELETED = -2;		/* slot's element unregistered */
+static const int MINSLOTS = 8;
+
+/*****************************************************************************/
+
 UHashElem::UHashElem (void* key) { _key = key; }
 UHashElem::~UHashElem () { }
 
 /*****************************************************************************/
 
 UHashElem* UHashTable::CreateElem () { return nil; }
-UHashElem* UHashTable::Elem (UList* r) { return (UHashElem*) (*r)(); }
-int UHashTable::Hash (void* c) { return (unsigned long) c % _nslots; }
+
+/*
+ * Mix all the bits of the key into the low-order ones, which pick the
+ * slot; pointers' low bits are mostly zero and small integers' high bits
+ * always are.
+ */
+
+int UHashTable::Hash (void* key) {
+    unsigned long k = (unsigned long) key;
+    unsigned int h = (unsigned int) (k ^ (k >> 16 >> 16));
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return int(h & 0x7fffffff);
+}
 
 UHashTable::UHashTable (int nslots) {
-    _nslots = nslots;
-    _slot = new UList*[_nslots];
-    Memory::zero(_slot, sizeof(void*) * _nslots);
+    _nslots = MINSLOTS;
+    while (_nslots < nslots) {
+        _nslots <<= 1;
+    }
+    _key = new void*[_nslots];
+    _pos = new int[_nslots];
+    for (int i = 0; i < _nslots; ++i) {
+        _pos[i] = EMPTY;
+    }
+    _maxelems = _nslots / 2;
+    _elem = new UHashElem*[_maxelems];
+    _nelems = _count = _deleted = 0;
 }
 
 UHashTable::~UHashTable () {
-    for (int i = 0; i < _nslots; ++i) {
-        if (_slot[i] != nil) {
-            DeleteSlot(_slot[i]);
-        }
+    for (int i = 0; i < _nelems; ++i) {
+        delete _elem[i];
     }
-    delete [] _slot;
+    delete [] _key;
+    delete [] _pos;
+    delete [] _elem;
+}
+
+inline int UHashTable::Start (void* key) {
+    return Hash(key) & (_nslots - 1);
 }
 
 void UHashTable::Register (void* key, UHashElem* elem) {
-    int n = Hash(key);
+    if ((_count + _deleted + 1) * 4 > _nslots * 3 || _nelems == _maxelems) {
+        int nslots = _nslots;
 
-    if (_slot[n] == nil) {
-        _slot[n] = new UList;
+        while ((_count + 1) * 2 > nslots) {
+            nslots <<= 1;
+        }
+        Rehash(nslots);
     }
     if (elem == nil) {
         elem = CreateElem();
     }
     elem->SetKey(key);
-    _slot[n]->Prepend(new UList(elem));
-}
 
-void UHashTable::Unregister (void* key) {
-    int n = Hash(key);
-    UList* slot = _slot[n];
-
-    if (slot != nil) {
-        for (UList* u = slot->First(); u != slot->End(); u = u->Next()) {
-            UHashElem* elem = Elem(u);
-
-            if (Equal(elem->GetKey(), key)) {
-                slot->Remove(u);
-                delete elem;
-                delete u;
-
-		if (_slot[n]->IsEmpty()) {
-		    delete _slot[n];
-		    _slot[n] = nil;
-		}
-                break;
+    int pos = _nelems++;
+    int n = Start(key);
+    int reuse = -1;
+
+    _elem[pos] = elem;
+    ++_count;
+
+    /*
+     * A key already present keeps its earlier elements further along
+     * the probe sequence than the new one, each shifted down one place.
+     */
+    for (;; n = (n + 1) & (_nslots - 1)) {
+        if (_pos[n] == EMPTY) {
+            if (reuse >= 0) {
+                n = reuse;
+                --_deleted;
             }
+            _key[n] = key;
+            _pos[n] = pos;
+            return;
+
+        } else if (_pos[n] == DELETED) {
+            if (reuse < 0) {
+                reuse = n;
+            }
+
+        } else if (Equal(_key[n], key)) {
+            int displaced = _pos[n];
+            _pos[n] = pos;
+            pos = displaced;
+            reuse = -1;
         }
     }
 }
 
-UList* UHashTable::UElem (Iterator i) { return (UList*) i.GetValue(); }
-UHashElem* UHashTable::GetElem (Iterator i) { return Elem(UElem(i)); }
+void UHashTable::Unregister (void* key) {
+    for (int n = Start(key);; n = (n + 1) & (_nslots - 1)) {
+        if (_pos[n] == EMPTY) {
+            return;
 
-void UHashTable::First (Iterator& i) {
-    for (int j = 0; j < _nslots; ++j) {
-        if (_slot[j] != nil) {
-            i.SetValue(_slot[j]->First());
+        } else if (_pos[n] != DELETED && Equal(_key[n], key)) {
+            delete _elem[_pos[n]];
+            _elem[_pos[n]] = nil;
+            _pos[n] = DELETED;
+            --_count;
+            ++_deleted;
             return;
         }
     }
-    i.SetValue(nil);
 }
 
-void UHashTable::Next (Iterator& i) {
-    UHashElem* elem = GetElem(i);
-
-    if (elem != nil) {
-        int n = Hash(elem->GetKey());
-        UList* u = UElem(i);
-        u = u->Next();
-
-        if (u == _slot[n]->End()) {
-            for (int j = n+1; j < _nslots; ++j) {
-                if (_slot[j] != nil) {
-                    u = _slot[j]->First();
-                    break;
-                }
-            }
+void UHashTable::Unregister (Iterator& i) {
+    int pos = Position(i);
+    void* key = _elem[pos]->GetKey();
+
+    for (int n = Start(key);; n = (n + 1) & (_nslots - 1)) {
+        if (_pos[n] == pos) {
+            delete _elem[pos];
+            _elem[pos] = nil;
+            _pos[n] = DELETED;
+            --_count;
+            ++_deleted;
+            break;
         }
-        i.SetValue(u);
     }
+    Next(i);
 }
 
-boolean UHashTable::Done (Iterator i) {
-    for (int j = _nslots - 1; j >= 0; --j) {
-        if (_slot[j] != nil) {
-            return UElem(i) == _slot[j]->End();
+UHashElem* UHashTable::Find (void* key) {
+    for (int n = Start(key);; n = (n + 1) & (_nslots - 1)) {
+        if (_pos[n] == EMPTY) {
+            return nil;
+
+        } else if (_pos[n] != DELETED && Equal(_key[n], key)) {
+            return _elem[_pos[n]];
         }
     }
-    return true;
 }
 
 boolean UHashTable::Equal (void* key1, void* key2) { return key1 == key2; }
+int UHashTable::Count () { return _count; }
 
-UHashElem* UHashTable::Find (void* key) {
-    int n = Hash(key);
-    UList* slot = _slot[n];
+/*
+ * Resize the slots and squeeze unregistered elements out of the element
+ * array.  Later elements are entered first so that, for a key registered
+ * more than once, the most recent comes first in its probe sequence.
+ */
 
-    if (slot != nil) {
-        for (UList* u = slot->First(); u != slot->End(); u = u->Next()) {
-            UHashElem* elem = Elem(u);
+void UHashTable::Rehash (int nslots) {
+    int i, j = 0;
 
-            if (Equal(elem->GetKey(), key)) {
-                return elem;
-            }
+    for (i = 0; i < _nelems; ++i) {
+        if (_elem[i] != nil) {
+            _elem[j++] = _elem[i];
         }
     }
-    return nil;
+    _nelems = j;
+
+    if (_count * 2 >= _maxelems) {
+        UHashElem** elem = new UHashElem*[_maxelems * 2];
+        Memory::copy(_elem, elem, _nelems * sizeof(UHashElem*));
+        delete [] _elem;
+        _elem = elem;
+        _maxelems *= 2;
+    }
+    if (nslots != _nslots) {
+        delete [] _key;
+        delete [] _pos;
+        _nslots = nslots;
+        _key = new void*[_nslots];
+        _pos = new int[_nslots];
+    }
+    for (i = 0; i < _nslots; ++i) {
+        _pos[i] = EMPTY;
+    }
+    _deleted = 0;
+
+    for (i = _nelems - 1; i >= 0; --i) {
+        void* key = _elem[i]->GetKey();
+        int n = Start(key);
+
+        while (_pos[n] != EMPTY) {
+            n = (n + 1) & (_nslots - 1);
+        }
+        _key[n] = key;
+        _pos[n] = i;
+    }
 }
 
-void UHashTable::DeleteSlot (UList* slot) {
-    while (!slot->IsEmpty()) {
-        UList* u = slot->First();
-        slot->Remove(u);
-        UHashElem* elem = Elem(u);
-        delete elem;
-        delete u;
+int UHashTable::Position (Iterator i) { return (int) (long) i.GetValue(); }
+
+UHashElem* UHashTable::GetElem (Iterator i) { return _elem[Position(i)]; }
+
+void UHashTable::First (Iterator& i) {
+    int pos = 0;
+
+    while (pos < _nelems && _elem[pos] == nil) {
+        ++pos;
+    }
+    i.SetValue((void*) long(pos));
+}
+
+void UHashTable::Next (Iterator& i) {
+    int pos = Position(i) + 1;
+
+    while (pos < _nelems && _elem[pos] == nil) {
+        ++pos;
     }
-    delete slot;
+    i.SetValue((void*) long(pos));
 }
 
+boolean UHashTable::Done (Iterator i) { return Position(i) >= _nelems; }
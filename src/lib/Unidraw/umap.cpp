@@ -28,48 +28,223 @@
  */
 
 #include <Unidraw/globals.h>
+#include <Unidraw/iterator.h>
+#include <Unidraw/uhash.h>
 #include <Unidraw/umap.h>
 
 #include <string.h>
 
 /*****************************************************************************/
 
-UMapElem::UMapElem () { }
+static const int SLOTS = 16;
+
+/*****************************************************************************/
+
+UMapElem::UMapElem () { _index = -1; }
 UMapElem::~UMapElem () { }
 void* UMapElem::id () { return nil; }
 void* UMapElem::tag () { return nil; }
 
 /*****************************************************************************/
 
-UMap::UMap () { }
-UMap::~UMap () { Clear(); }
+class UMapIndexElem : public UHashElem {
+public:
+    UMapIndexElem(UMapElem*, int count);
+public:
+    UMapElem* _elem;                    /* earliest with this key */
+    int _count;                         /* number registered with this key */
+};
+
+UMapIndexElem::UMapIndexElem (UMapElem* elem, int count) {
+    _elem = elem;
+    _count = count;
+}
+
+/*****************************************************************************/
+
+class UMapIndex : public UHashTable {
+public:
+    UMapIndex(boolean strings, boolean tags);
+
+    void Insert(UMapElem*);
+    void Remove(UMapElem*, UArray&);
+    void Clear();
+
+    UMapElem* Lookup(void* key);
+protected:
+    virtual int Hash(void*);
+    virtual boolean Equal(void*, void*);
+private:
+    void* Key(UMapElem*);
+private:
+    boolean _strings;
+    boolean _tags;
+};
+
+UMapIndex::UMapIndex (boolean strings, boolean tags) : UHashTable(SLOTS) {
+    _strings = strings;
+    _tags = tags;
+}
+
+inline void* UMapIndex::Key (UMapElem* elem) {
+    return _tags ? elem->tag() : elem->id();
+}
+
+int UMapIndex::Hash (void* key) {
+    if (!_strings) {
+        return UHashTable::Hash(key);
+    }
+    unsigned int h = 2166136261U;
+
+    if (key != nil) {
+        for (const char* s = (const char*) key; *s != '\0'; ++s) {
+            h = (h ^ (unsigned char) *s) * 16777619U;
+        }
+    }
+    return int(h & 0x7fffffff);
+}
+
+boolean UMapIndex::Equal (void* key1, void* key2) {
+    if (!_strings || key1 == nil || key2 == nil) {
+        return key1 == key2;
+    }
+    return strcmp((const char*) key1, (const char*) key2) == 0;
+}
+
+void UMapIndex::Insert (UMapElem* elem) {
+    void* key = Key(elem);
+    UMapIndexElem* e = (UMapIndexElem*) Find(key);
+
+    if (e == nil) {
+        Register(key, new UMapIndexElem(elem, 1));
+    } else {
+        ++e->_count;
+    }
+}
+
+/*
+ * Called once elem has left elems, which may hold nils.  If elem was
+ * the one found under its key but others share the key, the earliest
+ * of those takes its place.
+ */
+
+void UMapIndex::Remove (UMapElem* elem, UArray& elems) {
+    void* key = Key(elem);
+    UMapIndexElem* e = (UMapIndexElem*) Find(key);
+
+    if (e == nil) {
+        return;
+
+    } else if (--e->_count == 0) {
+        Unregister(key);
+
+    } else if (e->_elem == elem) {
+        int count = e->_count;
+        Unregister(key);
+
+        for (int i = 0; i < elems.Count(); ++i) {
+            UMapElem* next = (UMapElem*) elems[i];
+
+            if (next != nil && Equal(Key(next), key)) {
+                Register(Key(next), new UMapIndexElem(next, count));
+                break;
+            }
+        }
+    }
+}
+
+void UMapIndex::Clear () {
+    Iterator i;
+
+    for (First(i); !Done(i); ) {
+        Unregister(i);
+    }
+}
+
+UMapElem* UMapIndex::Lookup (void* key) {
+    UMapIndexElem* e = (UMapIndexElem*) Find(key);
+    return (e == nil) ? nil : e->_elem;
+}
+
+/*****************************************************************************/
+
+UMap::UMap (boolean string_ids, boolean string_tags) {
+    _ids = new UMapIndex(string_ids, false);
+    _tags = new UMapIndex(string_tags, true);
+    _holes = 0;
+}
+
+UMap::~UMap () {
+    Clear();
+    delete _ids;
+    delete _tags;
+}
 
 void UMap::Clear () { 
+    _ids->Clear();
+    _tags->Clear();
+
     for (int i = 0; i < _elems.Count(); ++i) {
-        UMapElem* e = Elem(i);
+        UMapElem* e = (UMapElem*) _elems[i];
         delete e;
     }
     _elems.Clear(); 
+    _holes = 0;
+}
+
+void UMap::Register (UMapElem* elem) {
+    elem->_index = _elems.Count();
+    _elems.Insert(elem, _elems.Count());
+    _ids->Insert(elem);
+    _tags->Insert(elem);
 }
 
+void UMap::Unregister (UMapElem* elem) {
+    int index = elem->_index;
 
-void UMap::Register (UMapElem* elem) { _elems.Insert(elem, _elems.Count()); }
-void UMap::Unregister (UMapElem* elem) { _elems.Remove(_elems.Index(elem)); }
+    if (index >= 0 && index < _elems.Count() && _elems[index] == elem) {
+        _elems[index] = nil;
+        elem->_index = -1;
+        ++_holes;
+        _ids->Remove(elem, _elems);
+        _tags->Remove(elem, _elems);
 
-UMapElem* UMap::FindId (void* id) {
-    for (int i = 0; i < _elems.Count(); ++i) {
-        if (Elem(i)->id() == id) {
-            return (UMapElem*) _elems[i];
+        if (_holes > _elems.Count() / 2) {
+            Compact();
         }
     }
-    return nil;
 }
 
-UMapElem* UMap::FindTag (void* tag) {
+int UMap::Index (UMapElem* elem) {
+    if (_holes != 0) {
+        Compact();
+    }
+    int index = elem->_index;
+    return (index >= 0 && index < _elems.Count() && _elems[index] == elem) ?
+        index : -1;
+}
+
+/*
+ * Close up the holes unregistering left, keeping the elements in the
+ * order they were registered.
+ */
+
+void UMap::Compact () {
+    int j = 0;
+
     for (int i = 0; i < _elems.Count(); ++i) {
-        if (Elem(i)->tag() == tag) {
-            return (UMapElem*) _elems[i];
+        UMapElem* e = (UMapElem*) _elems[i];
+
+        if (e != nil) {
+            e->_index = j;
+            _elems[j++] = e;
         }
     }
-    return nil;
+    while (_elems.Count() > j) {
+        _elems.Remove(_elems.Count() - 1);
+    }
+    _holes = 0;
 }
+
+UMapElem* UMap::FindId (void* id) { return _ids->Lookup(id); }
+UMapElem* UMap::FindTag (void* tag) { return _tags->Lookup(tag); }
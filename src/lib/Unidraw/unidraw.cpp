@@ -33,6 +33,7 @@
 #include <Unidraw/globals.h>
 #include <Unidraw/iterator.h>
 #include <Unidraw/statevars.h>
+#include <Unidraw/uhash.h>
 #include <Unidraw/ulist.h>
 #include <Unidraw/umap.h>
 #include <Unidraw/unidraw.h>
@@ -48,11 +49,13 @@
 
 #include <IV-2_6/_enter.h>
 
+#include <ivstream.h>
 #include <stdlib.h>
 
 /*****************************************************************************/
 
 static const int DEFAULT_HISTLEN = 20;
+static const int HISTSIZES_SIZE = 64;
 
 /*****************************************************************************/
 
@@ -136,6 +139,79 @@ Component* HistoryMap::GetComponent (int index) {
     return (Component*) Elem(index)->id();
 }
 
+/*****************************************************************************/
+
+class CommandSize : public UHashElem {
+public:
+    CommandSize(long);
+public:
+    long _size;
+};
+
+CommandSize::CommandSize (long size) { _size = size; }
+
+static long SizeOf (UHashTable* sizes, Command* cmd) {
+    CommandSize* cs = (CommandSize*) sizes->Find(cmd);
+    return (cs == nil) ? 0 : cs->_size;
+}
+
+static long SizeOf (UHashTable* sizes, UList* hist) {
+    long size = 0;
+
+    for (UList* u = hist->First(); u != hist->End(); u = u->Next()) {
+        size += SizeOf(sizes, (Command*) (*u)());
+    }
+    return size;
+}
+
+/*****************************************************************************/
+
+/*
+ * A record of the commands that fall off the end of the history, in the
+ * catalog's text form; it is opened when the first one is written.
+ */
+
+class HistoryLog {
+public:
+    HistoryLog(const char*);
+    virtual ~HistoryLog();
+
+    void Write(Command*);
+private:
+    char* _name;
+    filebuf* _fbuf;
+    ostream* _out;
+};
+
+HistoryLog::HistoryLog (const char* name) {
+    _name = strnew(name);
+    _fbuf = nil;
+    _out = nil;
+}
+
+HistoryLog::~HistoryLog () {
+    delete _out;
+    delete _fbuf;
+    delete [] _name;
+}
+
+void HistoryLog::Write (Command* cmd) {
+    Catalog* catalog = unidraw->GetCatalog();
+
+    if (_fbuf == nil) {
+        _fbuf = new filebuf;
+
+        if (_fbuf->open(_name, IOS_OUT) != 0) {
+            _out = new ostream(_fbuf);
+            catalog->WriteVersion(catalog->GetVersion(), *_out);
+        }
+    }
+    if (_out != nil) {
+        catalog->WriteCommand(cmd, *_out);
+        _out->flush();
+    }
+}
+
 
 /*****************************************************************************/
 
@@ -207,6 +283,8 @@ void Unidraw::Init (Catalog* c, World* w) {
     updated(false);
 
     _histories = new HistoryMap;
+    _histsizes = new UHashTable(HISTSIZES_SIZE);
+    _histlog = nil;
 
     InitAttributes();
 }
@@ -215,6 +293,8 @@ Unidraw::~Unidraw () {
     CloseAll();
     ClearHistory();
     delete _histories;
+    delete _histsizes;
+    delete _histlog;
     delete _editors;
     delete _deadEditors;
     delete _catalog;
@@ -224,6 +304,15 @@ Unidraw::~Unidraw () {
 void Unidraw::InitAttributes () {
     const char* attrib = GetWorld()->GetAttribute("history");
     _histlen = (attrib == nil) ? DEFAULT_HISTLEN : atoi(attrib);
+
+    attrib = GetWorld()->GetAttribute("historyBudget");
+    _histbudget = (attrib == nil) ? 0 : atol(attrib);
+
+    attrib = GetWorld()->GetAttribute("historyLog");
+
+    if (attrib != nil && *attrib != '\0') {
+        _histlog = new HistoryLog(attrib);
+    }
 }
 
 void Unidraw::Mark (Editor* editor) {
@@ -386,6 +475,34 @@ Editor* Unidraw::FindAny (Component* comp, UList* editors) {
 
 void Unidraw::SetHistoryLength (int hl) { _histlen = hl; }
 int Unidraw::GetHistoryLength () { return _histlen; }
+void Unidraw::SetHistoryBudget (long hb) { _histbudget = hb; }
+long Unidraw::GetHistoryBudget () { return _histbudget; }
+
+/*
+ * Commands are sized when they are logged; the figure does not change
+ * as they are undone and redone.
+ */
+
+long Unidraw::GetHistorySize (Component* comp) {
+    long size = 0;
+
+    if (comp == nil) {
+        Iterator i;
+
+        for (_histsizes->First(i); !_histsizes->Done(i); _histsizes->Next(i)) {
+            size += ((CommandSize*) _histsizes->GetElem(i))->_size;
+        }
+
+    } else {
+        History* history = _histories->GetHistory(comp->GetRoot());
+
+        if (history != nil) {
+            size = SizeOf(_histsizes, history->_past);
+            size += SizeOf(_histsizes, history->_future);
+        }
+    }
+    return size;
+}
 
 void Unidraw::ClearHistory (Editor* ed) {
     Component* comp = ed->GetComponent();
@@ -429,6 +546,7 @@ void Unidraw::ClearHistory (UList* hist, int start) {
             Editor* ed = cmd->GetEditor();
 
 	    Resource::unref(ed);
+            _histsizes->Unregister(cmd);
 
             delete cmd;
             delete doomed;
@@ -455,8 +573,35 @@ void Unidraw::Log (Command* cmd) {
 	}
 	    
         past->Prepend(new UList(cmd));
-        ClearHistory(past, _histlen+1);
+        _histsizes->Register(cmd, new CommandSize(cmd->Size()));
+        TrimHistory(past);
+    }
+}
+
+/*
+ * Keep no more than _histlen commands and, given a budget, only the most
+ * recent that fit in it, though always the latest.  What is dropped goes
+ * to the history log if there is one.
+ */
+
+void Unidraw::TrimHistory (UList* past) {
+    long size = 0;
+    int n = 1;
+    UList* u;
+
+    for (u = past->First(); u != past->End(); u = u->Next(), ++n) {
+        size += SizeOf(_histsizes, command(u));
+
+        if (n > _histlen || (n > 1 && _histbudget > 0 && size > _histbudget)) {
+            break;
+        }
+    }
+    if (_histlog != nil) {
+        for (UList* v = u; v != past->End(); v = v->Next()) {
+            _histlog->Write(command(v));
+        }
     }
+    ClearHistory(past, n);
 }
 
 void Unidraw::Process () {
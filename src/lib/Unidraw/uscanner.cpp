@@ -0,0 +1,145 @@
+#ifdef HAVE_CONFIG_H
+#include <../../config.h>
+#endif
+/*
+ * UScanner implementation.
+ */
+
+#include <Unidraw/uscanner.h>
+
+#include <OS/file.h>
+#include <OS/memory.h>
+#include <OS/string.h>
+
+#include <string.h>
+
+/*****************************************************************************/
+
+/*
+ * Values of hex digits, or -1 for anything else.
+ */
+
+static signed char hexval[256];
+static boolean hexvalInit = false;
+
+static void InitHexVal () {
+    if (!hexvalInit) {
+        int i;
+
+        hexvalInit = true;
+
+        for (i = 0; i < 256; ++i) {
+            hexval[i] = -1;
+        }
+        for (i = 0; i < 10; ++i) {
+            hexval['0' + i] = i;
+        }
+        for (i = 0; i < 6; ++i) {
+            hexval['a' + i] = hexval['A' + i] = 10 + i;
+        }
+    }
+}
+
+/*****************************************************************************/
+
+UScanner::UScanner (const char* filename) {
+    const char* start = nil;
+    long len = 0;
+
+    _buf = nil;
+    _file = InputFile::open(String(filename));
+
+    if (_file != nil) {
+        len = _file->read(start);
+    }
+    if (len <= 0) {
+        start = nil;
+        len = 0;
+    }
+    Init(start, len);
+}
+
+UScanner::UScanner (FILE* file) {
+    long size = BUFSIZ, len = 0;
+
+    _file = nil;
+    _buf = new char[size];
+
+    for (;;) {
+        len += fread(&_buf[len], 1, size - len, file);
+
+        if (len < size) {
+            break;
+        }
+        char* buf = new char[size * 2];
+        Memory::copy(_buf, buf, len);
+        delete [] _buf;
+        _buf = buf;
+        size *= 2;
+    }
+    Init(_buf, len);
+}
+
+UScanner::~UScanner () {
+    delete _file;
+    delete [] _buf;
+}
+
+void UScanner::Init (const char* start, long len) {
+    InitHexVal();
+    setg((char*) start, (char*) start, (char*) start + len);
+}
+
+boolean UScanner::Valid () { return _file != nil || _buf != nil; }
+int UScanner::underflow () { return EOF; }
+
+boolean UScanner::GetLine (streambuf* sb, char* line, int size) {
+    int n = 0;
+
+    while (n < size - 1) {
+        int c = sb->sbumpc();
+
+        if (c == EOF) {
+            break;
+        }
+        line[n++] = char(c);
+
+        if (c == '\n') {
+            break;
+        }
+    }
+    if (size > 0) {
+        line[n] = '\0';
+    }
+    return n > 0;
+}
+
+/*
+ * Blanks and newlines may come before each pair of digits.  Decoding
+ * stops short at anything else that is not a hex digit.
+ */
+
+int UScanner::GetHex (streambuf* sb, unsigned char* bytes, int n) {
+    int i = 0;
+
+    InitHexVal();
+
+    while (i < n) {
+        int c = sb->sgetc();
+
+        while (c == ' ' || c == '\n') {
+            c = sb->snextc();
+        }
+        if (c == EOF || hexval[c] < 0) {
+            break;
+        }
+        int lo = sb->snextc();
+
+        if (lo == EOF || hexval[lo] < 0) {
+            break;
+        }
+        bytes[i++] = (unsigned char) (hexval[c] << 4 | hexval[lo]);
+        sb->sbumpc();
+    }
+    return i;
+}